@@ -1,7 +1,12 @@
 string(TIMESTAMP date "%Y%m%d")
 
+# Objects are reused for a day, the format version makes a layout change rebuild them
+get_filename_component(SCRIPT_DIR "${PYTHON_SCRIPT}" DIRECTORY)
+file(STRINGS "${SCRIPT_DIR}/gamedb_writer.py" GAMEDB_VERSION_LINE REGEX "^GAMEDB_VERSION = ")
+string(REGEX REPLACE "^GAMEDB_VERSION = ([0-9]+).*" "\\1" GAMEDB_VERSION "${GAMEDB_VERSION_LINE}")
+
 set(GAMEDB_${SYSTEM}_BIN "gamedb${SYSTEM}.dat")
-set(GAMEDB_${SYSTEM}_OBJ "${OUTPUT_DIR}/gamedb${SYSTEM}_${date}.o")
+set(GAMEDB_${SYSTEM}_OBJ "${OUTPUT_DIR}/gamedb${SYSTEM}_v${GAMEDB_VERSION}_${date}.o")
 
 if(NOT EXISTS "${GAMEDB_${SYSTEM}_OBJ}")
 
@@ -34,7 +39,7 @@ execute_process(
     OUTPUT_QUIET
 )
 execute_process(
-    COMMAND ${CMAKE_OBJCOPY} --input-target=binary --output-target=elf32-littlearm --binary-architecture arm --rename-section .data=.rodata "${GAMEDB_${SYSTEM}_BIN}" "${GAMEDB_${SYSTEM}_OBJ}"
+    COMMAND ${CMAKE_OBJCOPY} --input-target=binary --output-target=${OBJCOPY_TARGET} --binary-architecture ${OBJCOPY_ARCH} --rename-section .data=.rodata "${GAMEDB_${SYSTEM}_BIN}" "${GAMEDB_${SYSTEM}_OBJ}"
     WORKING_DIRECTORY ${OUTPUT_DIR}
     OUTPUT_QUIET
 )
@@ -0,0 +1,185 @@
+# Layout of the generated game databases, read by src/game_db/game_db.c.
+# All values are big endian.
+#
+# Header, 4 byte each:
+#   Magic "GMDB"
+#   Format version, bumped on any layout change
+#   Number of hash buckets, 0 if no hash was found
+#   Number of hash slots, at least the number of games
+#   Number of games
+#   Hash seed
+#   Number of prefixes
+#   Offset of the prefix table
+#   Offset of the bucket table
+#   Offset of the game entries
+#   Number of game names
+#   Offset of the name block table
+#
+# Prefix table, 4 byte per prefix: its chars padded with ws, sorted
+#
+# Bucket table, 2 byte per bucket: displacement of the bucket, see gameHash
+#
+# Game entries, 12 bytes each, one per hash slot:
+#   Index of the prefix + 1 (1 byte) and the game ID without prefix (3 byte)
+#   Index of the game name
+#   Parent Game ID - if multi disc this is equal to Game ID
+# Slots without a game are all zero.
+#
+# Name block table, 4 byte per block: offset of the block
+#
+# Last: game names, sorted and front coded in blocks of NAME_BLOCK_SIZE. Each
+# name is the count of leading chars it shares with the previous name of its
+# block (1 byte, 0 for the first one) followed by the null terminated rest.
+#
+# The entries form a perfect hash over (prefix, ID): an entry sits in slot
+# gameHash(key, d) % slots, d being the displacement stored for bucket
+# gameHash(key, seed) % buckets. A lookup reads one bucket and one entry.
+#
+# If no displacement fits a bucket, the hash is built again with another seed,
+# more buckets and a few spare slots. Should that keep failing, the DB is
+# written without buckets, entries sorted by (prefix, ID), and lookups binary
+# search the entries.
+
+GAMEDB_MAGIC = b"GMDB"
+GAMEDB_VERSION = 4
+
+HEADER_SIZE = 48
+GAME_ENTRY_SIZE = 12
+MAX_GAME_ID = 0xFFFFFF
+MAX_PREFIXES = 0xFF
+NAME_BLOCK_SIZE = 16
+KEYS_PER_BUCKET = 2
+MAX_DISPLACEMENT = 0xFFFF
+MAX_HASH_ATTEMPTS = 16
+
+
+def paddedPrefix(prefix):
+    return (prefix + (4 - len(prefix)) * " ").encode('ascii')
+
+
+# FNV-1a over the seed and the 8 key bytes plus the murmur3 finalizer, FNV
+# alone leaves the low bits too regular. Mirrored by game_db_hash
+def gameHash(prefix, id, seed):
+    h = 0x811c9dc5 ^ seed
+    for b in prefix + id.to_bytes(4, 'big'):
+        h ^= b
+        h = (h * 0x01000193) & 0xFFFFFFFF
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+
+def tryHash(keys, num_buckets, num_slots, seed):
+    buckets = [[] for _ in range(num_buckets)]
+    for key in keys:
+        buckets[gameHash(key[0], key[1], seed) % num_buckets].append(key)
+
+    displacements = [0] * num_buckets
+    slots = [None] * num_slots
+    # Largest buckets first, while most slots are still free
+    for bucket in sorted(range(num_buckets), key=lambda b: len(buckets[b]), reverse=True):
+        if not buckets[bucket]:
+            break
+        for d in range(1, MAX_DISPLACEMENT + 1):
+            taken = [gameHash(key[0], key[1], d) % num_slots for key in buckets[bucket]]
+            if len(set(taken)) == len(taken) and all(slots[s] is None for s in taken):
+                break
+        else:
+            return None
+        displacements[bucket] = d
+        for key, s in zip(buckets[bucket], taken):
+            slots[s] = key
+
+    return (displacements, slots)
+
+
+def buildHash(keys):
+    num_buckets = len(keys) // KEYS_PER_BUCKET + 1
+    num_slots = len(keys)
+    seed = 0
+    for attempt in range(MAX_HASH_ATTEMPTS):
+        result = tryHash(keys, num_buckets, num_slots, seed)
+        if result is not None:
+            return (seed,) + result
+        seed = (seed + 0x9e3779b9) & 0xFFFFFFFF
+        num_buckets = num_buckets * 5 // 4 + 1
+        num_slots = num_slots + len(keys) // 32 + 1
+        print("No perfect hash for {} games, retrying with {} buckets and {} slots".format(len(keys), num_buckets, num_slots))
+
+    print("No perfect hash for {} games, lookups will binary search".format(len(keys)))
+    return (0, [], sorted(keys))
+
+
+def frontCode(names):
+    block = bytearray()
+    previous = b""
+    for name in names:
+        encoded = name.encode('ascii')
+        shared = 0
+        while shared < min(len(previous), len(encoded), 255) and previous[shared] == encoded[shared]:
+            shared += 1
+        block.append(shared)
+        block += encoded[shared:] + b"\x00"
+        previous = encoded
+    return bytes(block)
+
+
+def writeSortedGameList(outfile, games_sorted, gamenames):
+    term = 0
+
+    # The first entry of an ID wins, like the linear scan the hash replaced
+    games = {}
+    for prefix in games_sorted:
+        for game in games_sorted[prefix]:
+            key = (paddedPrefix(prefix), int(game.id))
+            if key not in games:
+                games[key] = game
+
+    prefixes = sorted(set(key[0] for key in games))
+    prefix_to_index = {prefix: index for index, prefix in enumerate(prefixes)}
+    if len(prefixes) > MAX_PREFIXES or any(key[1] > MAX_GAME_ID for key in games):
+        raise ValueError("Game IDs do not fit the game entries")
+
+    (seed, displacements, slots) = buildHash(list(games.keys()))
+
+    names = sorted(set(gamenames))
+    name_to_index = {name: index for index, name in enumerate(names)}
+    name_blocks = [frontCode(names[i:i + NAME_BLOCK_SIZE]) for i in range(0, len(names), NAME_BLOCK_SIZE)]
+
+    # Calculate general offsets
+    prefixes_offset = HEADER_SIZE
+    buckets_offset = prefixes_offset + len(prefixes) * 4
+    game_ids_offset = buckets_offset + ((len(displacements) * 2 + 3) & ~3)
+    name_blocks_offset = game_ids_offset + len(slots) * GAME_ENTRY_SIZE
+    offset = name_blocks_offset + len(name_blocks) * 4
+
+    outfile.write(GAMEDB_MAGIC)
+    for value in [GAMEDB_VERSION, len(displacements), len(slots), len(games), seed, len(prefixes), prefixes_offset,
+                  buckets_offset, game_ids_offset, len(names), name_blocks_offset]:
+        outfile.write(value.to_bytes(4, 'big'))
+
+    for prefix in prefixes:
+        outfile.write(prefix)
+
+    for d in displacements:
+        outfile.write(d.to_bytes(2, 'big'))
+    outfile.write(term.to_bytes(game_ids_offset - buckets_offset - len(displacements) * 2, 'big'))
+
+    for key in slots:
+        if key is None:
+            outfile.write(term.to_bytes(GAME_ENTRY_SIZE, 'big'))
+            continue
+        game = games[key]
+        outfile.write(((prefix_to_index[key[0]] + 1) << 24 | key[1]).to_bytes(4, 'big'))
+        outfile.write(name_to_index[game.name].to_bytes(4, 'big'))
+        outfile.write(int(game.parent_id).to_bytes(4, 'big'))
+
+    for block in name_blocks:
+        outfile.write(offset.to_bytes(4, 'big'))
+        offset = offset + len(block)
+
+    for block in name_blocks:
+        outfile.write(block)
@@ -3,6 +3,8 @@ import json
 import re
 from unidecode import unidecode
 
+from gamedb_writer import writeSortedGameList
+
 
 disc_pattern = r'\(Disc (\d)\)'
 replacer = r'\((.*)\)'
@@ -30,46 +32,6 @@ class GameId:
         return self.name < o.name
 
 
-def writeSortedGameList(outfile, prefixes, games_count, games_sorted, gamenames):
-    term = 0
-    # Calculate general offsets
-    game_ids_offset = (len(prefixes) + 1) * 8
-    game_names_base_offset = game_ids_offset + (games_count * 12) + (len(prefixes) * 12)
-    prefix_offset = game_ids_offset
-
-    offset = game_names_base_offset
-    game_name_to_offset = {}
-    # Calculate offset for each game name
-    for gamename in gamenames:
-        game_name_to_offset[gamename] = offset
-        offset = offset + len(gamename) + 1
-    # First: write prefix Indices in the format 
-    # 4 Byte: Index Chars, padded with ws in the end
-    # 4 Byte: Index Offset within dat
-    for prefix in games_sorted:
-        adjustedPrefix = prefix
-        if len(prefix) < 4:
-            adjustedPrefix = prefix + (4 - len(prefix) ) * " "
-        outfile.write(adjustedPrefix.encode('ascii'))
-        outfile.write(prefix_offset.to_bytes(4, 'big'))
-        prefix_offset = prefix_offset + (len(games_sorted[prefix]) + 1) * 12
-    outfile.write(term.to_bytes(8, 'big'))
-    # Next: write game entries for each index in the format:
-    # 4 Byte: Game ID without prefix, Big Endian
-    # 4 Byte: Offset to game name, Big Endian
-    # 4 Byte: Parent Game ID - if multi disc this is equal to Game ID
-    for prefix in games_sorted:
-        for game in games_sorted[prefix]:
-            #print(game)
-            outfile.write(int(game.id).to_bytes(4, 'big'))
-            outfile.write(game_name_to_offset[game.name].to_bytes(4, 'big'))
-            outfile.write(int(game.parent_id).to_bytes(4, 'big'))
-        outfile.write(term.to_bytes(12, 'big'))
-    # Last: write null terminated game names
-    for game in game_name_to_offset:
-        outfile.write(game.encode('ascii'))
-        outfile.write(term.to_bytes(1, 'big'))
-
 def getGamesGameDB() -> ([], [], {}, int):
     prefixes = []
     gamenames = []
@@ -135,5 +97,5 @@ games_count = 0
 
 with open("gamedbps1.dat", "wb") as out:
     (prefixes, gamenames, games_sorted, games_count) = getGamesGameDB()
-    writeSortedGameList(out, prefixes, games_count, games_sorted, gamenames)
+    writeSortedGameList(out, games_sorted, gamenames)
 
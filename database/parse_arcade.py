@@ -1,6 +1,8 @@
 import requests
 import json
 
+from gamedb_writer import writeSortedGameList
+
 def getGamesGameDB(system) -> dict[str, str]:
     url = f"https://raw.githubusercontent.com/israpps/AthenaEnv/refs/heads/aclauncher/bin/aclauncher/{system}.json"
 
@@ -43,21 +45,16 @@ filename = "gamedbcoh.dat"
 games_dict = getGamesGameDB("246") | getGamesGameDB("256")
 
 
-# Assemble Arcade DB:
+# Assemble Arcade DB, laid out like the console ones with NM as the only prefix:
 
-game_ids_section_length = (len(games_dict) +1 ) * 8
-game_names_section_length = 0
-name_offsets = { }
-with open(filename, "wb") as out:
-    term = 0
-    for id in games_dict:
-        name_offsets[id] = game_ids_section_length + game_names_section_length
-        game_names_section_length += len(games_dict[id]) + 1
-        out.write(int(id).to_bytes(4, 'big'))
-        out.write(name_offsets[id].to_bytes(4, 'big'))
-    out.write(term.to_bytes(8, 'big'))
-
-    for id in games_dict:
-        out.write(games_dict[id].encode("ascii"))
-        out.write(b"\x00")
+class ArcadeGame:
+    def __init__(self, id, name):
+        self.id = id
+        self.parent_id = id
+        self.name = name
 
+games_sorted = { "NM": [ArcadeGame(id, games_dict[id]) for id in games_dict] }
+gamenames = list(dict.fromkeys(games_dict.values()))
+
+with open(filename, "wb") as out:
+    writeSortedGameList(out, games_sorted, gamenames)
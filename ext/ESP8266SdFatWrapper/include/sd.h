@@ -2,6 +2,7 @@
 
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define SEEK_SET 0
@@ -41,6 +42,17 @@ typedef struct sd_file_stat_t {
     bool writable;
 } sd_file_stat_t;
 
+/* Contiguous files are accessed with raw sector transfers when reads and
+ * writes are sector aligned, counters show how often that was the case */
+typedef struct sd_fast_path_stat_t {
+    bool active;
+    uint32_t first_lba;
+    uint32_t fast_reads;
+    uint32_t fast_writes;
+    uint32_t slow_reads;
+    uint32_t slow_writes;
+} sd_fast_path_stat_t;
+
 void sd_init(void);
 int sd_open(const char *path, int oflag);
 int sd_close(int fd);
@@ -67,4 +79,7 @@ int sd_fd_is_open(int fd);
 
 uint64_t sd_filesize64(int fd);
 int sd_seek64(int fd, int64_t offset, int whence);
-uint64_t sd_tell64(int fd);
\ No newline at end of file
+uint64_t sd_tell64(int fd);
+
+int sd_get_fast_path_stat(int fd, sd_fast_path_stat_t* const stat);
+int sd_preallocate(int fd, uint64_t size);
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Host implementation of sd.h on top of a directory of the build machine.
+ * Every call is charged a simulated latency drawn from a per-operation
+ * distribution plus the time its payload takes at the configured bandwidth.
+ * Random draws come from a seeded generator so runs are reproducible. */
+
+typedef enum sd_posix_op_t {
+    SD_POSIX_OP_OPEN = 0,
+    SD_POSIX_OP_CLOSE,
+    SD_POSIX_OP_READ,
+    SD_POSIX_OP_WRITE,
+    SD_POSIX_OP_SEEK,
+    SD_POSIX_OP_FLUSH,
+    SD_POSIX_OP_META,       //mkdir, exists, remove, rmdir, stat, dir iteration
+    SD_POSIX_OP_COUNT
+} sd_posix_op_t;
+
+/* Uniform in [min_us, max_us], plus spike_us with a probability of
+ * spike_permille / 1000 to model erase and garbage collection stalls */
+typedef struct sd_posix_latency_t {
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t spike_us;
+    uint16_t spike_permille;
+} sd_posix_latency_t;
+
+typedef struct sd_posix_config_t {
+    sd_posix_latency_t latency[SD_POSIX_OP_COUNT];
+    uint32_t read_bytes_per_s;      //0 for unlimited
+    uint32_t write_bytes_per_s;     //0 for unlimited
+    uint16_t short_read_permille;   //chance of returning fewer bytes than asked for
+    uint16_t short_write_permille;
+    uint32_t seed;
+} sd_posix_config_t;
+
+typedef struct sd_posix_stat_t {
+    uint32_t ops[SD_POSIX_OP_COUNT];
+    uint64_t delay_us[SD_POSIX_OP_COUNT];
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint32_t short_reads;
+    uint32_t short_writes;
+} sd_posix_stat_t;
+
+/* Consumes the simulated delay of an operation. The default one sleeps,
+ * simulations with their own clock advance it here instead */
+typedef void (*sd_posix_delay_cb_t)(uint64_t us);
+
+/* Directory used as the card root, "." unless set or SD2PSX_SD_ROOT is given */
+void sd_posix_set_root(const char *path);
+/* Resets the generator to config->seed, NULL restores a zero latency setup */
+void sd_posix_configure(const sd_posix_config_t *config);
+void sd_posix_set_delay_cb(sd_posix_delay_cb_t cb);
+
+void sd_posix_get_stat(sd_posix_stat_t *stat);
+void sd_posix_reset_stat(void);
@@ -21,6 +21,8 @@
 #include "SPI.h"
 #include <hardware/spi.h>
 #include <hardware/gpio.h>
+#include <hardware/dma.h>
+#include <pico/time.h>
 
 #ifdef USE_TINYUSB
 // For Serial when selecting TinyUSB.  Can't include in the core because Arduino IDE
@@ -40,6 +42,9 @@ SPIClassRP2040::SPIClassRP2040(spi_inst_t *spi, pin_size_t rx, pin_size_t cs, pi
     _TX = tx;
     _SCK = sck;
     _CS = cs;
+    _dmaTx = -1;
+    _dmaRx = -1;
+    _dmaError = false;
 }
 
 inline spi_cpol_t SPIClassRP2040::cpol() {
@@ -130,9 +135,88 @@ uint16_t SPIClassRP2040::transfer16(uint16_t data) {
     return ret;
 }
 
+// The PSRAM driver claims DMA channels 0-3 on demand, so take ours from the top
+bool SPIClassRP2040::dmaClaim() {
+    if (_dmaTx >= 0) {
+        return true;
+    }
+    for (int ch = NUM_DMA_CHANNELS - 1; ch > 0; ch--) {
+        if (!dma_channel_is_claimed(ch) && !dma_channel_is_claimed(ch - 1)) {
+            dma_channel_claim(ch);
+            dma_channel_claim(ch - 1);
+            _dmaRx = ch;
+            _dmaTx = ch - 1;
+            DEBUGSPI("SPI: using DMA channels tx=%d, rx=%d\n", _dmaTx, _dmaRx);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Full duplex DMA transfer, either buffer may be nullptr. rxbuf may alias
+// txbuf as every byte is sent before its reply can arrive.
+bool SPIClassRP2040::dmaTransfer(const uint8_t *txbuf, uint8_t *rxbuf, size_t count) {
+    static const uint8_t txdummy = 0xFF;
+    static uint8_t rxdummy;
+    io_rw_32 *dr = &spi_get_hw(_spi)->dr;
+
+    dma_channel_config c = dma_channel_get_default_config(_dmaTx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(_spi, true));
+    channel_config_set_read_increment(&c, txbuf != nullptr);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(_dmaTx, &c, dr, txbuf ? txbuf : &txdummy, count, false);
+
+    c = dma_channel_get_default_config(_dmaRx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(_spi, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, rxbuf != nullptr);
+    dma_channel_configure(_dmaRx, &c, rxbuf ? rxbuf : &rxdummy, dr, count, false);
+
+    // Allow for 4x the nominal wire time before declaring the bus stuck
+    uint64_t timeout = ((uint64_t)count * 8 * 4 * 1000000) / _spis.getClockFreq() + 1000;
+    uint64_t deadline = time_us_64() + timeout;
+
+    dma_start_channel_mask((1u << _dmaTx) | (1u << _dmaRx));
+    while (dma_channel_is_busy(_dmaRx)) {
+        if (time_us_64() > deadline) {
+            DEBUGSPI("SPI: DMA transfer of %d timed out, %d left\n", count, dma_channel_hw_addr(_dmaRx)->transfer_count);
+            dma_channel_abort(_dmaTx);
+            dma_channel_abort(_dmaRx);
+            while (spi_is_busy(_spi)) {
+                tight_loop_contents();
+            }
+            while (spi_is_readable(_spi)) {
+                (void)*dr;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SPIClassRP2040::transferError() {
+    bool ret = _dmaError;
+    _dmaError = false;
+    return ret;
+}
+
 void SPIClassRP2040::transfer(void *buf, size_t count) {
     DEBUGSPI("SPI::transfer(%p, %d)\n", buf, count);
     uint8_t *buff = reinterpret_cast<uint8_t *>(buf);
+    if (_initted && _spis.getBitOrder() == MSBFIRST) {
+        spi_set_format(_spi, 8, cpol(), cpha(), SPI_MSB_FIRST);
+        if (count >= SPI_DMA_MIN_XFER && dmaClaim()) {
+            if (!dmaTransfer(buff, buff, count)) {
+                _dmaError = true;
+            }
+        } else {
+            spi_write_read_blocking(_spi, buff, buff, count);
+        }
+        DEBUGSPI("SPI::transfer completed\n");
+        return;
+    }
     for (size_t i = 0; i < count; i++) {
         *buff = transfer(*buff);
         *buff = (_spis.getBitOrder() == MSBFIRST) ? *buff : reverseByte(*buff);
@@ -154,6 +238,12 @@ void SPIClassRP2040::transfer(const void *txbuf, void *rxbuf, size_t count) {
     if (_spis.getBitOrder() == MSBFIRST) {
         spi_set_format(_spi, 8, cpol(), cpha(), SPI_MSB_FIRST);
 
+        if (count >= SPI_DMA_MIN_XFER && dmaClaim()) {
+            if (!dmaTransfer(txbuff, rxbuff, count)) {
+                _dmaError = true;
+            }
+            return;
+        }
         if (rxbuf == nullptr) { // transmit only!
             spi_write_blocking(_spi, txbuff, count);
             return;
@@ -285,6 +375,12 @@ void SPIClassRP2040::end() {
         _initted = false;
         spi_deinit(_spi);
     }
+    if (_dmaTx >= 0) {
+        dma_channel_unclaim(_dmaTx);
+        dma_channel_unclaim(_dmaRx);
+        _dmaTx = -1;
+        _dmaRx = -1;
+    }
     gpio_set_function(_RX, GPIO_FUNC_SIO);
     if (_hwCS) {
         gpio_set_function(_CS, GPIO_FUNC_SIO);
@@ -8,6 +8,11 @@
 
 #define DEBUGSPI(...) do { } while(0)
 
+// Buffers of at least this many bytes are moved by DMA instead of by the CPU
+#ifndef SPI_DMA_MIN_XFER
+#define SPI_DMA_MIN_XFER 32
+#endif
+
 typedef enum {
   SPI_MODE0 = 0,
   SPI_MODE1 = 1,
@@ -128,6 +133,9 @@ public:
     // Sends one buffer and receives into another, much faster! can set rx or txbuf to nullptr
     void transfer(const void *txbuf, void *rxbuf, size_t count) override;
 
+    // Returns true if a bulk transfer failed since the last call and clears the flag
+    bool transferError();
+
     // Call before/after every complete transaction
     void beginTransaction(SPISettings settings) override;
     void endTransaction(void) override;
@@ -166,6 +174,8 @@ private:
     uint8_t reverseByte(uint8_t b);
     uint16_t reverse16Bit(uint16_t w);
     void adjustBuffer(const void *s, void *d, size_t cnt, bool by16);
+    bool dmaClaim();
+    bool dmaTransfer(const uint8_t *txbuf, uint8_t *rxbuf, size_t count);
 
     spi_inst_t *_spi;
     SPISettings _spis;
@@ -173,6 +183,8 @@ private:
     bool _hwCS;
     bool _running; // SPI port active
     bool _initted; // Transaction begun
+    int _dmaTx, _dmaRx; // Bulk transfer channels, -1 if unavailable
+    bool _dmaError; // Sticky until transferError() is called
 };
 
 typedef SPIClassRP2040 SPIClass;
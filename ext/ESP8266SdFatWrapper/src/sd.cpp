@@ -11,13 +11,93 @@ extern "C" {
 }
 
 #include <stdio.h>
+#include <string.h>
 
 #define NUM_FILES 16
+#define SECTOR_SIZE 512
+
+/* Directory handles kept open to resolve paths from, saves walking every
+ * path component from the root for repeated accesses to the same folder */
+#define DIR_CACHE_ENTRIES 4
+#define DIR_CACHE_PATH_MAX 128
+
+typedef struct {
+    char path[DIR_CACHE_PATH_MAX];
+    uint32_t last_use;
+    File dir;
+} dir_cache_entry_t;
+
+typedef struct {
+    uint32_t first_lba;
+    uint32_t last_lba;
+    bool dir_dirty;         // raw writes since the last sync, the entry needs its modify time
+    sd_fast_path_stat_t stat;
+} fast_path_t;
 
 static SdFat sd;
 static File files[NUM_FILES + 1];
+static fast_path_t fast_path[NUM_FILES + 1];
 static bool initialized = false;
 
+static dir_cache_entry_t dir_cache[DIR_CACHE_ENTRIES];
+static uint32_t dir_cache_tick;
+
+static void dir_cache_flush(void) {
+    for (int i = 0; i < DIR_CACHE_ENTRIES; ++i) {
+        if (dir_cache[i].dir.isOpen())
+            dir_cache[i].dir.close();
+        dir_cache[i].path[0] = '\0';
+    }
+}
+
+/* Splits path into parent directory and last component and returns an open
+ * handle of the parent, nullptr if path should be resolved from the root */
+static File* dir_cache_lookup(const char *path, const char **name) {
+    const char *sep;
+    size_t len;
+    dir_cache_entry_t *entry = &dir_cache[0];
+
+    while (*path == '/')
+        ++path;
+
+    sep = strrchr(path, '/');
+    /* top level entries and paths with a trailing slash */
+    if (!sep || sep[1] == '\0')
+        return nullptr;
+
+    len = sep - path;
+    if (len == 0 || len >= DIR_CACHE_PATH_MAX)
+        return nullptr;
+
+    *name = sep + 1;
+    ++dir_cache_tick;
+
+    for (int i = 0; i < DIR_CACHE_ENTRIES; ++i) {
+        if (dir_cache[i].dir.isOpen() && strncmp(dir_cache[i].path, path, len) == 0 && dir_cache[i].path[len] == '\0') {
+            dir_cache[i].last_use = dir_cache_tick;
+            return &dir_cache[i].dir;
+        }
+        /* evict the least recently used or a free slot */
+        if (!dir_cache[i].dir.isOpen() || (entry->dir.isOpen() && dir_cache[i].last_use < entry->last_use))
+            entry = &dir_cache[i];
+    }
+
+    if (entry->dir.isOpen())
+        entry->dir.close();
+
+    memcpy(entry->path, path, len);
+    entry->path[len] = '\0';
+
+    if (!entry->dir.open(entry->path, O_RDONLY) || !entry->dir.isDir()) {
+        entry->dir.close();
+        entry->path[0] = '\0';
+        return nullptr;
+    }
+
+    entry->last_use = dir_cache_tick;
+    return &entry->dir;
+}
+
 extern "C" void sd_init() {
     if (!initialized) {
         SD_PERIPH.setRX(SD_MISO);
@@ -48,6 +128,61 @@ void sdCsWrite(SdCsPin_t pin, bool level) {
     gpio_put(pin, level);
 }
 
+/* contiguousRange walks the cluster chain, run it at open and after
+ * preallocating so the walk stays off the first transfer. Counters are kept */
+static void fast_path_detect(int fd) {
+    uint32_t bgn, end;
+
+    fast_path[fd].stat.active = false;
+
+    if (files[fd].isFile() && files[fd].contiguousRange(&bgn, &end)) {
+        fast_path[fd].first_lba = bgn;
+        fast_path[fd].last_lba = end;
+        fast_path[fd].stat.active = true;
+        fast_path[fd].stat.first_lba = bgn;
+    }
+}
+
+/* Raw writes bypass the directory entry. A zero length write through the
+ * filesystem marks it the way the bypassed writes would have, so the next
+ * sync stamps the modify time. SdFat only does that with a date and time
+ * callback set, without one neither kind of write changes the entry */
+static void fast_path_sync_dir(int fd) {
+    if (fast_path[fd].dir_dirty) {
+        files[fd].write(&fast_path[fd], 0);
+        fast_path[fd].dir_dirty = false;
+    }
+}
+
+/* The DMA error flag of the SPI is sticky and shared by all handles. Reads
+ * and writes clear it first, so they only fail on their own transfers */
+static void transfer_error_clear(void) {
+    (void)SD_PERIPH.transferError();
+}
+
+/* Returns the first sector for a raw transfer of count bytes at the current
+ * position or 0 if the transfer has to go through the filesystem */
+static uint32_t fast_path_sector(int fd, size_t count) {
+    uint64_t pos;
+    uint32_t sector;
+
+    if (count == 0 || (count % SECTOR_SIZE) != 0)
+        return 0;
+
+    pos = files[fd].curPosition();
+    if ((pos % SECTOR_SIZE) != 0 || pos + count > files[fd].fileSize())
+        return 0;
+
+    if (!fast_path[fd].stat.active)
+        return 0;
+
+    sector = fast_path[fd].first_lba + (uint32_t)(pos / SECTOR_SIZE);
+    if (sector + count / SECTOR_SIZE - 1 > fast_path[fd].last_lba)
+        return 0;
+
+    return sector;
+}
+
 extern "C" int sd_open(const char *path, int oflag) {
     size_t fd;
 
@@ -59,12 +194,21 @@ extern "C" int sd_open(const char *path, int oflag) {
     if (fd >= NUM_FILES)
         return -1;
 
-    files[fd].open(path, oflag);
+    const char *name;
+    File *dir = dir_cache_lookup(path, &name);
+
+    if (dir)
+        files[fd].open(dir, name, oflag);
+    else
+        files[fd].open(path, oflag);
 
     /* error during opening file */
     if (!files[fd].isOpen())
         return -1;
 
+    memset(&fast_path[fd], 0, sizeof(fast_path[fd]));
+    fast_path_detect(fd);
+
     return fd;
 }
 
@@ -74,25 +218,70 @@ extern "C" int sd_open(const char *path, int oflag) {
 extern "C" int sd_close(int fd) {
     CHECK_FD(fd);
 
+    fast_path_sync_dir(fd);
+    fast_path[fd].stat.active = false;
+
     return files[fd].close() != true;
 }
 
 extern "C" void sd_flush(int fd) {
     CHECK_FD_VOID(fd);
 
+    fast_path_sync_dir(fd);
     files[fd].flush();
 }
 
 extern "C" int sd_read(int fd, void *buf, size_t count) {
     CHECK_FD(fd);
 
-    return files[fd].read(buf, count);
+    transfer_error_clear();
+
+    int ret;
+    uint32_t sector = fast_path_sector(fd, count);
+    if (sector) {
+        /* write back anything pending in the volume cache first */
+        if (!sd.cacheClear() || !sd.card()->readSectors(sector, (uint8_t*)buf, count / SECTOR_SIZE))
+            return -1;
+        files[fd].seekCur(count);
+        fast_path[fd].stat.fast_reads++;
+        ret = count;
+    } else {
+        fast_path[fd].stat.slow_reads++;
+        ret = files[fd].read(buf, count);
+    }
+
+    /* a timed out DMA transfer leaves the buffer contents undefined */
+    if (SD_PERIPH.transferError())
+        return -1;
+    return ret;
 }
 
 extern "C" int sd_write(int fd, void *buf, size_t count) {
     CHECK_FD(fd);
 
-    return files[fd].write(buf, count);
+    /* only overwrites within the file size, anything growing the file
+     * needs the filesystem to update the directory entry. Read only handles
+     * go through it too and fail there */
+    transfer_error_clear();
+
+    int ret;
+    uint32_t sector = files[fd].isWritable() ? fast_path_sector(fd, count) : 0;
+    if (sector) {
+        /* the volume cache must not hold stale copies of these sectors */
+        if (!sd.cacheClear() || !sd.card()->writeSectors(sector, (const uint8_t*)buf, count / SECTOR_SIZE))
+            return -1;
+        files[fd].seekCur(count);
+        fast_path[fd].dir_dirty = true;
+        fast_path[fd].stat.fast_writes++;
+        ret = count;
+    } else {
+        fast_path[fd].stat.slow_writes++;
+        ret = files[fd].write(buf, count);
+    }
+
+    if (SD_PERIPH.transferError())
+        return -1;
+    return ret;
 }
 
 extern "C" int sd_seek(int fd, int32_t offset, int whence) {
@@ -116,7 +305,17 @@ extern "C" uint32_t sd_tell(int fd) {
 }
 
 extern "C" int sd_mkdir(const char *path) {
+    const char *name;
+    File *dir = dir_cache_lookup(path, &name);
+
     /* return 1 on error */
+    if (dir) {
+        File sub;
+        bool ret = sub.mkdir(dir, name);
+        sub.close();
+        return ret != true;
+    }
+
     return sd.mkdir(path) != true;
 }
 
@@ -130,12 +329,21 @@ extern "C" int sd_filesize(int fd) {
 }
 
 extern "C" int sd_rmdir(const char* path) {
+    /* removed directory might be cached itself or be a parent of a cached one */
+    dir_cache_flush();
+
     /* return 1 on error */
     return sd.rmdir(path) != true;
 }
 
 extern "C" int sd_remove(const char* path) {
+    const char *name;
+    File *dir = dir_cache_lookup(path, &name);
+
     /* return 1 on error */
+    if (dir)
+        return dir->remove(name) != true;
+
     return sd.remove(path) != true;
 }
 
@@ -147,6 +355,9 @@ extern "C" int sd_iterate_dir(int dir, int it) {
     }
     if (!files[it].openNext(&files[dir], O_RDONLY)) {
         it = -1;
+    } else {
+        /* listed entries stay on the filesystem path */
+        memset(&fast_path[it], 0, sizeof(fast_path[it]));
     }
     return it;
 }
@@ -249,4 +460,26 @@ extern "C" int sd_seek64(int fd, int64_t offset, int whence) {
         return files[fd].seekEnd(offset) != true;
     }
     return 1;
-}
\ No newline at end of file
+}
+
+extern "C" int sd_get_fast_path_stat(int fd, sd_fast_path_stat_t* const stat) {
+    CHECK_FD(fd);
+
+    *stat = fast_path[fd].stat;
+
+    return 0;
+}
+
+/* Reserve contiguous clusters for an empty file */
+extern "C" int sd_preallocate(int fd, uint64_t size) {
+    CHECK_FD(fd);
+
+    /* return 1 on error */
+    if (!files[fd].preAllocate(size))
+        return 1;
+
+    /* the cluster chain changed */
+    fast_path_detect(fd);
+
+    return 0;
+}
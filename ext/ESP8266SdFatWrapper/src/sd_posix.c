@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+
+#include "sd.h"
+#include "sd_posix.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Mirrors the handle table of sd.cpp, the extra slot is only handed out
+ * by sd_iterate_dir */
+#define NUM_FILES 16
+
+typedef struct {
+    bool open;
+    bool is_dir;
+    int fd;
+    int oflag;
+    bool dirty;             //written since the last flush, syncing a clean file costs nothing
+    DIR *dir;               //iteration state, created on the first sd_iterate_dir
+    char path[PATH_MAX];
+    sd_fast_path_stat_t stat;
+} sd_posix_file_t;
+
+static sd_posix_file_t files[NUM_FILES + 1];
+static char root[PATH_MAX] = ".";
+static bool root_set = false;
+
+static sd_posix_config_t config;
+static sd_posix_stat_t counters;
+static uint32_t rng_state = 1;
+
+static void sleep_delay(uint64_t us) {
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+static sd_posix_delay_cb_t delay_cb = sleep_delay;
+
+/* xorshift32, good enough for picking latencies and deterministic per seed */
+static uint32_t rng_next(void) {
+    uint32_t x = rng_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+static bool rng_permille(uint16_t permille) {
+    return permille && (rng_next() % 1000) < permille;
+}
+
+static void charge(sd_posix_op_t op, size_t bytes, uint32_t bytes_per_s) {
+    const sd_posix_latency_t *lat = &config.latency[op];
+    uint64_t us = lat->min_us;
+
+    if (lat->max_us > lat->min_us)
+        us += rng_next() % (lat->max_us - lat->min_us + 1);
+    if (rng_permille(lat->spike_permille))
+        us += lat->spike_us;
+    if (bytes_per_s)
+        us += ((uint64_t)bytes * 1000000) / bytes_per_s;
+
+    counters.ops[op]++;
+    counters.delay_us[op] += us;
+
+    if (us && delay_cb)
+        delay_cb(us);
+}
+
+static void host_path(const char *path, char *out, size_t size) {
+    while (*path == '/')
+        ++path;
+    snprintf(out, size, "%s/%s", root, path);
+}
+
+void sd_posix_set_root(const char *path) {
+    snprintf(root, sizeof(root), "%s", path);
+    root_set = true;
+}
+
+void sd_posix_configure(const sd_posix_config_t *cfg) {
+    if (cfg)
+        config = *cfg;
+    else
+        memset(&config, 0, sizeof(config));
+    rng_state = config.seed ? config.seed : 1;
+}
+
+void sd_posix_set_delay_cb(sd_posix_delay_cb_t cb) {
+    delay_cb = cb;
+}
+
+void sd_posix_get_stat(sd_posix_stat_t *out) {
+    *out = counters;
+}
+
+void sd_posix_reset_stat(void) {
+    memset(&counters, 0, sizeof(counters));
+}
+
+void sd_init(void) {
+    const char *env = getenv("SD2PSX_SD_ROOT");
+
+    if (!root_set && env)
+        sd_posix_set_root(env);
+}
+
+#define CHECK_FD(fd) if (fd < 0 || fd >= NUM_FILES || !files[fd].open) return -1;
+#define CHECK_FD_VOID(fd) if (fd < 0 || fd >= NUM_FILES || !files[fd].open) return;
+
+static int file_open(int slot, const char *hpath, int oflag) {
+    struct stat st;
+    sd_posix_file_t *file = &files[slot];
+
+    file->fd = open(hpath, oflag, 0644);
+    if (file->fd < 0)
+        return -1;
+
+    fstat(file->fd, &st);
+    file->open = true;
+    file->is_dir = S_ISDIR(st.st_mode);
+    file->oflag = oflag;
+    file->dirty = false;
+    file->dir = NULL;
+    snprintf(file->path, sizeof(file->path), "%s", hpath);
+    memset(&file->stat, 0, sizeof(file->stat));
+
+    return slot;
+}
+
+static void file_close(int slot) {
+    sd_posix_file_t *file = &files[slot];
+
+    /* closedir releases its own duplicate of the descriptor */
+    if (file->dir)
+        closedir(file->dir);
+    close(file->fd);
+    file->dir = NULL;
+    file->open = false;
+}
+
+int sd_open(const char *path, int oflag) {
+    char hpath[PATH_MAX];
+    int fd;
+
+    charge(SD_POSIX_OP_OPEN, 0, 0);
+
+    for (fd = 0; fd < NUM_FILES; ++fd)
+        if (!files[fd].open)
+            break;
+
+    /* no fd available */
+    if (fd >= NUM_FILES)
+        return -1;
+
+    host_path(path, hpath, sizeof(hpath));
+    return file_open(fd, hpath, oflag);
+}
+
+int sd_close(int fd) {
+    CHECK_FD(fd);
+
+    charge(SD_POSIX_OP_CLOSE, 0, 0);
+    file_close(fd);
+    return 0;
+}
+
+void sd_flush(int fd) {
+    CHECK_FD_VOID(fd);
+
+    if (!files[fd].dirty)
+        return;
+    charge(SD_POSIX_OP_FLUSH, 0, 0);
+    files[fd].dirty = false;
+}
+
+int sd_read(int fd, void *buf, size_t count) {
+    CHECK_FD(fd);
+
+    if (count > 1 && rng_permille(config.short_read_permille)) {
+        count = 1 + rng_next() % (count - 1);
+        counters.short_reads++;
+    }
+
+    charge(SD_POSIX_OP_READ, count, config.read_bytes_per_s);
+    files[fd].stat.slow_reads++;
+
+    ssize_t ret = read(files[fd].fd, buf, count);
+    if (ret > 0)
+        counters.bytes_read += ret;
+    return (int)ret;
+}
+
+int sd_write(int fd, void *buf, size_t count) {
+    CHECK_FD(fd);
+
+    if (count > 1 && rng_permille(config.short_write_permille)) {
+        count = 1 + rng_next() % (count - 1);
+        counters.short_writes++;
+    }
+
+    charge(SD_POSIX_OP_WRITE, count, config.write_bytes_per_s);
+    files[fd].stat.slow_writes++;
+
+    ssize_t ret = write(files[fd].fd, buf, count);
+    if (ret > 0) {
+        counters.bytes_written += ret;
+        files[fd].dirty = true;
+    }
+    return (int)ret;
+}
+
+/* Like SdFat, seeking past the end of a file fails and keeps the position */
+static int file_seek(int fd, int64_t offset, int whence) {
+    struct stat st;
+    off_t pos;
+
+    charge(SD_POSIX_OP_SEEK, 0, 0);
+
+    if (fstat(files[fd].fd, &st) != 0)
+        return 1;
+
+    if (whence == SEEK_SET)
+        pos = offset;
+    else if (whence == SEEK_CUR)
+        pos = lseek(files[fd].fd, 0, SEEK_CUR) + offset;
+    else if (whence == SEEK_END)
+        pos = st.st_size + offset;
+    else
+        return 1;
+
+    if (pos < 0 || pos > st.st_size)
+        return 1;
+
+    return lseek(files[fd].fd, pos, SEEK_SET) != pos;
+}
+
+int sd_seek(int fd, int32_t offset, int whence) {
+    CHECK_FD(fd);
+    return file_seek(fd, offset, whence);
+}
+
+int sd_seek64(int fd, int64_t offset, int whence) {
+    CHECK_FD(fd);
+    return file_seek(fd, offset, whence);
+}
+
+uint32_t sd_tell(int fd) {
+    CHECK_FD(fd);
+    return (uint32_t)lseek(files[fd].fd, 0, SEEK_CUR);
+}
+
+uint64_t sd_tell64(int fd) {
+    CHECK_FD(fd);
+    return (uint64_t)lseek(files[fd].fd, 0, SEEK_CUR);
+}
+
+uint64_t sd_filesize64(int fd) {
+    struct stat st;
+
+    CHECK_FD(fd);
+    if (fstat(files[fd].fd, &st) != 0)
+        return 0;
+    return (uint64_t)st.st_size;
+}
+
+int sd_filesize(int fd) {
+    CHECK_FD(fd);
+    return (int)sd_filesize64(fd);
+}
+
+/* SdFat creates missing parents as well */
+int sd_mkdir(const char *path) {
+    char hpath[PATH_MAX];
+    size_t skip = strlen(root) + 1;
+
+    charge(SD_POSIX_OP_META, 0, 0);
+    host_path(path, hpath, sizeof(hpath));
+
+    for (char *p = hpath + skip; *p; ++p) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(hpath, 0755) != 0 && errno != EEXIST) {
+            *p = '/';
+            return 1;
+        }
+        *p = '/';
+    }
+
+    /* return 1 on error */
+    return mkdir(hpath, 0755) != 0;
+}
+
+int sd_exists(const char *path) {
+    char hpath[PATH_MAX];
+    struct stat st;
+
+    charge(SD_POSIX_OP_META, 0, 0);
+    host_path(path, hpath, sizeof(hpath));
+    return stat(hpath, &st) == 0;
+}
+
+int sd_remove(const char *path) {
+    char hpath[PATH_MAX];
+
+    charge(SD_POSIX_OP_META, 0, 0);
+    host_path(path, hpath, sizeof(hpath));
+
+    /* return 1 on error */
+    return unlink(hpath) != 0;
+}
+
+int sd_rmdir(const char *path) {
+    char hpath[PATH_MAX];
+
+    charge(SD_POSIX_OP_META, 0, 0);
+    host_path(path, hpath, sizeof(hpath));
+
+    /* return 1 on error */
+    return rmdir(hpath) != 0;
+}
+
+int sd_iterate_dir(int dir, int it) {
+    struct dirent *ent;
+    char hpath[PATH_MAX + NAME_MAX + 2];
+
+    CHECK_FD(dir);
+    charge(SD_POSIX_OP_META, 0, 0);
+
+    if (it == -1) {
+        for (it = 0; it < NUM_FILES; ++it)
+            if (!files[it].open)
+                break;
+    } else if (files[it].open) {
+        file_close(it);
+    }
+
+    if (!files[dir].dir) {
+        int dup_fd = dup(files[dir].fd);
+        files[dir].dir = dup_fd < 0 ? NULL : fdopendir(dup_fd);
+        if (!files[dir].dir) {
+            if (dup_fd >= 0)
+                close(dup_fd);
+            return -1;
+        }
+    }
+
+    do {
+        ent = readdir(files[dir].dir);
+    } while (ent && (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0));
+
+    if (!ent)
+        return -1;
+
+    snprintf(hpath, sizeof(hpath), "%s/%s", files[dir].path, ent->d_name);
+    return file_open(it, hpath, O_RDONLY);
+}
+
+size_t sd_get_name(int fd, char *name, size_t size) {
+    CHECK_FD(fd);
+
+    const char *base = strrchr(files[fd].path, '/');
+    base = base ? base + 1 : files[fd].path;
+
+    if (size == 0)
+        return 0;
+    snprintf(name, size, "%s", base);
+    return strlen(name);
+}
+
+bool sd_is_dir(int fd) {
+    if (fd < 0 || fd >= NUM_FILES || !files[fd].open)
+        return false;
+    return files[fd].is_dir;
+}
+
+int sd_fd_is_open(int fd) {
+    CHECK_FD(fd);
+    return 0;
+}
+
+static void fat_date_time(time_t t, uint16_t *date, uint16_t *time) {
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    *date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+    *time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1);
+}
+
+int sd_getStat(int fd, sd_file_stat_t* const sd_stat) {
+    struct stat st;
+
+    CHECK_FD(fd);
+    charge(SD_POSIX_OP_META, 0, 0);
+
+    fstat(files[fd].fd, &st);
+    fat_date_time(st.st_atime, &sd_stat->adate, &sd_stat->atime);
+    fat_date_time(st.st_ctime, &sd_stat->cdate, &sd_stat->ctime);
+    fat_date_time(st.st_mtime, &sd_stat->mdate, &sd_stat->mtime);
+    sd_stat->writable = (files[fd].oflag & O_ACCMODE) != O_RDONLY;
+    sd_stat->size = st.st_size;
+
+    /* same as the SdFat implementation */
+    return -1;
+}
+
+static void map_time(time_t t, unsigned char *out_time) {
+    uint16_t date, time;
+
+    fat_date_time(t, &date, &time);
+
+    out_time[0] = 0; // Padding
+    out_time[1] = (time << 1) & 31; // Seconds (multiplied by 2)
+    out_time[2] = (time >> 5) & 63; // Minutes
+    out_time[3] = (time >> 11); // Hours
+    out_time[4] = (date & 31); // Day
+    out_time[5] = (date >> 5) & 15; // Month
+    out_time[6] = ((date >> 9) + 1980) & 0xff; // Year (low bits)
+    out_time[7] = (((date >> 9) + 1980) >> 8) & 0xff; // Year (high bits)
+}
+
+int sd_get_stat(int fd, ps2_fileio_stat_t* const ps2_fileio_stat) {
+    struct stat st;
+    int acc;
+
+    CHECK_FD(fd);
+    charge(SD_POSIX_OP_META, 0, 0);
+
+    fstat(files[fd].fd, &st);
+    acc = files[fd].oflag & O_ACCMODE;
+
+    ps2_fileio_stat->mode = files[fd].is_dir ? FIO_S_IFDIR : FIO_S_IFREG;
+    if (acc != O_WRONLY)
+        ps2_fileio_stat->mode |= FIO_S_IROTH;
+    if (acc != O_RDONLY)
+        ps2_fileio_stat->mode |= FIO_S_IWOTH;
+
+    ps2_fileio_stat->attr = 0x0;
+    ps2_fileio_stat->size = (uint32_t)st.st_size;
+    map_time(st.st_ctime, ps2_fileio_stat->ctime);
+    map_time(st.st_atime, ps2_fileio_stat->atime);
+    map_time(st.st_mtime, ps2_fileio_stat->mtime);
+    ps2_fileio_stat->hisize = ((uint64_t)st.st_size >> 32);
+
+    return 0;
+}
+
+/* There is no raw sector access on the host, every transfer is counted
+ * as going through the filesystem */
+int sd_get_fast_path_stat(int fd, sd_fast_path_stat_t* const out) {
+    CHECK_FD(fd);
+
+    *out = files[fd].stat;
+
+    return 0;
+}
+
+int sd_preallocate(int fd, uint64_t size) {
+    CHECK_FD(fd);
+
+    /* SdFat only preallocates empty files, return 1 on error */
+    if (files[fd].is_dir || sd_filesize64(fd) != 0)
+        return 1;
+
+    return fallocate(files[fd].fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0;
+}
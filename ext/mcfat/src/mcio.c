@@ -83,6 +83,7 @@ struct MCCacheEntry {
     uint8_t  *cl_data;
     uint8_t   wr_flag;
     uint8_t   rd_flag;
+    int16_t   next;     /* next entry in the same hash bucket */
 } __attribute__((packed));
 
 struct MCCacheDir {
@@ -99,9 +100,19 @@ struct MCFatCluster {
 #ifndef MAX_CACHEENTRY
     #define MAX_CACHEENTRY		36
 #endif
+/* With a single entry the FAT cluster and the data cluster of a write evict
+ * each other and in-place rewrites of multi-cluster files fail. Only the host
+ * benchmark builds it, as the reference from before the hashed cache */
+#ifndef MCIO_ALLOW_SINGLE_CACHEENTRY
+_Static_assert(MAX_CACHEENTRY >= 2, "mcfat needs at least 2 cache entries");
+#endif
+#ifndef MCIO_CACHEHASH_SIZE
+    #define MCIO_CACHEHASH_SIZE		(MAX_CACHEENTRY * 2)
+#endif
 uint8_t mcio_cachebuf[MAX_CACHEENTRY * MCIO_CLUSTERSIZE];
 struct MCCacheEntry mcio_entrycache[MAX_CACHEENTRY];
 struct MCCacheEntry *mcio_mccache[MAX_CACHEENTRY];
+int16_t mcio_cachehash[MCIO_CACHEHASH_SIZE]; /* first entry per bucket, by cluster */
 
 struct MCCacheEntry *pmcio_entrycache;
 struct MCCacheEntry **pmcio_mccache;
@@ -112,6 +123,11 @@ struct MCFatCache {
 
 struct MCFatCache mcio_fatcache;
 
+/* Copy of the first indirect FAT cluster, it covers the FAT of cards up to
+ * 64MB. Keeps FAT lookups down to a single cluster read */
+struct MCFatCluster mcio_indirectfat;
+uint8_t mcio_indirectfat_valid;
+
 struct MCFsEntry { /* size = 512 */
     uint16_t mode;
     uint16_t unused;
@@ -515,9 +531,14 @@ static void Card_InitCache(void)
         mcio_entrycache[i].cl_data = (uint8_t *)p;
         mcio_mccache[i] = (struct MCCacheEntry *)&mcio_entrycache[j - i];
         mcio_entrycache[i].cluster = -1;
+        mcio_entrycache[i].wr_flag = 0;
+        mcio_entrycache[i].next = -1;
         p += MCIO_CLUSTERSIZE;
     }
 
+    memset((void *)mcio_cachehash, -1, sizeof(mcio_cachehash));
+    mcio_indirectfat_valid = 0;
+
     pmcio_entrycache = (struct MCCacheEntry *)mcio_entrycache;
     pmcio_mccache = (struct MCCacheEntry **)mcio_mccache;
 
@@ -542,8 +563,12 @@ static int Card_ClearCache(void)
             mce->wr_flag = 0;
             mce->cluster = -1;
         }
+        mce->next = -1;
     }
 
+    memset((void *)mcio_cachehash, -1, sizeof(mcio_cachehash));
+    mcio_indirectfat_valid = 0;
+
     for (i = 0; i < (MAX_CACHEENTRY - 1); i++) {
         mce = mce_save = (struct MCCacheEntry *)pmce[i];
         if (mce->cluster < 0) {
@@ -570,28 +595,60 @@ static int Card_ClearCache(void)
 static struct MCCacheEntry *Card_GetCacheEntry(int32_t cluster)
 {
     register int i;
-    struct MCCacheEntry *mce = (struct MCCacheEntry *)pmcio_entrycache;
 
-    for (i = 0; i < MAX_CACHEENTRY; i++) {
-        if (mce->cluster == cluster)
-            return mce;
-        mce++;
+    if (cluster < 0)
+        return NULL;
+
+    i = mcio_cachehash[(uint32_t)cluster % MCIO_CACHEHASH_SIZE];
+    while (i >= 0) {
+        if (mcio_entrycache[i].cluster == cluster)
+            return &mcio_entrycache[i];
+        i = mcio_entrycache[i].next;
     }
 
     return NULL;
 }
 
-static void Card_FreeCluster(int32_t cluster) /* release cluster from entrycache */
+static void Card_SetCacheCluster(struct MCCacheEntry *mce, int32_t cluster) /* move entry to another hash bucket */
 {
-    register int i;
-    struct MCCacheEntry *mce = (struct MCCacheEntry *)pmcio_entrycache;
+    register int i, prev;
+    int16_t index = (int16_t)(mce - mcio_entrycache);
 
-    for (i = 0; i < MAX_CACHEENTRY; i++) {
-        if (mce->cluster == cluster) {
-            mce->cluster = -1;
-            mce->wr_flag = 0;
+    if (mce->cluster >= 0) {
+        uint32_t bucket = (uint32_t)mce->cluster % MCIO_CACHEHASH_SIZE;
+
+        prev = -1;
+        i = mcio_cachehash[bucket];
+        while ((i >= 0) && (i != index)) {
+            prev = i;
+            i = mcio_entrycache[i].next;
         }
-        mce++;
+        if (i >= 0) {
+            if (prev < 0)
+                mcio_cachehash[bucket] = mce->next;
+            else
+                mcio_entrycache[prev].next = mce->next;
+        }
+    }
+
+    mce->cluster = cluster;
+    mce->next = -1;
+
+    if (cluster >= 0) {
+        uint32_t bucket = (uint32_t)cluster % MCIO_CACHEHASH_SIZE;
+
+        mce->next = mcio_cachehash[bucket];
+        mcio_cachehash[bucket] = index;
+    }
+}
+
+static void Card_FreeCluster(int32_t cluster) /* release cluster from entrycache */
+{
+    struct MCCacheEntry *mce = Card_GetCacheEntry(cluster);
+
+    if (mce != NULL) {
+        Card_SetCacheCluster(mce, -1);
+        mce->wr_flag = 0;
     }
 }
 
@@ -706,7 +763,7 @@ static int Card_FillBackupBlock1(int32_t block, uint8_t **pagedata, uint8_t *ecc
 static int Card_FlushCacheEntry(struct MCCacheEntry *mce)
 {
     register int r, i, j, ecc_count;
-    register int temp1, temp2, offset, pageindex;
+    register int temp2, offset, pageindex;
     int32_t clusters_per_block, blocksize, cardtype, pagesize, sparesize, flag, cluster, block;
     struct MCCacheEntry *pmce[16];
     struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
@@ -737,22 +794,13 @@ static int Card_FlushCacheEntry(struct MCCacheEntry *mce)
 
     memset((void *)pmce, 0, sizeof(pmce));
 
-    i = 0;
-    if (MAX_CACHEENTRY > 0) {
-        mcee = (struct MCCacheEntry *)pmcio_entrycache;
-        do {
-            if (mcee->wr_flag == mce->wr_flag) {
-                temp1 = mcee->cluster / clusters_per_block;
-                temp2 = mcee->cluster % clusters_per_block;
-
-                if (temp1 == block) {
-                    pmce[temp2] = (struct MCCacheEntry *)mcee;
-                    if (mcee->rd_flag == 0)
-                        flag = 1;
-                }
-            }
-            mcee++;
-        } while (++i < MAX_CACHEENTRY);
+    for (temp2 = 0; temp2 < clusters_per_block; temp2++) {
+        mcee = Card_GetCacheEntry((block * clusters_per_block) + temp2);
+        if ((mcee != NULL) && (mcee->wr_flag == mce->wr_flag)) {
+            pmce[temp2] = (struct MCCacheEntry *)mcee;
+            if (mcee->rd_flag == 0)
+                flag = 1;
+        }
     }
 
     if (clusters_per_block > 0) {
@@ -999,7 +1047,7 @@ static int Card_ReadCluster(int32_t cluster, struct MCCacheEntry **pmce)
                 return r;
         }
 
-        mce->cluster = cluster;
+        Card_SetCacheCluster(mce, cluster);
         mce->rd_flag = 0;
 
         uint16_t pages_per_cluster = read_le_uint16((uint8_t *)&mcdi->pages_per_cluster);
@@ -1124,12 +1172,46 @@ static int Card_WriteCluster(int32_t cluster, int32_t flag)
     return 1;
 }
 
+static int Card_GetFatCluster(int32_t indirect_index, int32_t *fat_cluster)
+{
+    register int r;
+    int32_t ifc_index, indirect_offset;
+    struct MCCacheEntry *mce;
+    struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
+
+    int32_t FATentries_per_cluster = (int32_t)read_le_uint32((uint8_t *)&mcdi->FATentries_per_cluster);
+
+    ifc_index = indirect_index / FATentries_per_cluster;
+    indirect_offset = indirect_index % FATentries_per_cluster;
+
+    if ((ifc_index == 0) && mcio_indirectfat_valid) {
+        *fat_cluster = read_le_uint32((uint8_t *)&mcio_indirectfat.entry[indirect_offset]);
+        return sceMcResSucceed;
+    }
+
+    int32_t ifc = (int32_t)read_le_uint32((uint8_t *)&mcdi->ifc_list[ifc_index]);
+
+    r = Card_ReadCluster(ifc, &mce);
+    if (r != sceMcResSucceed)
+        return r;
+
+    if ((ifc_index == 0) && (FATentries_per_cluster <= MCIO_CLUSTERFATENTRIES)) {
+        memcpy((void *)&mcio_indirectfat, mce->cl_data, FATentries_per_cluster * sizeof(int32_t));
+        mcio_indirectfat_valid = 1;
+    }
+
+    struct MCFatCluster *fc = (struct MCFatCluster *)mce->cl_data;
+    *fat_cluster = read_le_uint32((uint8_t *)&fc->entry[indirect_offset]);
+
+    return sceMcResSucceed;
+}
+
 static int Card_FindFree(int reserve)
 {
     register int r;
-    int32_t rfree, indirect_index, ifc_index, fat_offset, indirect_offset, fat_index, block;
+    int32_t rfree, indirect_index, fat_offset, fat_index, fat_cluster, block;
     struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
-    struct MCCacheEntry *mce1, *mce2;
+    struct MCCacheEntry *mce2;
 
     int32_t unknown2 = (int32_t)read_le_uint32((uint8_t *)&mcdi->unknown2);
     int32_t FATentries_per_cluster = (int32_t)read_le_uint32((uint8_t *)&mcdi->FATentries_per_cluster);
@@ -1144,15 +1226,11 @@ static int Card_FindFree(int reserve)
 
         if ((fat_offset == 0) || (fat_index == unknown2)) {
 
-            ifc_index = indirect_index / FATentries_per_cluster;
-            int32_t ifc = (int32_t)read_le_uint32((uint8_t *)&mcdi->ifc_list[ifc_index]);
-            r = Card_ReadCluster(ifc, &mce1);
+            r = Card_GetFatCluster(indirect_index, &fat_cluster);
             if (r != sceMcResSucceed)
                 return r;
 
-            indirect_offset = indirect_index % FATentries_per_cluster;
-            struct MCFatCluster *fc = (struct MCFatCluster *)mce1->cl_data;
-            r = Card_ReadCluster(read_le_uint32((uint8_t *)&fc->entry[indirect_offset]), &mce2);
+            r = Card_ReadCluster(fat_cluster, &mce2);
             if (r != sceMcResSucceed)
                 return r;
         }
@@ -1184,7 +1262,7 @@ static int Card_FindFree(int reserve)
 static int Card_SetFatEntry(int32_t fat_index, int32_t fat_entry)
 {
     register int r;
-    int32_t ifc_index, indirect_index, indirect_offset, fat_offset;
+    int32_t indirect_index, fat_offset, fat_cluster;
     struct MCCacheEntry *mce;
     struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
 
@@ -1193,22 +1271,15 @@ static int Card_SetFatEntry(int32_t fat_index, int32_t fat_entry)
     indirect_index = fat_index / FATentries_per_cluster;
     fat_offset = fat_index % FATentries_per_cluster;
 
-    ifc_index = indirect_index / FATentries_per_cluster;
-    indirect_offset = indirect_index % FATentries_per_cluster;
-
-    int32_t ifc = (int32_t)read_le_uint32((uint8_t *)&mcdi->ifc_list[ifc_index]);
-
-    r = Card_ReadCluster(ifc, &mce);
+    r = Card_GetFatCluster(indirect_index, &fat_cluster);
     if (r != sceMcResSucceed)
         return r;
 
-    struct MCFatCluster *fc = (struct MCFatCluster *)mce->cl_data;
-
-    r = Card_ReadCluster(read_le_uint32((uint8_t *)&fc->entry[indirect_offset]), &mce);
+    r = Card_ReadCluster(fat_cluster, &mce);
     if (r != sceMcResSucceed)
         return r;
 
-    fc = (struct MCFatCluster *)mce->cl_data;
+    struct MCFatCluster *fc = (struct MCFatCluster *)mce->cl_data;
 
     append_le_uint32((uint8_t *)&fc->entry[fat_offset], fat_entry);
     mce->wr_flag = 1;
@@ -1218,7 +1289,8 @@ static int Card_SetFatEntry(int32_t fat_index, int32_t fat_entry)
 
 static int Card_GetFatEntry(int32_t fat_index, int32_t *fat_entry)
 {
-    register int r, ifc_index, indirect_index, indirect_offset, fat_offset;
+    register int r, indirect_index, fat_offset;
+    int32_t fat_cluster;
     struct MCCacheEntry *mce;
     struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
 
@@ -1227,22 +1299,15 @@ static int Card_GetFatEntry(int32_t fat_index, int32_t *fat_entry)
     indirect_index = fat_index / FATentries_per_cluster;
     fat_offset = fat_index % FATentries_per_cluster;
 
-    ifc_index = indirect_index / FATentries_per_cluster;
-    indirect_offset = indirect_index % FATentries_per_cluster;
-
-    int32_t ifc = (int32_t)read_le_uint32((uint8_t *)&mcdi->ifc_list[ifc_index]);
-
-    r = Card_ReadCluster(ifc, &mce);
+    r = Card_GetFatCluster(indirect_index, &fat_cluster);
     if (r != sceMcResSucceed)
         return r;
 
-    struct MCFatCluster *fc = (struct MCFatCluster *)mce->cl_data;
-
-    r = Card_ReadCluster(read_le_uint32((uint8_t *)&fc->entry[indirect_offset]), &mce);
+    r = Card_ReadCluster(fat_cluster, &mce);
     if (r != sceMcResSucceed)
         return r;
 
-    fc = (struct MCFatCluster *)mce->cl_data;
+    struct MCFatCluster *fc = (struct MCFatCluster *)mce->cl_data;
 
     *fat_entry = read_le_uint32((uint8_t *)&fc->entry[fat_offset]);
 
@@ -2184,6 +2249,8 @@ static int Card_Format(void)
     struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
     struct MCCacheEntry *mce;
 
+    mcio_indirectfat_valid = 0; /* the ifc list is rebuilt below */
+
     if (read_le_uint32((uint8_t *)&mcdi->cardform) == sceMcResNoFormat) {
         for (i = 0; i < 32; i++)
             append_le_uint32((uint8_t *)&mcdi->bad_block_list[i], -1);
@@ -3222,6 +3289,33 @@ int mcio_mcGetCluster(int fd)
     return r;
 }
 
+/* Absolute cluster holding the start of the file data */
+int mcio_mcGetDataCluster(int fd)
+{
+    register int r;
+    struct MCFHandle *fh;
+    struct MCDevInfo *mcdi = (struct MCDevInfo *)&mcio_devinfo;
+
+    if (!(fd < MAX_FDHANDLES))
+        return sceMcResDeniedPermit;
+
+    fh = (struct MCFHandle *)&mcio_fdhandles[fd];
+    if (!fh->status)
+        return sceMcResDeniedPermit;
+
+    if (!fh->rdflag)
+        return sceMcResDeniedPermit;
+
+    r = mcio_mcDetect();
+    if (r != sceMcResSucceed)
+        return r;
+
+    if ((int32_t)fh->freeclink < 0)
+        return sceMcResNoEntry;
+
+    return fh->freeclink + read_le_uint32((uint8_t *)&mcdi->alloc_offset);
+}
+
 int mcio_mcCreateCrossLinkedFile(char *real_filepath, char *dummy_filepath)
 {
     int r, fd;
@@ -3462,8 +3556,9 @@ int mcio_mcFormat(void)
 {
     int r;
 
+    /* a blank card is what format is for */
     r = mcio_mcDetect();
-    if (r != sceMcResSucceed)
+    if ((r != sceMcResSucceed) && (r != sceMcResNoFormat))
         return r;
 
     r = Card_Format();
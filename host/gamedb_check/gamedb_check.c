@@ -0,0 +1,318 @@
+/* Checks the game DB lookups against a linear search.
+ *
+ * Every entry of the PS1, PS2 and COH databases linked into the binary is
+ * looked up through the public game_db API, and the parent ID and name have
+ * to match what a linear scan over the raw entries finds. IDs that the scan
+ * does not find have to miss. A DB with buckets is looked up through the
+ * hash, one without through binary search.
+ *
+ * "gamedb_check bench [rounds]" times the lookups instead: every entry and as
+ * many absent keys per round, through game_db and through the linear scan
+ * that the DBs were searched with before the sorted layout.
+ *
+ * Without SD2PSX_HOST_GAMEDB the databases are synthetic ones written by
+ * gen_gamedb.py, see host/CMakeLists.txt. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "game_db/game_db.h"
+#include "sd_posix.h"
+#include "settings.h"
+
+#define DB_HEADER_SIZE      48
+#define DB_GAME_ENTRY_SIZE  12
+#define DB_NAME_BLOCK_SIZE  16
+#define MAX_NAME            128
+#define MISSES_PER_DB       20000
+
+extern const char _binary_gamedbps1_dat_start, _binary_gamedbps1_dat_size;
+extern const char _binary_gamedbps2_dat_start, _binary_gamedbps2_dat_size;
+extern const char _binary_gamedbcoh_dat_start, _binary_gamedbcoh_dat_size;
+
+typedef struct {
+    const char *label;
+    const uint8_t *start;
+    size_t size;
+    int mode;
+    bool arcade;
+} db_t;
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t header_field(const db_t *db, int index) {
+    return be32(&db->start[8 + index * 4]);
+}
+
+#define NUM_BUCKETS(db)     header_field(db, 0)
+#define NUM_SLOTS(db)       header_field(db, 1)
+#define PREFIXES(db)        header_field(db, 5)
+#define GAMES_OFFSET(db)    header_field(db, 7)
+#define NUM_NAMES(db)       header_field(db, 8)
+#define NAME_BLOCKS(db)     header_field(db, 9)
+
+#define ENGINE(db)          (NUM_BUCKETS(db) ? "hash" : "bsearch")
+
+static const uint8_t *slot_entry(const db_t *db, uint32_t slot) {
+    return &db->start[GAMES_OFFSET(db) + slot * DB_GAME_ENTRY_SIZE];
+}
+
+/* Padded prefix of an entry, NULL for an empty slot */
+static const char *entry_prefix(const db_t *db, const uint8_t *entry) {
+    if (entry[0] == 0)
+        return NULL;
+    return (const char *)&db->start[PREFIXES(db) + (entry[0] - 1) * 4];
+}
+
+static uint32_t entry_id(const uint8_t *entry) {
+    return be32(entry) & 0xFFFFFF;
+}
+
+/* The reference: first entry with the prefix and ID, in slot order */
+static const uint8_t *linear_search(const db_t *db, const char prefix[4], uint32_t id) {
+    const uint8_t *entry = slot_entry(db, 0), *end = slot_entry(db, NUM_SLOTS(db));
+
+    for (; entry < end; entry += DB_GAME_ENTRY_SIZE) {
+        const char *entry_pfx = entry_prefix(db, entry);
+        if (entry_pfx && (memcmp(entry_pfx, prefix, 4) == 0) && (entry_id(entry) == id))
+            return entry;
+    }
+    return NULL;
+}
+
+/* Front coded names, decoded the straightforward way */
+static void linear_name(const db_t *db, uint32_t index, char *name) {
+    uint32_t pos;
+    size_t length = 0;
+
+    name[0] = '\0';
+    if (index >= NUM_NAMES(db))
+        return;
+
+    pos = be32(&db->start[NAME_BLOCKS(db) + (index / DB_NAME_BLOCK_SIZE) * 4]);
+    for (uint32_t i = 0; i <= index % DB_NAME_BLOCK_SIZE; i++) {
+        size_t rest = strlen((const char *)&db->start[pos + 1]);
+        length = db->start[pos];
+        memcpy(&name[length], &db->start[pos + 1], rest + 1);
+        pos += rest + 2;
+    }
+}
+
+static void padded(const char *prefix, char out[4]) {
+    memset(out, ' ', 4);
+    for (int i = 0; (i < 4) && prefix[i]; i++)
+        out[i] = prefix[i];
+}
+
+static void title_of(const db_t *db, const char prefix[4], uint32_t id, char *title) {
+    char trimmed[5] = {};
+
+    for (int i = 0; (i < 4) && (prefix[i] != ' '); i++)
+        trimmed[i] = prefix[i];
+    if (db->arcade)
+        sprintf(title, "%s%05u", trimmed, id);
+    else
+        sprintf(title, "%s-%05u", trimmed, id);
+}
+
+/* Runs one lookup through the API, false if it missed */
+static bool api_lookup(const db_t *db, const char *title, char *parent, char *name) {
+    int mode;
+
+    parent[0] = '\0';
+    name[0] = '\0';
+    mode = db->arcade ? game_db_update_arcade(title) : game_db_update_game(title);
+    if (mode < 0)
+        return false;
+    game_db_get_current_parent(parent);
+    game_db_get_current_name(name);
+    return true;
+}
+
+static int check_key(const db_t *db, const char prefix[4], uint32_t id, const char *title) {
+    const uint8_t *entry = linear_search(db, prefix, id);
+    char exp_parent[32] = "", exp_name[MAX_NAME] = "", parent[32], name[MAX_NAME];
+    int errors = 0;
+    bool found;
+
+    /* PS2 lookups fall back to the PS1 DB, keep those IDs out of the misses */
+    if (!entry && (db->mode == MODE_PS2) && !db->arcade) {
+        db_t ps1 = { "ps1", (const uint8_t *)&_binary_gamedbps1_dat_start, (size_t)&_binary_gamedbps1_dat_size, MODE_PS1, false };
+        if ((ps1.size >= DB_HEADER_SIZE) && linear_search(&ps1, prefix, id))
+            return 0;
+    }
+
+    if (entry) {
+        char trimmed[5] = {};
+        for (int i = 0; (i < 4) && (prefix[i] != ' '); i++)
+            trimmed[i] = prefix[i];
+        snprintf(exp_parent, sizeof(exp_parent), "%s-%05u", trimmed, be32(&entry[8]));
+        linear_name(db, be32(&entry[4]), exp_name);
+    }
+
+    found = api_lookup(db, title, parent, name);
+    if (found != (entry != NULL)) {
+        printf("%s %s: %s %s\n", db->label, ENGINE(db), title, found ? "found, not in the DB" : "missed");
+        errors++;
+    } else if (found && ((strcmp(parent, exp_parent) != 0) || (strcmp(name, exp_name) != 0))) {
+        printf("%s %s: %s gave %s \"%s\", expected %s \"%s\"\n", db->label, ENGINE(db), title,
+               parent, name, exp_parent, exp_name);
+        errors++;
+    }
+
+    return errors;
+}
+
+static int check_db(const db_t *db) {
+    uint32_t entries = 0, misses = 0;
+    int errors = 0;
+
+    if ((db->size < DB_HEADER_SIZE) || (memcmp(db->start, "GMDB", 4) != 0)) {
+        printf("%s: no database linked, skipped\n", db->label);
+        return 0;
+    }
+
+    settings_set_mode(db->mode);
+    settings_set_ps2_variant(db->arcade ? PS2_VARIANT_COH : PS2_VARIANT_RETAIL);
+
+    for (uint32_t slot = 0; slot < NUM_SLOTS(db); slot++) {
+        const uint8_t *entry = slot_entry(db, slot);
+        const char *prefix = entry_prefix(db, entry);
+        char title[32];
+
+        if (!prefix)
+            continue;
+        title_of(db, prefix, entry_id(entry), title);
+        errors += check_key(db, prefix, entry_id(entry), title);
+        entries++;
+    }
+
+    /* Random keys with the prefixes of the DB, almost all of them absent */
+    srand(1);
+    for (uint32_t i = 0; i < MISSES_PER_DB; i++) {
+        const uint8_t *entry = slot_entry(db, rand() % NUM_SLOTS(db));
+        const char *entry_pfx = entry_prefix(db, entry);
+        char prefix[4], title[32];
+        uint32_t id = rand() % 99999 + 1;
+
+        if (!entry_pfx)
+            padded(db->arcade ? "NM" : "ZZZZ", prefix);
+        else
+            memcpy(prefix, entry_pfx, 4);
+        title_of(db, prefix, id, title);
+        errors += check_key(db, prefix, id, title);
+        misses++;
+    }
+
+    printf("%s %s: %u entries, %u random keys, %d errors\n", db->label, ENGINE(db), entries, misses, errors);
+    return errors;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Titles of all entries, followed by as many absent ones */
+static uint32_t bench_titles(const db_t *db, char (*titles)[32]) {
+    uint32_t count = 0, entries;
+
+    for (uint32_t slot = 0; slot < NUM_SLOTS(db); slot++) {
+        const uint8_t *entry = slot_entry(db, slot);
+        const char *prefix = entry_prefix(db, entry);
+        if (prefix)
+            title_of(db, prefix, entry_id(entry), titles[count++]);
+    }
+    entries = count;
+
+    srand(2);
+    while (count < entries * 2) {
+        const char *prefix = entry_prefix(db, slot_entry(db, rand() % NUM_SLOTS(db)));
+        uint32_t id = rand() % 99999 + 1;
+
+        if (prefix && !linear_search(db, prefix, id))
+            title_of(db, prefix, id, titles[count++]);
+    }
+
+    return count;
+}
+
+static void bench_db(const db_t *db, int rounds) {
+    char (*titles)[32];
+    uint32_t count;
+    uint64_t start, ns;
+    volatile int sink = 0;
+
+    if ((db->size < DB_HEADER_SIZE) || (memcmp(db->start, "GMDB", 4) != 0)) {
+        printf("%s: no database linked, skipped\n", db->label);
+        return;
+    }
+
+    settings_set_mode(db->mode);
+    settings_set_ps2_variant(db->arcade ? PS2_VARIANT_COH : PS2_VARIANT_RETAIL);
+
+    titles = malloc(NUM_SLOTS(db) * 2 * sizeof(*titles));
+    count = bench_titles(db, titles);
+
+    start = now_ns();
+    for (int round = 0; round < rounds; round++)
+        for (uint32_t i = 0; i < count; i++)
+            sink += db->arcade ? game_db_update_arcade(titles[i]) : game_db_update_game(titles[i]);
+    ns = now_ns() - start;
+    printf("%s %-8s %8u lookups %8.1f ns/lookup\n", db->label, ENGINE(db), count * rounds,
+           (double)ns / (count * rounds));
+
+    /* One round is enough to see the difference */
+    start = now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        game_db_title_id_t parsed;
+        char prefix[4];
+
+        game_db_parse_title_id(titles[i], &parsed);
+        padded(parsed.prefix, prefix);
+        sink += linear_search(db, prefix, parsed.numeric_id) != NULL;
+    }
+    ns = now_ns() - start;
+    printf("%s %-8s %8u lookups %8.1f ns/lookup\n", db->label, "linear", count, (double)ns / count);
+
+    free(titles);
+}
+
+int main(int argc, char **argv) {
+    const db_t dbs[] = {
+        { "ps1", (const uint8_t *)&_binary_gamedbps1_dat_start, (size_t)&_binary_gamedbps1_dat_size, MODE_PS1, false },
+        { "ps2", (const uint8_t *)&_binary_gamedbps2_dat_start, (size_t)&_binary_gamedbps2_dat_size, MODE_PS2, false },
+        { "coh", (const uint8_t *)&_binary_gamedbcoh_dat_start, (size_t)&_binary_gamedbcoh_dat_size, MODE_PS2, true },
+    };
+    char root[] = "/tmp/gamedb_check.XXXXXX";
+    int errors = 0;
+
+    /* Settings are written back to the card, keep them out of the cwd */
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    sd_posix_set_root(root);
+    settings_init();
+    game_db_init();
+
+    if ((argc > 1) && (strcmp(argv[1], "bench") == 0)) {
+        int rounds = (argc > 2) ? atoi(argv[2]) : 20;
+
+        for (size_t i = 0; i < sizeof(dbs) / sizeof(dbs[0]); i++)
+            bench_db(&dbs[i], rounds > 0 ? rounds : 1);
+        return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(dbs) / sizeof(dbs[0]); i++)
+        errors += check_db(&dbs[i]);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+# Writes a synthetic game database with database/gamedb_writer.py, for the
+# host build when the real ones are not generated. IDs, parents and names are
+# random but reproducible from --seed. --ids also lists the title IDs, the
+# way a console sends them, for the title ID fuzz corpus.
+
+import argparse
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "database"))
+import gamedb_writer
+
+PREFIXES = {
+    "ps1": ["SLUS", "SCUS", "SLES", "SCES", "SLPS", "SLPM", "SCPS", "PAPX", "SIPS", "PBP"],
+    "ps2": ["SLUS", "SCUS", "SLES", "SCES", "SLPS", "SLPM", "SCPS", "SLKA", "PBPX", "TCES"],
+    "coh": ["NM"],
+}
+
+WORDS = ["Alpha", "Battle", "Crash", "Dragon", "Final", "Gran", "Hero", "Legend", "Metal", "Racing",
+         "Silent", "Tekken", "Ultimate", "World", "Zone", "Disc", "Special", "Edition", "II", "III"]
+
+
+class SyntheticGame:
+    def __init__(self, prefix, id, parent_id, name):
+        self.prefix = prefix
+        self.id = id
+        self.parent_id = parent_id
+        self.name = name
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("system", choices=PREFIXES.keys())
+parser.add_argument("output")
+parser.add_argument("--games", type=int, default=12000)
+parser.add_argument("--seed", type=int, default=1)
+parser.add_argument("--max-displacement", type=int, default=gamedb_writer.MAX_DISPLACEMENT,
+                    help="lower it to exercise the hash retries")
+parser.add_argument("--no-hash", action="store_true", help="write the binary search only layout")
+parser.add_argument("--ids", help="also write the title IDs to this file, one per line")
+args = parser.parse_args()
+
+gamedb_writer.MAX_DISPLACEMENT = args.max_displacement
+if args.no_hash:
+    gamedb_writer.MAX_HASH_ATTEMPTS = 0
+
+rng = random.Random(args.seed)
+games_sorted = {}
+gamenames = []
+for i in range(args.games):
+    prefix = rng.choice(PREFIXES[args.system])
+    id = rng.randrange(1, 99999)
+    name = " ".join(rng.choice(WORDS) for _ in range(rng.randrange(1, 5)))
+    gamenames.append(name)
+    games = games_sorted.setdefault(prefix, [])
+    games.append(SyntheticGame(prefix, str(id), str(id), name))
+    # Multi disc games point at their first disc, duplicate IDs exercise first entry wins
+    if rng.random() < 0.05:
+        games.append(SyntheticGame(prefix, str(id + 1), str(id), name + " (Disc 2)"))
+        gamenames.append(name + " (Disc 2)")
+    if rng.random() < 0.01:
+        games.append(SyntheticGame(prefix, str(id), str(id), name + " Dup"))
+        gamenames.append(name + " Dup")
+
+with open(args.output, "wb") as out:
+    gamedb_writer.writeSortedGameList(out, games_sorted, gamenames)
+
+if args.ids:
+    with open(args.ids, "w") as out:
+        for prefix, games in sorted(games_sorted.items()):
+            for game in games:
+                separator = "" if args.system == "coh" else "-"
+                out.write("%s%s%05d\n" % (prefix, separator, int(game.id)))
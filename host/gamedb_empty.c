@@ -0,0 +1,22 @@
+/* Stands in for the generated game databases when SD2PSX_HOST_GAMEDB is
+ * off. Each one is zeroed and fails the header check, so every lookup
+ * misses. The _size symbols are absolute like the ones objcopy emits */
+__asm__(
+    "    .section .rodata\n"
+    "    .balign 4\n"
+    "    .globl _binary_gamedbps1_dat_start\n"
+    "_binary_gamedbps1_dat_start:\n"
+    "    .zero 16\n"
+    "    .globl _binary_gamedbps2_dat_start\n"
+    "_binary_gamedbps2_dat_start:\n"
+    "    .zero 16\n"
+    "    .globl _binary_gamedbcoh_dat_start\n"
+    "_binary_gamedbcoh_dat_start:\n"
+    "    .zero 16\n"
+    "    .globl _binary_gamedbps1_dat_size\n"
+    "    .set _binary_gamedbps1_dat_size, 16\n"
+    "    .globl _binary_gamedbps2_dat_size\n"
+    "    .set _binary_gamedbps2_dat_size, 16\n"
+    "    .globl _binary_gamedbcoh_dat_size\n"
+    "    .set _binary_gamedbcoh_dat_size, 16\n"
+    "    .text\n");
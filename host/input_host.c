@@ -0,0 +1,28 @@
+#include "input.h"
+
+/* No buttons on the host, nothing is ever pressed */
+
+void input_flip(void) {
+}
+
+void input_init(void) {
+}
+
+void input_task(void) {
+}
+
+int input_get_pressed(void) {
+    return 0;
+}
+
+void input_flush(void) {
+}
+
+int input_is_down_raw(int idx) {
+    (void)idx;
+    return 0;
+}
+
+int input_is_any_down(void) {
+    return 0;
+}
@@ -0,0 +1,1333 @@
+/* PS2 card image toolkit on top of ext/mcfat.
+ *
+ * The image is loaded into RAM and handed to mcfat through a set of page
+ * callbacks that also count the page operations, the same numbers decide
+ * the latency on the device where every page comes from PSRAM or SD.
+ *
+ *   ls <image> [path]                 list the card, recursively
+ *   extract <image> <path> <dir>      copy a file or directory to the host
+ *   insert <image> <host path> [dir]  copy a host file or directory to the card
+ *   rm <image> <path>                 remove a file or directory
+ *   fsck <image>                      check FAT chains and directories
+ *   compact <image> [out]             rewrite all saves in order on a fresh card
+ *   format <image> [size MB]          create a formatted image
+ *   bench [size MB ...]               time mcfat operations per card size
+ *
+ * fsck reads the image directly instead of going through mcfat, so it also
+ * catches what mcfat would silently work around. mcfat is built with a single
+ * file handle for the host, like on the device, all walks close a directory
+ * before descending into it. The bench uses the mcfat cache size of the host
+ * build, see SD2PSX_MCFAT_CACHE_ENTRIES, the mcfat_bench_cache* builds of
+ * this file run it with other cache sizes. Its last pass reads files that
+ * were grown in turns, so their clusters are spread over the card. */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "mcfat.h"
+#include "mcio.h"
+
+#define PAGE_SIZE          512
+#define BLOCK_SIZE         16
+#define CARD_FLAGS         (0x08 | 0x10)
+#define CARD_ERASE_VALUE   0x00
+#define NAME_LENGTH        32
+#define PATH_LENGTH        1024
+#define FAT_ENTRIES        256
+#define MAX_IFC            32
+
+#define SUPERBLOCK_MAGIC        "Sony PS2 Memory Card Format "
+#define SUPERBLOCK_MAGIC_LENGTH 28
+#define SUPERBLOCK_PAGESIZE     0x28
+#define SUPERBLOCK_PAGES_PER_CL 0x2A
+#define SUPERBLOCK_CLUSTERS     0x30
+#define SUPERBLOCK_ALLOC_OFFSET 0x34
+#define SUPERBLOCK_ALLOC_END    0x38
+#define SUPERBLOCK_ROOTDIR      0x3C
+#define SUPERBLOCK_IFC_LIST     0x50
+
+#define ENTRY_MODE     0x00
+#define ENTRY_LENGTH   0x04
+#define ENTRY_CREATED  0x08
+#define ENTRY_CLUSTER  0x10
+#define ENTRY_MODIFIED 0x18
+#define ENTRY_ATTR     0x20
+#define ENTRY_NAME     0x40
+#define ENTRY_TIME_LEN 8
+
+#define FAT_ENTRY_USED 0x80000000
+#define FAT_CHAIN_END  0xFFFFFFFF
+#define FAT_BAD        0xFFFFFFFD
+
+#define OPEN_READ   (sceMcFileAttrReadable)
+#define OPEN_CREATE (sceMcFileCreateFile | sceMcFileAttrWriteable | sceMcFileAttrReadable | sceMcFileAttrFile)
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} image_t;
+
+/* Superblock fields of a loaded image, for the raw walks */
+typedef struct {
+    const image_t *image;
+    uint32_t pages_per_cluster;
+    uint32_t clusters_per_card;
+    uint32_t alloc_offset;
+    uint32_t alloc_end;
+    uint32_t root_cluster;
+    uint32_t ifc_list[MAX_IFC];
+} card_t;
+
+typedef struct tree_node {
+    char name[NAME_LENGTH + 1];
+    bool dir;
+    uint32_t size;
+    uint8_t *data;
+    struct tree_node *children;
+    size_t count;
+} tree_node_t;
+
+static struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t erases;
+} counters;
+
+static image_t *current;
+
+static int page_erase(mcfat_cardspecs_t *info, uint32_t page) {
+    (void)info;
+    counters.erases++;
+    if ((size_t)(page + 1) * PAGE_SIZE > current->size)
+        return sceMcResFailIO;
+    memset(current->data + (size_t)page * PAGE_SIZE, CARD_ERASE_VALUE, PAGE_SIZE);
+    return sceMcResSucceed;
+}
+
+static int page_write(mcfat_cardspecs_t *info, uint32_t page, void *buff) {
+    (void)info;
+    counters.writes++;
+    if ((size_t)(page + 1) * PAGE_SIZE > current->size)
+        return sceMcResFailIO;
+    memcpy(current->data + (size_t)page * PAGE_SIZE, buff, PAGE_SIZE);
+    return sceMcResSucceed;
+}
+
+static int page_read(mcfat_cardspecs_t *info, uint32_t page, uint32_t count, void *buff) {
+    (void)info;
+    counters.reads++;
+    if ((size_t)page * PAGE_SIZE + count > current->size)
+        return sceMcResFailIO;
+    memcpy(buff, current->data + (size_t)page * PAGE_SIZE, count);
+    return sceMcResSucceed;
+}
+
+static int ecc_write(mcfat_cardspecs_t *info, uint32_t page, void *buff) {
+    (void)info;
+    (void)page;
+    (void)buff;
+    return sceMcResSucceed;
+}
+
+static int ecc_read(mcfat_cardspecs_t *info, uint32_t page, uint32_t count, void *buff) {
+    (void)info;
+    (void)page;
+    (void)count;
+    (void)buff;
+    return sceMcResSucceed;
+}
+
+static uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Image handling */
+
+static bool image_alloc(image_t *image, size_t size) {
+    image->data = malloc(size);
+    image->size = size;
+    if (!image->data) {
+        fprintf(stderr, "out of memory for a %zu byte image\n", size);
+        return false;
+    }
+    memset(image->data, 0xFF, size);
+    return true;
+}
+
+static bool image_load(image_t *image, const char *path) {
+    FILE *f = fopen(path, "rb");
+    long size;
+
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if ((size <= 0) || (size % (PAGE_SIZE * BLOCK_SIZE) != 0)) {
+        fprintf(stderr, "%s: %ld bytes is not a raw PS2 card image (images with ECC are not supported)\n", path, size);
+        fclose(f);
+        return false;
+    }
+
+    if (!image_alloc(image, size) || (fread(image->data, 1, size, f) != (size_t)size)) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        return false;
+    }
+
+    fclose(f);
+    return true;
+}
+
+static bool image_save(const image_t *image, const char *path) {
+    FILE *f = fopen(path, "wb");
+
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    if (fwrite(image->data, 1, image->size, f) != image->size) {
+        perror(path);
+        fclose(f);
+        return false;
+    }
+
+    return fclose(f) == 0;
+}
+
+/* Makes the image the card mcfat works on */
+static int image_mount(image_t *image) {
+    const mcfat_mcops_t ops = { page_erase, page_write, page_read, ecc_write, ecc_read };
+    const mcfat_cardspecs_t specs = {
+        .pagesize = PAGE_SIZE,
+        .blocksize = BLOCK_SIZE,
+        .cardsize = image->size / PAGE_SIZE,
+        .flags = CARD_FLAGS,
+    };
+
+    current = image;
+    mcfat_setCardChanged(true);
+    mcfat_setConfig(ops, specs);
+
+    return mcio_init();
+}
+
+static int image_format(image_t *image) {
+    int ret;
+
+    image_mount(image);
+    ret = mcio_mcFormat();
+    if (ret == sceMcResSucceed)
+        ret = mcio_init();
+
+    return ret;
+}
+
+/* Raw access */
+
+static bool card_parse(card_t *card, const image_t *image) {
+    const uint8_t *sb = image->data;
+
+    memset(card, 0x00, sizeof(*card));
+    card->image = image;
+
+    if ((memcmp(sb, SUPERBLOCK_MAGIC, SUPERBLOCK_MAGIC_LENGTH) != 0) || (get_le16(&sb[SUPERBLOCK_PAGESIZE]) != PAGE_SIZE))
+        return false;
+
+    card->pages_per_cluster = get_le16(&sb[SUPERBLOCK_PAGES_PER_CL]);
+    card->clusters_per_card = get_le32(&sb[SUPERBLOCK_CLUSTERS]);
+    card->alloc_offset = get_le32(&sb[SUPERBLOCK_ALLOC_OFFSET]);
+    card->alloc_end = get_le32(&sb[SUPERBLOCK_ALLOC_END]);
+    card->root_cluster = get_le32(&sb[SUPERBLOCK_ROOTDIR]);
+    for (int i = 0; i < MAX_IFC; i++)
+        card->ifc_list[i] = get_le32(&sb[SUPERBLOCK_IFC_LIST + i * 4]);
+
+    return (card->pages_per_cluster != 0)
+        && ((size_t)card->clusters_per_card * card->pages_per_cluster * PAGE_SIZE <= image->size)
+        && (card->alloc_offset + card->alloc_end <= card->clusters_per_card);
+}
+
+/* Page of an absolute cluster */
+static uint8_t *card_page(const card_t *card, uint32_t cluster, uint32_t page) {
+    if ((cluster >= card->clusters_per_card) || (page >= card->pages_per_cluster))
+        return NULL;
+    return card->image->data + ((size_t)cluster * card->pages_per_cluster + page) * PAGE_SIZE;
+}
+
+static bool card_fat_entry(const card_t *card, uint32_t cluster, uint32_t *entry) {
+    uint32_t per_page = PAGE_SIZE / 4;
+    uint32_t indirect_index = cluster / FAT_ENTRIES;
+    uint32_t fat_offset = cluster % FAT_ENTRIES;
+    uint32_t ifc_index = indirect_index / FAT_ENTRIES;
+    uint32_t indirect_offset = indirect_index % FAT_ENTRIES;
+    const uint8_t *page;
+
+    if (ifc_index >= MAX_IFC)
+        return false;
+
+    page = card_page(card, card->ifc_list[ifc_index], indirect_offset / per_page);
+    if (!page)
+        return false;
+
+    page = card_page(card, get_le32(&page[(indirect_offset % per_page) * 4]), fat_offset / per_page);
+    if (!page)
+        return false;
+
+    *entry = get_le32(&page[(fat_offset % per_page) * 4]);
+    return true;
+}
+
+/* Entry index of the directory starting at cluster, NULL past the chain */
+static uint8_t *card_dir_entry(const card_t *card, uint32_t cluster, uint32_t index) {
+    uint32_t entry;
+
+    for (uint32_t i = 0; i < index / card->pages_per_cluster; i++) {
+        if (!card_fat_entry(card, cluster, &entry) || (entry == FAT_CHAIN_END) || !(entry & FAT_ENTRY_USED))
+            return NULL;
+        cluster = entry & ~FAT_ENTRY_USED;
+    }
+
+    return card_page(card, card->alloc_offset + cluster, index % card->pages_per_cluster);
+}
+
+/* Directory entry of an absolute path, "/" is the "." of the root */
+static uint8_t *card_find(const card_t *card, const char *path) {
+    uint8_t *entry = card_dir_entry(card, card->root_cluster, 0);
+    uint32_t cluster = card->root_cluster;
+    uint32_t length = entry ? get_le32(&entry[ENTRY_LENGTH]) : 0;
+
+    while (entry && *path) {
+        char name[NAME_LENGTH + 1];
+        size_t len;
+
+        while (*path == '/')
+            path++;
+        len = strcspn(path, "/");
+        if (len == 0)
+            break;
+        if (len > NAME_LENGTH)
+            return NULL;
+        memcpy(name, path, len);
+        name[len] = '\0';
+        path += len;
+
+        entry = NULL;
+        for (uint32_t i = 0; i < length; i++) {
+            uint8_t *e = card_dir_entry(card, cluster, i);
+            if (!e)
+                return NULL;
+            if ((get_le16(&e[ENTRY_MODE]) & sceMcFileAttrExists) && (strncmp((char *)&e[ENTRY_NAME], name, NAME_LENGTH) == 0)) {
+                entry = e;
+                break;
+            }
+        }
+
+        if (entry) {
+            cluster = get_le32(&entry[ENTRY_CLUSTER]);
+            length = get_le32(&entry[ENTRY_LENGTH]);
+        }
+    }
+
+    return entry;
+}
+
+/* Path helpers */
+
+static void join(char *out, const char *dir, const char *name) {
+    size_t len = strlen(dir);
+    snprintf(out, PATH_LENGTH, "%s%s%s", dir, (len && dir[len - 1] == '/') ? "" : "/", name);
+}
+
+/* Last path component without trailing slashes, empty for the root */
+static void basename_of(char *out, const char *path) {
+    const char *end = path + strlen(path);
+    while ((end > path) && (end[-1] == '/'))
+        end--;
+    const char *start = end;
+    while ((start > path) && (start[-1] != '/'))
+        start--;
+    snprintf(out, PATH_LENGTH, "%.*s", (int)(end - start), start);
+}
+
+/* Reads all entries of a card directory except "." and "..", the handle is
+ * closed on return */
+static int read_dir(const char *path, struct io_dirent **entries, size_t *count) {
+    char buf[PATH_LENGTH];
+    struct io_dirent dirent;
+    int fd, ret;
+
+    *entries = NULL;
+    *count = 0;
+
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    fd = mcio_mcDopen(buf);
+    if (fd < 0)
+        return fd;
+
+    while ((ret = mcio_mcDread(fd, &dirent)) > 0) {
+        if ((strcmp(dirent.name, ".") == 0) || (strcmp(dirent.name, "..") == 0))
+            continue;
+        *entries = realloc(*entries, (*count + 1) * sizeof(dirent));
+        (*entries)[(*count)++] = dirent;
+    }
+    mcio_mcDclose(fd);
+
+    return ret < 0 ? ret : 0;
+}
+
+static int read_file(const char *path, uint8_t *data, uint32_t size) {
+    char buf[PATH_LENGTH];
+    int fd, ret;
+
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    fd = mcio_mcOpen(buf, OPEN_READ);
+    if (fd < 0)
+        return fd;
+
+    ret = size ? mcio_mcRead(fd, data, size) : 0;
+    mcio_mcClose(fd);
+    if ((ret >= 0) && ((uint32_t)ret != size))
+        ret = sceMcResFailIO;
+
+    return ret < 0 ? ret : 0;
+}
+
+static int write_file(const char *path, const uint8_t *data, uint32_t size) {
+    char buf[PATH_LENGTH];
+    int fd, ret;
+
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    mcio_mcRemove(buf);
+    fd = mcio_mcOpen(buf, OPEN_CREATE);
+    if (fd < 0)
+        return fd;
+
+    ret = size ? mcio_mcWrite(fd, (void *)data, size) : 0;
+    mcio_mcClose(fd);
+    if ((ret >= 0) && ((uint32_t)ret != size))
+        ret = sceMcResFullDevice;
+
+    return ret < 0 ? ret : 0;
+}
+
+/* Writes the data of an existing, empty file */
+static int fill_file(const char *path, const uint8_t *data, uint32_t size) {
+    char buf[PATH_LENGTH];
+    int fd, ret;
+
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    fd = mcio_mcOpen(buf, sceMcFileAttrWriteable);
+    if (fd < 0)
+        return fd;
+
+    ret = mcio_mcWrite(fd, (void *)data, size);
+    mcio_mcClose(fd);
+    if ((ret >= 0) && ((uint32_t)ret != size))
+        ret = sceMcResFullDevice;
+
+    return ret < 0 ? ret : 0;
+}
+
+static int make_dir(const char *path) {
+    char buf[PATH_LENGTH];
+    int fd;
+
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    // already there is fine, saves get merged
+    fd = mcio_mcDopen(buf);
+    if (fd >= 0)
+        return mcio_mcDclose(fd);
+
+    // no handle stays open for a new directory
+    return mcio_mcMkDir(buf);
+}
+
+/* ls */
+
+static int list_dir(const char *path) {
+    struct io_dirent *entries;
+    size_t count;
+    int ret = read_dir(path, &entries, &count);
+
+    if (ret < 0) {
+        fprintf(stderr, "%s: error %d\n", path, ret);
+        return ret;
+    }
+
+    for (size_t i = 0; (i < count) && (ret == 0); i++) {
+        const struct io_stat *st = &entries[i].stat;
+        char child[PATH_LENGTH];
+
+        join(child, path, entries[i].name);
+        printf("%c%c%c%c %8" PRIu32 "  %04u-%02u-%02u %02u:%02u:%02u  %s%s\n",
+               (st->mode & sceMcFileAttrSubdir) ? 'd' : '-',
+               (st->mode & sceMcFileAttrReadable) ? 'r' : '-',
+               (st->mode & sceMcFileAttrWriteable) ? 'w' : '-',
+               (st->mode & sceMcFileAttrExecutable) ? 'x' : '-',
+               st->size, st->mtime.Year, st->mtime.Month, st->mtime.Day,
+               st->mtime.Hour, st->mtime.Min, st->mtime.Sec,
+               child, (st->mode & sceMcFileAttrSubdir) ? "/" : "");
+
+        if (st->mode & sceMcFileAttrSubdir)
+            ret = list_dir(child);
+    }
+
+    free(entries);
+    return ret;
+}
+
+static int cmd_ls(image_t *image, int argc, char **argv) {
+    int ret, free_bytes = 0;
+
+    if ((ret = image_mount(image)) != sceMcResSucceed) {
+        fprintf(stderr, "card not formatted (%d)\n", ret);
+        return 1;
+    }
+
+    ret = list_dir(argc > 0 ? argv[0] : "/");
+    if (mcio_mcGetAvailableSpace(&free_bytes) == sceMcResSucceed)
+        printf("%d KB free\n", free_bytes / 1024);
+
+    return ret < 0 ? 1 : 0;
+}
+
+/* extract */
+
+static int extract(const char *path, const char *host, bool dir, uint32_t size) {
+    int ret = 0;
+
+    if (dir) {
+        struct io_dirent *entries;
+        size_t count;
+
+        if ((mkdir(host, 0777) != 0) && (errno != EEXIST)) {
+            perror(host);
+            return -1;
+        }
+        if ((ret = read_dir(path, &entries, &count)) < 0)
+            return ret;
+
+        for (size_t i = 0; (i < count) && (ret == 0); i++) {
+            char child[PATH_LENGTH], host_child[PATH_LENGTH];
+            join(child, path, entries[i].name);
+            join(host_child, host, entries[i].name);
+            ret = extract(child, host_child, entries[i].stat.mode & sceMcFileAttrSubdir, entries[i].stat.size);
+        }
+
+        free(entries);
+        return ret;
+    }
+
+    uint8_t *data = malloc(size ? size : 1);
+    FILE *f;
+
+    if ((ret = read_file(path, data, size)) < 0) {
+        free(data);
+        return ret;
+    }
+
+    f = fopen(host, "wb");
+    if (!f || (fwrite(data, 1, size, f) != size)) {
+        perror(host);
+        ret = -1;
+    }
+    if (f)
+        fclose(f);
+    free(data);
+
+    return ret;
+}
+
+static int cmd_extract(image_t *image, int argc, char **argv) {
+    char host[PATH_LENGTH], name[PATH_LENGTH];
+    card_t card;
+    uint8_t *entry;
+    int ret;
+
+    if (argc < 2)
+        return -1;
+    if ((ret = image_mount(image)) != sceMcResSucceed) {
+        fprintf(stderr, "card not formatted (%d)\n", ret);
+        return 1;
+    }
+
+    if (!card_parse(&card, image) || !(entry = card_find(&card, argv[0]))) {
+        fprintf(stderr, "%s: not found\n", argv[0]);
+        return 1;
+    }
+
+    basename_of(name, argv[0]);
+    join(host, argv[1], name[0] ? name : "root");
+    ret = extract(argv[0], host, get_le16(&entry[ENTRY_MODE]) & sceMcFileAttrSubdir, get_le32(&entry[ENTRY_LENGTH]));
+    if (ret < 0) {
+        fprintf(stderr, "%s: error %d\n", argv[0], ret);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* insert */
+
+static int insert(const char *host, const char *path) {
+    char name[PATH_LENGTH];
+    struct stat st;
+    int ret = 0;
+
+    basename_of(name, path);
+    if (strlen(name) > NAME_LENGTH) {
+        fprintf(stderr, "%s: name longer than %d characters\n", host, NAME_LENGTH);
+        return -1;
+    }
+    if (stat(host, &st) != 0) {
+        perror(host);
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(host);
+        struct dirent *de;
+
+        if (!dir) {
+            perror(host);
+            return -1;
+        }
+        if ((ret = make_dir(path)) < 0) {
+            closedir(dir);
+            return ret;
+        }
+
+        while ((ret == 0) && (de = readdir(dir))) {
+            char host_child[PATH_LENGTH], child[PATH_LENGTH];
+            if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+                continue;
+            join(host_child, host, de->d_name);
+            join(child, path, de->d_name);
+            ret = insert(host_child, child);
+        }
+
+        closedir(dir);
+        return ret;
+    }
+
+    FILE *f = fopen(host, "rb");
+    uint8_t *data = malloc(st.st_size ? st.st_size : 1);
+
+    if (!f || (fread(data, 1, st.st_size, f) != (size_t)st.st_size)) {
+        perror(host);
+        ret = -1;
+    } else {
+        ret = write_file(path, data, st.st_size);
+    }
+
+    if (f)
+        fclose(f);
+    free(data);
+
+    return ret;
+}
+
+static int cmd_insert(image_t *image, const char *image_path, int argc, char **argv) {
+    char path[PATH_LENGTH], name[PATH_LENGTH];
+    int ret;
+
+    if (argc < 1)
+        return -1;
+    if ((ret = image_mount(image)) != sceMcResSucceed) {
+        fprintf(stderr, "card not formatted (%d)\n", ret);
+        return 1;
+    }
+
+    basename_of(name, argv[0]);
+    join(path, argc > 1 ? argv[1] : "/", name);
+    ret = insert(argv[0], path);
+    if (ret < 0) {
+        fprintf(stderr, "%s: error %d, image left unchanged\n", argv[0], ret);
+        return 1;
+    }
+
+    return image_save(image, image_path) ? 0 : 1;
+}
+
+/* rm */
+
+static int remove_path(const char *path, bool dir) {
+    char buf[PATH_LENGTH];
+    int ret = 0;
+
+    if (dir) {
+        struct io_dirent *entries;
+        size_t count;
+
+        if ((ret = read_dir(path, &entries, &count)) < 0)
+            return ret;
+        for (size_t i = 0; (i < count) && (ret == 0); i++) {
+            join(buf, path, entries[i].name);
+            ret = remove_path(buf, entries[i].stat.mode & sceMcFileAttrSubdir);
+        }
+        free(entries);
+        if (ret < 0)
+            return ret;
+    }
+
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    return dir ? mcio_mcRmDir(buf) : mcio_mcRemove(buf);
+}
+
+static int cmd_rm(image_t *image, const char *image_path, int argc, char **argv) {
+    card_t card;
+    uint8_t *entry;
+    int ret;
+
+    if (argc < 1)
+        return -1;
+    if ((ret = image_mount(image)) != sceMcResSucceed) {
+        fprintf(stderr, "card not formatted (%d)\n", ret);
+        return 1;
+    }
+
+    if (!card_parse(&card, image) || !(entry = card_find(&card, argv[0])) || (entry == card_find(&card, "/"))) {
+        fprintf(stderr, "%s: not found\n", argv[0]);
+        return 1;
+    }
+
+    ret = remove_path(argv[0], get_le16(&entry[ENTRY_MODE]) & sceMcFileAttrSubdir);
+    if (ret < 0) {
+        fprintf(stderr, "%s: error %d, image left unchanged\n", argv[0], ret);
+        return 1;
+    }
+
+    return image_save(image, image_path) ? 0 : 1;
+}
+
+/* fsck */
+
+typedef struct {
+    const card_t *card;
+    uint8_t *owned;
+    unsigned dirs;
+    unsigned files;
+    unsigned fragmented;
+    unsigned errors;
+    unsigned warnings;
+} fsck_t;
+
+/* Claims the clusters needed by an entry, reports what is wrong with its chain */
+static void fsck_chain(fsck_t *fsck, const char *path, uint32_t cluster, uint32_t needed) {
+    uint32_t entry = FAT_CHAIN_END;
+    bool fragmented = false;
+
+    for (uint32_t i = 0; i < needed; i++) {
+        if (cluster >= fsck->card->alloc_end) {
+            printf("%s: cluster %" PRIu32 " out of range\n", path, cluster);
+            fsck->errors++;
+            return;
+        }
+        if (!card_fat_entry(fsck->card, cluster, &entry)) {
+            printf("%s: FAT of cluster %" PRIu32 " not readable\n", path, cluster);
+            fsck->errors++;
+            return;
+        }
+        if (!(entry & FAT_ENTRY_USED) || (entry == FAT_BAD)) {
+            printf("%s: cluster %" PRIu32 " is not allocated\n", path, cluster);
+            fsck->errors++;
+            return;
+        }
+        if (fsck->owned[cluster]) {
+            printf("%s: cluster %" PRIu32 " is cross linked\n", path, cluster);
+            fsck->errors++;
+            return;
+        }
+        fsck->owned[cluster] = 1;
+
+        if ((entry == FAT_CHAIN_END) && (i + 1 < needed)) {
+            printf("%s: chain ends after %" PRIu32 " of %" PRIu32 " clusters\n", path, i + 1, needed);
+            fsck->errors++;
+            return;
+        }
+        if ((i + 1 < needed) && ((entry & ~FAT_ENTRY_USED) != cluster + 1))
+            fragmented = true;
+        cluster = entry & ~FAT_ENTRY_USED;
+    }
+
+    if (fragmented)
+        fsck->fragmented++;
+    if (needed && (entry != FAT_CHAIN_END)) {
+        printf("%s: chain longer than %" PRIu32 " clusters\n", path, needed);
+        fsck->warnings++;
+    }
+}
+
+static void fsck_dir(fsck_t *fsck, const char *path, uint32_t cluster, uint32_t length) {
+    const card_t *card = fsck->card;
+
+    fsck->dirs++;
+    fsck_chain(fsck, path, cluster, (length + card->pages_per_cluster - 1) / card->pages_per_cluster);
+
+    for (uint32_t i = 0; i < length; i++) {
+        const uint8_t *entry = card_dir_entry(card, cluster, i);
+        char name[NAME_LENGTH + 1], child[PATH_LENGTH];
+
+        if (!entry) {
+            printf("%s: entry %" PRIu32 " of %" PRIu32 " not reachable\n", path, i, length);
+            fsck->errors++;
+            return;
+        }
+
+        uint16_t mode = get_le16(&entry[ENTRY_MODE]);
+        if (!(mode & sceMcFileAttrExists))
+            continue;
+
+        memcpy(name, &entry[ENTRY_NAME], NAME_LENGTH);
+        name[NAME_LENGTH] = '\0';
+        if (i < 2) {
+            if (strcmp(name, i == 0 ? "." : "..") != 0) {
+                printf("%s: entry %" PRIu32 " is \"%s\"\n", path, i, name);
+                fsck->warnings++;
+            }
+            continue;
+        }
+
+        join(child, path, name);
+        if (mode & sceMcFileAttrSubdir) {
+            fsck_dir(fsck, child, get_le32(&entry[ENTRY_CLUSTER]), get_le32(&entry[ENTRY_LENGTH]));
+        } else {
+            uint32_t size = get_le32(&entry[ENTRY_LENGTH]);
+            fsck->files++;
+            if (size)
+                fsck_chain(fsck, child, get_le32(&entry[ENTRY_CLUSTER]), (size + PAGE_SIZE * card->pages_per_cluster - 1) / (PAGE_SIZE * card->pages_per_cluster));
+        }
+    }
+}
+
+static int cmd_fsck(image_t *image) {
+    card_t card;
+    fsck_t fsck = { .card = &card };
+    unsigned used = 0, lost = 0, bad = 0;
+    const uint8_t *root;
+
+    if (!card_parse(&card, image)) {
+        printf("superblock invalid, card not formatted\n");
+        return 1;
+    }
+    if (!(root = card_dir_entry(&card, card.root_cluster, 0))) {
+        printf("root directory not reachable\n");
+        return 1;
+    }
+
+    fsck.owned = calloc(card.alloc_end, 1);
+    fsck_dir(&fsck, "/", card.root_cluster, get_le32(&root[ENTRY_LENGTH]));
+
+    for (uint32_t cluster = 0; cluster < card.alloc_end; cluster++) {
+        uint32_t entry;
+        if (!card_fat_entry(&card, cluster, &entry)) {
+            printf("FAT of cluster %" PRIu32 " not readable\n", cluster);
+            fsck.errors++;
+            break;
+        }
+        if (entry == FAT_BAD) {
+            bad++;
+        } else if (entry & FAT_ENTRY_USED) {
+            used++;
+            if (!fsck.owned[cluster])
+                lost++;
+        }
+    }
+    free(fsck.owned);
+
+    if (lost) {
+        printf("%u clusters allocated but not in use\n", lost);
+        fsck.warnings++;
+    }
+
+    printf("%u directories, %u files, %u fragmented\n", fsck.dirs, fsck.files, fsck.fragmented);
+    printf("%u of %" PRIu32 " clusters used, %u bad, %u errors, %u warnings\n",
+           used, card.alloc_end, bad, fsck.errors, fsck.warnings);
+
+    return fsck.errors ? 1 : 0;
+}
+
+/* compact */
+
+static int tree_load(tree_node_t *node, const char *path) {
+    struct io_dirent *entries;
+    int ret = read_dir(path, &entries, &node->count);
+
+    if (ret < 0)
+        return ret;
+
+    node->children = calloc(node->count ? node->count : 1, sizeof(tree_node_t));
+    for (size_t i = 0; (i < node->count) && (ret == 0); i++) {
+        tree_node_t *child = &node->children[i];
+        char child_path[PATH_LENGTH];
+
+        strncpy(child->name, entries[i].name, NAME_LENGTH);
+        child->dir = entries[i].stat.mode & sceMcFileAttrSubdir;
+        child->size = entries[i].stat.size;
+        join(child_path, path, child->name);
+
+        if (child->dir) {
+            ret = tree_load(child, child_path);
+        } else {
+            child->data = malloc(child->size ? child->size : 1);
+            ret = read_file(child_path, child->data, child->size);
+        }
+    }
+
+    free(entries);
+    return ret;
+}
+
+/* Grows an empty directory to its final length before anything else gets
+ * allocated, so its own clusters stay in one run. Placeholder entries take
+ * no data clusters, removing them keeps the length and the entries of the
+ * directory reuse their slots */
+static int dir_presize(const char *path, size_t count) {
+    char child_path[PATH_LENGTH], name[NAME_LENGTH];
+    int ret = 0;
+
+    for (size_t i = 0; (i < count) && (ret == 0); i++) {
+        snprintf(name, sizeof(name), "~compact%zu", i);
+        join(child_path, path, name);
+        ret = write_file(child_path, NULL, 0);
+    }
+    for (size_t i = 0; (i < count) && (ret == 0); i++) {
+        snprintf(name, sizeof(name), "~compact%zu", i);
+        join(child_path, path, name);
+        ret = remove_path(child_path, false);
+    }
+
+    return ret;
+}
+
+/* Writes a directory with all its files before the next one, so each save
+ * ends up in one run of clusters. The directory is sized first, it would
+ * otherwise grow in between the file data and the subdirectories */
+static int tree_store(const tree_node_t *node, const char *path) {
+    char child_path[PATH_LENGTH];
+    int ret = dir_presize(path, node->count);
+
+    for (size_t i = 0; (i < node->count) && (ret == 0); i++) {
+        if (!node->children[i].dir) {
+            join(child_path, path, node->children[i].name);
+            ret = write_file(child_path, NULL, 0);
+        }
+    }
+
+    for (size_t i = 0; (i < node->count) && (ret == 0); i++) {
+        const tree_node_t *child = &node->children[i];
+
+        join(child_path, path, child->name);
+        if (child->dir) {
+            if ((ret = make_dir(child_path)) == 0)
+                ret = tree_store(child, child_path);
+        } else if (child->size) {
+            ret = fill_file(child_path, child->data, child->size);
+        }
+    }
+
+    return ret;
+}
+
+/* mcfat stamps new entries with the host time and its own mode bits, the
+ * originals are copied over from the old image */
+static void tree_restore_meta(const tree_node_t *node, const char *path, const card_t *from, const card_t *to) {
+    for (size_t i = 0; i < node->count; i++) {
+        const tree_node_t *child = &node->children[i];
+        char child_path[PATH_LENGTH];
+        const uint8_t *src;
+        uint8_t *dst;
+
+        join(child_path, path, child->name);
+        src = card_find(from, child_path);
+        dst = card_find(to, child_path);
+        if (!src || !dst)
+            continue;
+
+        memcpy(&dst[ENTRY_MODE], &src[ENTRY_MODE], 2);
+        memcpy(&dst[ENTRY_CREATED], &src[ENTRY_CREATED], ENTRY_TIME_LEN);
+        memcpy(&dst[ENTRY_MODIFIED], &src[ENTRY_MODIFIED], ENTRY_TIME_LEN);
+        memcpy(&dst[ENTRY_ATTR], &src[ENTRY_ATTR], 4);
+
+        if (child->dir) {
+            uint8_t *dot = card_dir_entry(to, get_le32(&dst[ENTRY_CLUSTER]), 0);
+            if (dot) {
+                memcpy(&dot[ENTRY_CREATED], &src[ENTRY_CREATED], ENTRY_TIME_LEN);
+                memcpy(&dot[ENTRY_MODIFIED], &src[ENTRY_MODIFIED], ENTRY_TIME_LEN);
+            }
+            tree_restore_meta(child, child_path, from, to);
+        }
+    }
+}
+
+static void tree_free(tree_node_t *node) {
+    for (size_t i = 0; i < node->count; i++)
+        tree_free(&node->children[i]);
+    free(node->children);
+    free(node->data);
+}
+
+static int cmd_compact(image_t *image, const char *image_path, int argc, char **argv) {
+    tree_node_t root = { .dir = true };
+    image_t out;
+    card_t from, to;
+    int ret;
+
+    if ((ret = image_mount(image)) != sceMcResSucceed) {
+        fprintf(stderr, "card not formatted (%d)\n", ret);
+        return 1;
+    }
+    if ((ret = tree_load(&root, "/")) < 0) {
+        fprintf(stderr, "reading the card failed (%d), run fsck\n", ret);
+        return 1;
+    }
+
+    if (!image_alloc(&out, image->size))
+        return 1;
+    if ((ret = image_format(&out)) != sceMcResSucceed) {
+        fprintf(stderr, "format failed (%d)\n", ret);
+        return 1;
+    }
+    if ((ret = tree_store(&root, "/")) < 0) {
+        fprintf(stderr, "writing the card failed (%d)\n", ret);
+        return 1;
+    }
+
+    if (card_parse(&from, image) && card_parse(&to, &out))
+        tree_restore_meta(&root, "/", &from, &to);
+    tree_free(&root);
+
+    ret = image_save(&out, argc > 0 ? argv[0] : image_path) ? 0 : 1;
+    free(out.data);
+
+    return ret;
+}
+
+/* format */
+
+static int cmd_format(const char *image_path, int argc, char **argv) {
+    image_t image;
+    long size_mb = argc > 0 ? strtol(argv[0], NULL, 0) : 8;
+    int ret;
+
+    if ((size_mb <= 0) || (size_mb > 128) || (size_mb & (size_mb - 1))) {
+        fprintf(stderr, "card size must be a power of two up to 128 MB\n");
+        return 1;
+    }
+
+    if (!image_alloc(&image, (size_t)size_mb * 1024 * 1024))
+        return 1;
+    if ((ret = image_format(&image)) != sceMcResSucceed) {
+        fprintf(stderr, "format failed (%d)\n", ret);
+        free(image.data);
+        return 1;
+    }
+
+    ret = image_save(&image, image_path) ? 0 : 1;
+    free(image.data);
+
+    return ret;
+}
+
+/* bench */
+
+#define BENCH_FILES 3
+#define BENCH_FRAG_FILES 8
+#define BENCH_FRAG_SIZE (64 * 1024)
+#define BENCH_FRAG_CHUNK 1024   // one cluster
+
+static const char *bench_files[BENCH_FILES] = { "icon.sys", "icon.ico", "data" };
+
+/* A few dozen KB per save, roughly what games write */
+static uint32_t bench_file_size(unsigned save, unsigned file) {
+    switch (file) {
+        case 0: return 964;
+        case 1: return 16 * 1024 + (save * 7919) % (32 * 1024);
+        default: return 8 * 1024 + (save * 104729) % (96 * 1024);
+    }
+}
+
+/* Operations that failed are counted in, so they are reported next to the
+ * numbers instead of passing as fast ones */
+static void bench_report(unsigned size_mb, const char *op, unsigned ops, unsigned failed, uint64_t start) {
+    uint64_t us = now_us() - start;
+
+    printf("%4u MB  %-8s %6u ops %10.1f us/op %8.1f reads/op %8.1f writes/op %8.1f erases/op",
+           size_mb, op, ops, (double)us / ops, (double)counters.reads / ops,
+           (double)counters.writes / ops, (double)counters.erases / ops);
+    if (failed)
+        printf("  %u FAILED", failed);
+    printf("\n");
+}
+
+static void bench_reset(void) {
+    memset(&counters, 0x00, sizeof(counters));
+    // cold cache, as after a card switch
+    mcio_init();
+}
+
+/* Grows the files a cluster at a time in turns, so that their chains
+ * interleave like on a card that saw many saves come and go */
+static int bench_write_interleaved(const char *dir, const uint8_t *data) {
+    char path[PATH_LENGTH];
+    int ret = make_dir(dir);
+
+    for (unsigned f = 0; (f < BENCH_FRAG_FILES) && (ret == 0); f++) {
+        snprintf(path, sizeof(path), "%s/data%u", dir, f);
+        ret = write_file(path, data, 0);
+    }
+    for (uint32_t off = 0; (off < BENCH_FRAG_SIZE) && (ret == 0); off += BENCH_FRAG_CHUNK) {
+        for (unsigned f = 0; (f < BENCH_FRAG_FILES) && (ret == 0); f++) {
+            snprintf(path, sizeof(path), "%s/data%u", dir, f);
+            int fd = mcio_mcOpen(path, sceMcFileAttrWriteable);
+            if (fd < 0)
+                return fd;
+            ret = mcio_mcSeek(fd, off, SEEK_SET);
+            if (ret >= 0)
+                ret = mcio_mcWrite(fd, (void *)&data[off], BENCH_FRAG_CHUNK);
+            mcio_mcClose(fd);
+            ret = (ret == BENCH_FRAG_CHUNK) ? 0 : (ret < 0 ? ret : sceMcResFullDevice);
+        }
+    }
+
+    return ret;
+}
+
+static unsigned bench_fragmented(const image_t *image) {
+    card_t card;
+    fsck_t fsck = { .card = &card };
+    const uint8_t *root;
+
+    if (!card_parse(&card, image) || !(root = card_dir_entry(&card, card.root_cluster, 0)))
+        return 0;
+    fsck.owned = calloc(card.alloc_end, 1);
+    fsck_dir(&fsck, "/", card.root_cluster, get_le32(&root[ENTRY_LENGTH]));
+    free(fsck.owned);
+
+    return fsck.fragmented;
+}
+
+static int bench_card(unsigned size_mb) {
+    unsigned saves = size_mb * 4;
+    uint8_t *buf = malloc(128 * 1024);
+    char path[PATH_LENGTH];
+    image_t image;
+    uint64_t start;
+    unsigned ops, failed;
+    int ret;
+
+    if (!buf || !image_alloc(&image, (size_t)size_mb * 1024 * 1024))
+        return 1;
+    for (unsigned i = 0; i < 128 * 1024; i++)
+        buf[i] = (uint8_t)(i * 31);
+
+    memset(&counters, 0x00, sizeof(counters));
+    start = now_us();
+    if ((ret = image_format(&image)) != sceMcResSucceed) {
+        fprintf(stderr, "%u MB: format failed (%d)\n", size_mb, ret);
+        return 1;
+    }
+    bench_report(size_mb, "format", 1, 0, start);
+
+    bench_reset();
+    start = now_us();
+    for (unsigned s = 0; (s < saves) && (ret == 0); s++) {
+        snprintf(path, sizeof(path), "/BASLUS-%05uSAVE", s);
+        ret = make_dir(path);
+        for (unsigned f = 0; (f < BENCH_FILES) && (ret == 0); f++) {
+            snprintf(path, sizeof(path), "/BASLUS-%05uSAVE/%s", s, bench_files[f]);
+            ret = write_file(path, buf, bench_file_size(s, f));
+        }
+    }
+    if (ret < 0) {
+        fprintf(stderr, "%u MB: creating the saves failed (%d)\n", size_mb, ret);
+        return 1;
+    }
+    bench_report(size_mb, "create", saves, 0, start);
+
+    bench_reset();
+    start = now_us();
+    ops = 0;
+    failed = 0;
+    {
+        struct io_dirent *entries, *save_entries;
+        size_t count, save_count;
+
+        if (read_dir("/", &entries, &count) < 0)
+            failed++;
+        ops++;
+        for (size_t i = 0; i < count; i++) {
+            join(path, "/", entries[i].name);
+            if (read_dir(path, &save_entries, &save_count) < 0)
+                failed++;
+            free(save_entries);
+            ops++;
+        }
+        free(entries);
+    }
+    bench_report(size_mb, "dirscan", ops, failed, start);
+
+    bench_reset();
+    start = now_us();
+    failed = 0;
+    for (unsigned s = 0; s < saves; s++) {
+        for (unsigned f = 0; f < BENCH_FILES; f++) {
+            snprintf(path, sizeof(path), "/BASLUS-%05uSAVE/%s", s, bench_files[f]);
+            int fd = mcio_mcOpen(path, OPEN_READ);
+            if (fd >= 0)
+                mcio_mcClose(fd);
+            else
+                failed++;
+        }
+    }
+    bench_report(size_mb, "open", saves * BENCH_FILES, failed, start);
+
+    bench_reset();
+    start = now_us();
+    failed = 0;
+    for (unsigned s = 0; s < saves; s++) {
+        for (unsigned f = 0; f < BENCH_FILES; f++) {
+            snprintf(path, sizeof(path), "/BASLUS-%05uSAVE/%s", s, bench_files[f]);
+            if (read_file(path, buf, bench_file_size(s, f)) < 0)
+                failed++;
+        }
+    }
+    bench_report(size_mb, "read", saves * BENCH_FILES, failed, start);
+
+    // overwrite in place, what a game does when saving again
+    bench_reset();
+    start = now_us();
+    failed = 0;
+    for (unsigned s = 0; s < saves; s++) {
+        snprintf(path, sizeof(path), "/BASLUS-%05uSAVE/%s", s, bench_files[BENCH_FILES - 1]);
+        if (fill_file(path, buf, bench_file_size(s, BENCH_FILES - 1)) < 0)
+            failed++;
+    }
+    bench_report(size_mb, "write", saves, failed, start);
+
+    // the same reads on files whose clusters are spread over the card
+    bench_reset();
+    if ((ret = bench_write_interleaved("/BASLUS-FRAGMENT", buf)) < 0) {
+        printf("%4u MB  fragread skipped, creating the files FAILED (%d)\n", size_mb, ret);
+    } else {
+        bench_reset();
+        start = now_us();
+        failed = 0;
+        for (unsigned f = 0; f < BENCH_FRAG_FILES; f++) {
+            snprintf(path, sizeof(path), "/BASLUS-FRAGMENT/data%u", f);
+            if (read_file(path, buf, BENCH_FRAG_SIZE) < 0)
+                failed++;
+        }
+        bench_report(size_mb, "fragread", BENCH_FRAG_FILES, failed, start);
+        printf("%4u MB  %u fragmented files on the card\n", size_mb, bench_fragmented(&image));
+    }
+
+    free(image.data);
+    free(buf);
+
+    return 0;
+}
+
+static int cmd_bench(int argc, char **argv) {
+    static char *defaults[] = { "8", "16", "32", "64" };
+    int ret = 0;
+
+    if (argc == 0) {
+        argc = 4;
+        argv = defaults;
+    }
+
+    printf("mcfat cache: %d clusters\n", MCFAT_TOOL_CACHE_ENTRIES);
+
+    for (int i = 0; (i < argc) && (ret == 0); i++)
+        ret = bench_card(strtoul(argv[i], NULL, 0));
+
+    return ret;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s <command> [args]\n"
+            "  ls <image> [path]                 list the card\n"
+            "  extract <image> <path> <dir>      copy a file or directory to the host\n"
+            "  insert <image> <host path> [dir]  copy a host file or directory to the card\n"
+            "  rm <image> <path>                 remove a file or directory\n"
+            "  fsck <image>                      check FAT chains and directories\n"
+            "  compact <image> [out]             rewrite the card without fragmentation\n"
+            "  format <image> [size MB]          create a formatted image (default 8)\n"
+            "  bench [size MB ...]               time mcfat operations (default 8 16 32 64)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    image_t image;
+    int ret;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "bench") == 0)
+        return cmd_bench(argc - 2, argv + 2);
+
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "format") == 0)
+        return cmd_format(argv[2], argc - 3, argv + 3);
+
+    if (!image_load(&image, argv[2]))
+        return 1;
+
+    if (strcmp(argv[1], "ls") == 0)
+        ret = cmd_ls(&image, argc - 3, argv + 3);
+    else if (strcmp(argv[1], "extract") == 0)
+        ret = cmd_extract(&image, argc - 3, argv + 3);
+    else if (strcmp(argv[1], "insert") == 0)
+        ret = cmd_insert(&image, argv[2], argc - 3, argv + 3);
+    else if (strcmp(argv[1], "rm") == 0)
+        ret = cmd_rm(&image, argv[2], argc - 3, argv + 3);
+    else if (strcmp(argv[1], "fsck") == 0)
+        ret = cmd_fsck(&image);
+    else if (strcmp(argv[1], "compact") == 0)
+        ret = cmd_compact(&image, argv[2], argc - 3, argv + 3);
+    else
+        ret = -1;
+
+    if (ret < 0)
+        usage(argv[0]);
+
+    free(image.data);
+    return ret < 0 ? 1 : ret;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "pico/platform.h"
+
+/* Nothing on the host does DMA outside of the PSRAM shim, which completes
+ * its transfers synchronously */
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "pico/platform.h"
+#include "hardware/irq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pin state isn't modelled, only the interrupt registers that the firmware
+ * reads back in its own GPIO IRQ handlers */
+
+#define NUM_BANK0_GPIOS 30
+#define NUM_CORES 2
+
+#define GPIO_IRQ_CALLBACK_ORDER_PRIORITY PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY
+
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+enum gpio_slew_rate {
+    GPIO_SLEW_RATE_SLOW = 0,
+    GPIO_SLEW_RATE_FAST = 1
+};
+
+enum gpio_drive_strength {
+    GPIO_DRIVE_STRENGTH_2MA = 0,
+    GPIO_DRIVE_STRENGTH_4MA = 1,
+    GPIO_DRIVE_STRENGTH_8MA = 2,
+    GPIO_DRIVE_STRENGTH_12MA = 3
+};
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7,
+    GPIO_FUNC_NULL = 0x1f,
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+typedef struct {
+    volatile uint32_t inte[4];
+    volatile uint32_t intf[4];
+    volatile uint32_t ints[4];
+} io_irq_ctrl_hw_t;
+
+typedef struct {
+    volatile uint32_t intr[4];
+    io_irq_ctrl_hw_t proc0_irq_ctrl;
+    io_irq_ctrl_hw_t proc1_irq_ctrl;
+} iobank0_hw_t;
+
+extern iobank0_hw_t host_iobank0_hw;
+#define iobank0_hw (&host_iobank0_hw)
+
+static inline void check_gpio_param(uint gpio) {
+    if (gpio >= NUM_BANK0_GPIOS)
+        panic("Invalid GPIO %u", gpio);
+}
+
+static inline void gpio_init(uint gpio) { (void)gpio; }
+static inline void gpio_set_function(uint gpio, enum gpio_function fn) { (void)gpio; (void)fn; }
+static inline void gpio_set_dir(uint gpio, bool out) { (void)gpio; (void)out; }
+static inline void gpio_disable_pulls(uint gpio) { (void)gpio; }
+static inline void gpio_pull_up(uint gpio) { (void)gpio; }
+static inline void gpio_set_slew_rate(uint gpio, enum gpio_slew_rate slew) { (void)gpio; (void)slew; }
+static inline void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive) { (void)gpio; (void)drive; }
+
+/* Enables events for the calling core */
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Interrupts are raised by the host side through host_irq.h and run in the
+ * raising thread, with get_core_num reporting the core that enabled them */
+
+#define IO_IRQ_BANK0 13
+#define NUM_IRQS 32
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_remove_handler(uint num, irq_handler_t handler);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "pico/platform.h"
+
+/* Host stand-in for the PIO blocks. Programs don't execute, each state
+ * machine is a pair of FIFOs that the host side feeds and drains through
+ * host_pio.h. Instructions passed to pio_sm_exec only matter for their
+ * effect on the TX FIFO: OUT and PULL consume a word */
+
+#define NUM_PIOS 2
+#define NUM_PIO_STATE_MACHINES 4
+
+#define PIO_SM0_SHIFTCTRL_AUTOPULL_BITS 0x00020000u
+#define PIO_SM0_SHIFTCTRL_AUTOPUSH_BITS 0x00010000u
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+} pio_sm_hw_t;
+
+typedef struct {
+    pio_sm_hw_t sm[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t host_pio_hw[NUM_PIOS];
+#define pio0 (&host_pio_hw[0])
+#define pio1 (&host_pio_hw[1])
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+} pio_sm_config;
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2,
+};
+
+enum pio_src_dest {
+    pio_pins = 0u,
+    pio_x = 1u,
+    pio_y = 2u,
+    pio_null = 3u,
+    pio_pindirs = 4u,
+    pio_exec_mov = 4u,
+    pio_status = 5u,
+    pio_pc = 5u,
+    pio_isr = 6u,
+    pio_osr = 7u,
+    pio_exec_out = 7u,
+};
+
+/* Real encodings, pio_sm_exec decodes the major opcode */
+#define PIO_INSTR_BITS_JMP  0x0000u
+#define PIO_INSTR_BITS_OUT  0x6000u
+#define PIO_INSTR_BITS_PULL 0x8080u
+#define PIO_INSTR_MASK      0xe000u
+
+static inline uint pio_encode_jmp(uint addr) {
+    return PIO_INSTR_BITS_JMP | (addr & 0x1fu);
+}
+
+static inline uint pio_encode_out(enum pio_src_dest dest, uint count) {
+    return PIO_INSTR_BITS_OUT | ((dest & 7u) << 5) | (count & 0x1fu);
+}
+
+static inline uint pio_encode_pull(bool if_empty, bool block) {
+    return PIO_INSTR_BITS_PULL | (if_empty ? 0x40u : 0u) | (block ? 0x20u : 0u);
+}
+
+static inline pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config c = {0};
+    return c;
+}
+
+static inline void sm_config_set_in_pins(pio_sm_config *c, uint in_base) { (void)c; (void)in_base; }
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) { (void)c; (void)out_base; (void)out_count; }
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) { (void)c; (void)set_base; (void)set_count; }
+static inline void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) { (void)c; (void)pin; }
+static inline void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) { (void)c; (void)join; }
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) { (void)c; (void)wrap_target; (void)wrap; }
+
+static inline void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    (void)shift_right; (void)push_threshold;
+    c->shiftctrl = (c->shiftctrl & ~PIO_SM0_SHIFTCTRL_AUTOPUSH_BITS) | (autopush ? PIO_SM0_SHIFTCTRL_AUTOPUSH_BITS : 0u);
+}
+
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    (void)shift_right; (void)pull_threshold;
+    c->shiftctrl = (c->shiftctrl & ~PIO_SM0_SHIFTCTRL_AUTOPULL_BITS) | (autopull ? PIO_SM0_SHIFTCTRL_AUTOPULL_BITS : 0u);
+}
+
+static inline void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    (void)pio; (void)sm; (void)pin_base; (void)pin_count; (void)is_out;
+}
+
+static inline void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask) {
+    (void)pio; (void)sm; (void)pin_values; (void)pin_mask;
+}
+
+static inline void pio_gpio_init(PIO pio, uint pin) {
+    (void)pio; (void)pin;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+
+static inline void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled) { (void)pio; (void)mask; (void)enabled; }
+static inline void pio_restart_sm_mask(PIO pio, uint32_t mask) { (void)pio; (void)mask; }
+static inline void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask) { (void)pio; (void)mask; }
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) { (void)pio; (void)sm; (void)enabled; }
+
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_drain_tx_fifo(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+
+uint32_t pio_sm_get(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+
+static inline uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+    while (pio_sm_is_rx_fifo_empty(pio, sm))
+        tight_loop_contents();
+    return pio_sm_get(pio, sm);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <sched.h>
+
+#include "pico/platform.h"
+
+/* Spin locks become host atomics. There are no interrupts to mask, DMA
+ * completions of the PSRAM shim run synchronously in the caller */
+typedef volatile uint32_t spin_lock_t;
+
+spin_lock_t *spin_lock_init(uint lock_num);
+uint spin_lock_claim_unused(bool required);
+
+/* Yields so the holder gets to run on hosts with fewer CPUs than threads */
+static inline void spin_lock_unsafe_blocking(spin_lock_t *lock) {
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+static inline void spin_unlock_unsafe(spin_lock_t *lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    spin_lock_unsafe_blocking(lock);
+    return 0;
+}
+
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    (void)saved_irq;
+    spin_unlock_unsafe(lock);
+}
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Every access through timer_hw latches the current host time, which keeps
+ * the hi/lo/hi read sequence of RAM_time_us_64 consistent */
+typedef struct {
+    volatile uint32_t timerawh;
+    volatile uint32_t timerawl;
+} timer_hw_t;
+
+timer_hw_t *host_timer_hw(void);
+#define timer_hw (host_timer_hw())
+
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+void busy_wait_us(uint64_t delay_us);
+
+static inline void busy_wait_us_32(uint32_t delay_us) {
+    busy_wait_us(delay_us);
+}
+
+#ifdef __cplusplus
+}
+#endif
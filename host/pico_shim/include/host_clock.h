@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* time_us_64 follows CLOCK_MONOTONIC by default. A simulated clock only
+ * moves through host_clock_advance and sleeps, which makes timing
+ * reproducible for replays and benchmarks */
+void host_clock_set_simulated(bool simulated);
+bool host_clock_is_simulated(void);
+void host_clock_advance(uint64_t us);
+
+#ifdef __cplusplus
+}
+#endif
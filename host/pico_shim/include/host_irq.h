@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/types.h"
+
+/* Latches events on a GPIO for every core that enabled them and runs the
+ * bank interrupt handlers, as if the edge had happened on the pin */
+void host_gpio_event(uint gpio, uint32_t events);
+
+/* Runs the handlers of an interrupt on behalf of core */
+void host_irq_raise(uint num, uint core);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/pio.h"
+
+/* Host side of the PIO FIFOs, the part the state machine programs would
+ * play on hardware. FIFOs are joined, so each direction holds 8 words */
+#define HOST_PIO_FIFO_DEPTH 8
+
+bool host_pio_rx_push(PIO pio, uint sm, uint32_t data);
+bool host_pio_tx_pop(PIO pio, uint sm, uint32_t *data);
+uint host_pio_tx_level(PIO pio, uint sm);
+
+/* Called on the firmware side for every word that enters a TX FIFO */
+typedef void (*host_pio_put_cb_t)(PIO pio, uint sm, uint32_t data);
+
+void host_pio_set_put_cb(host_pio_put_cb_t cb);
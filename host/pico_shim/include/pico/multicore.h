@@ -0,0 +1,17 @@
+#pragma once
+
+#include "pico/platform.h"
+
+/* Core 1 runs on its own thread */
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+
+/* Flash writes are what the lockout protects, the host has nothing to lock out */
+static inline bool multicore_lockout_victim_is_initialized(uint core_num) {
+    (void)core_num;
+    return false;
+}
+
+static inline void multicore_lockout_victim_init(void) {}
+static inline void multicore_lockout_start_blocking(void) {}
+static inline void multicore_lockout_end_blocking(void) {}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "pico/platform.h"
+
+typedef struct {
+    pthread_mutex_t mtx;
+} mutex_t;
+
+static inline void mutex_init(mutex_t *mtx) {
+    pthread_mutex_init(&mtx->mtx, NULL);
+}
+
+static inline void mutex_enter_blocking(mutex_t *mtx) {
+    pthread_mutex_lock(&mtx->mtx);
+}
+
+static inline bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out) {
+    (void)owner_out;
+    return pthread_mutex_trylock(&mtx->mtx) == 0;
+}
+
+static inline void mutex_exit(mutex_t *mtx) {
+    pthread_mutex_unlock(&mtx->mtx);
+}
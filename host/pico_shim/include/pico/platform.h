@@ -0,0 +1,57 @@
+#pragma once
+
+/* Host stand-in for the pico-sdk platform header, only what the card
+ * emulation core uses */
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __time_critical_func(func_name) func_name
+#define __not_in_flash_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) __attribute__((noinline)) func_name
+#define __not_in_flash(group)
+#define __scratch_x(group)
+#define __scratch_y(group)
+#define __uninitialized_ram(name) name
+#define __force_inline inline __attribute__((always_inline))
+#define __unused __attribute__((unused))
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+/* The cores are threads sharing few host CPUs, hand the CPU over instead of
+ * spinning out the time slice */
+static inline void tight_loop_contents(void) {
+    sched_yield();
+}
+
+static inline void __compiler_memory_barrier(void) {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* 0 for the main thread, 1 for the thread started by multicore_launch_core1 */
+uint get_core_num(void);
+
+void panic(const char *fmt, ...) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
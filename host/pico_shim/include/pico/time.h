@@ -0,0 +1,43 @@
+#pragma once
+
+#include "pico/types.h"
+#include "hardware/timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+static inline absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t)(t / 1000);
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return time_us_64() + us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + 1000ull * ms;
+}
+
+static inline bool time_reached(absolute_time_t t) {
+    return time_us_64() >= t;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+
+/* newlib has strlcpy, glibc only since 2.38 */
+#include_next <string.h>
+
+#if !SD2PSX_HAVE_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
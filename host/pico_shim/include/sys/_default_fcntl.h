@@ -0,0 +1,4 @@
+#pragma once
+
+/* newlib only header, glibc keeps the open flags in fcntl.h */
+#include <fcntl.h>
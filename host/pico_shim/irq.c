@@ -0,0 +1,106 @@
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "host_irq.h"
+#include "pico_shim_internal.h"
+
+#include <pthread.h>
+
+#define MAX_SHARED_HANDLERS 4
+
+typedef struct {
+    irq_handler_t handlers[MAX_SHARED_HANDLERS];
+    bool enabled[NUM_CORES];
+} irq_slot_t;
+
+iobank0_hw_t host_iobank0_hw;
+
+static irq_slot_t irqs[NUM_IRQS];
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static irq_slot_t *irq_slot(uint num) {
+    if (num >= NUM_IRQS)
+        panic("Invalid IRQ %u", num);
+    return &irqs[num];
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    irq_slot(num)->enabled[get_core_num()] = enabled;
+}
+
+bool irq_is_enabled(uint num) {
+    return irq_slot(num)->enabled[get_core_num()];
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    irq_slot_t *slot = irq_slot(num);
+
+    for (int i = 0; i < MAX_SHARED_HANDLERS; i++)
+        slot->handlers[i] = NULL;
+    slot->handlers[0] = handler;
+}
+
+/* Handlers run in the order they were added, priorities are ignored */
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    irq_slot_t *slot = irq_slot(num);
+    (void)order_priority;
+
+    for (int i = 0; i < MAX_SHARED_HANDLERS; i++) {
+        if (!slot->handlers[i]) {
+            slot->handlers[i] = handler;
+            return;
+        }
+    }
+    panic("Too many handlers for IRQ %u", num);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    irq_slot_t *slot = irq_slot(num);
+
+    for (int i = 0; i < MAX_SHARED_HANDLERS; i++)
+        if (slot->handlers[i] == handler)
+            slot->handlers[i] = NULL;
+}
+
+void host_irq_raise(uint num, uint core) {
+    irq_slot_t *slot = irq_slot(num);
+
+    if (core >= NUM_CORES || !slot->enabled[core])
+        return;
+
+    pthread_mutex_lock(&irq_lock);
+    uint prev = pico_shim_set_core_num(core);
+    for (int i = 0; i < MAX_SHARED_HANDLERS; i++)
+        if (slot->handlers[i])
+            slot->handlers[i]();
+    pico_shim_set_core_num(prev);
+    pthread_mutex_unlock(&irq_lock);
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {
+    check_gpio_param(gpio);
+    io_irq_ctrl_hw_t *ctrl = get_core_num() ? &iobank0_hw->proc1_irq_ctrl : &iobank0_hw->proc0_irq_ctrl;
+    uint32_t mask = events << (4 * (gpio % 8));
+
+    if (enabled)
+        ctrl->inte[gpio / 8] |= mask;
+    else
+        ctrl->inte[gpio / 8] &= ~mask;
+}
+
+/* Writes to intr don't clear anything on the host, events are dropped
+ * from ints once the handlers have run */
+void host_gpio_event(uint gpio, uint32_t events) {
+    check_gpio_param(gpio);
+    uint32_t mask = events << (4 * (gpio % 8));
+
+    for (uint core = 0; core < NUM_CORES; core++) {
+        io_irq_ctrl_hw_t *ctrl = core ? &iobank0_hw->proc1_irq_ctrl : &iobank0_hw->proc0_irq_ctrl;
+        uint32_t pending = ctrl->inte[gpio / 8] & mask;
+
+        if (!pending)
+            continue;
+        ctrl->ints[gpio / 8] |= pending;
+        host_irq_raise(IO_IRQ_BANK0, core);
+        ctrl->ints[gpio / 8] &= ~pending;
+    }
+}
@@ -0,0 +1,164 @@
+#include "pico/critical_section.h"
+#include "pico/multicore.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "host_clock.h"
+#include "pico_shim_internal.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_SPIN_LOCKS 32
+
+static spin_lock_t spin_locks[NUM_SPIN_LOCKS];
+static uint32_t spin_locks_claimed;
+/* the first 16 are left to the SDK on hardware, keep the same numbering */
+#define FIRST_UNCLAIMED_LOCK 16
+#define CRITICAL_SECTION_LOCK 31
+
+static _Thread_local uint core_num;
+static pthread_t core1_thread;
+static bool core1_running;
+
+static bool clock_simulated;
+static uint64_t clock_sim_us;
+static uint64_t clock_start_ns;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void host_clock_set_simulated(bool simulated) {
+    clock_sim_us = time_us_64();
+    clock_simulated = simulated;
+}
+
+bool host_clock_is_simulated(void) {
+    return clock_simulated;
+}
+
+void host_clock_advance(uint64_t us) {
+    __atomic_add_fetch(&clock_sim_us, us, __ATOMIC_SEQ_CST);
+}
+
+uint64_t time_us_64(void) {
+    if (clock_simulated)
+        return __atomic_load_n(&clock_sim_us, __ATOMIC_SEQ_CST);
+
+    if (!clock_start_ns)
+        clock_start_ns = monotonic_ns();
+    return (monotonic_ns() - clock_start_ns) / 1000;
+}
+
+timer_hw_t *host_timer_hw(void) {
+    static _Thread_local timer_hw_t hw;
+    uint64_t now = time_us_64();
+
+    hw.timerawh = (uint32_t)(now >> 32);
+    hw.timerawl = (uint32_t)now;
+    return &hw;
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    sleep_us(delay_us);
+}
+
+void sleep_us(uint64_t us) {
+    if (clock_simulated) {
+        host_clock_advance(us);
+        return;
+    }
+
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us(1000ull * ms);
+}
+
+uint get_core_num(void) {
+    return core_num;
+}
+
+uint pico_shim_set_core_num(uint core) {
+    uint prev = core_num;
+
+    core_num = core;
+    return prev;
+}
+
+void panic(const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    abort();
+}
+
+spin_lock_t *spin_lock_init(uint lock_num) {
+    spin_lock_t *lock = &spin_locks[lock_num % NUM_SPIN_LOCKS];
+
+    spin_unlock_unsafe(lock);
+    return lock;
+}
+
+uint spin_lock_claim_unused(bool required) {
+    for (uint i = FIRST_UNCLAIMED_LOCK; i < NUM_SPIN_LOCKS; ++i) {
+        uint32_t bit = 1u << i;
+        if (!(__atomic_fetch_or(&spin_locks_claimed, bit, __ATOMIC_SEQ_CST) & bit))
+            return i;
+    }
+    if (required)
+        panic("No spin locks are available");
+    return (uint)-1;
+}
+
+/* The SDK shares one lock between all critical sections by default, give
+ * each its own so unrelated sections don't serialize on the host */
+void critical_section_init(critical_section_t *crit_sec) {
+    uint lock_num = spin_lock_claim_unused(false);
+
+    if (lock_num == (uint)-1)
+        lock_num = CRITICAL_SECTION_LOCK;
+    crit_sec->spin_lock = spin_lock_init(lock_num);
+}
+
+void critical_section_deinit(critical_section_t *crit_sec) {
+    crit_sec->spin_lock = NULL;
+}
+
+static void *core1_entry(void *arg) {
+    core_num = 1;
+    /* the firmware spins without ever reaching a cancellation point */
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    ((void (*)(void))arg)();
+    return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    if (core1_running)
+        multicore_reset_core1();
+    if (pthread_create(&core1_thread, NULL, core1_entry, (void *)entry) != 0)
+        panic("Failed to start core 1");
+    core1_running = true;
+}
+
+/* Core 1 loops forever on hardware, the thread can only be cancelled */
+void multicore_reset_core1(void) {
+    if (!core1_running)
+        return;
+    pthread_cancel(core1_thread);
+    pthread_join(core1_thread, NULL);
+    core1_running = false;
+}
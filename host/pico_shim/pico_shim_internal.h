@@ -0,0 +1,7 @@
+#pragma once
+
+#include "pico/types.h"
+
+/* Lets interrupts run on the raising thread as the core that owns them,
+ * returns the previous core number */
+uint pico_shim_set_core_num(uint core);
@@ -0,0 +1,190 @@
+#include "hardware/pio.h"
+#include "host_pio.h"
+
+#include <pthread.h>
+
+typedef struct {
+    uint32_t data[HOST_PIO_FIFO_DEPTH];
+    uint head;
+    uint level;
+} fifo_t;
+
+typedef struct {
+    fifo_t rx;
+    fifo_t tx;
+} sm_fifos_t;
+
+pio_hw_t host_pio_hw[NUM_PIOS];
+
+static sm_fifos_t fifos[NUM_PIOS][NUM_PIO_STATE_MACHINES];
+static uint8_t sm_claimed[NUM_PIOS];
+static uint8_t program_used[NUM_PIOS];
+
+/* FIFO state is shared between the firmware thread and the host side */
+static pthread_mutex_t fifo_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_pio_put_cb_t put_cb;
+
+static sm_fifos_t *sm_fifos(PIO pio, uint sm) {
+    uint idx = (uint)(pio - host_pio_hw);
+
+    if (idx >= NUM_PIOS || sm >= NUM_PIO_STATE_MACHINES)
+        panic("Invalid PIO %u SM %u", idx, sm);
+    return &fifos[idx][sm];
+}
+
+static bool fifo_push(fifo_t *fifo, uint32_t data) {
+    if (fifo->level == HOST_PIO_FIFO_DEPTH)
+        return false;
+    fifo->data[(fifo->head + fifo->level) % HOST_PIO_FIFO_DEPTH] = data;
+    fifo->level++;
+    return true;
+}
+
+static bool fifo_pop(fifo_t *fifo, uint32_t *data) {
+    if (fifo->level == 0)
+        return false;
+    if (data)
+        *data = fifo->data[fifo->head];
+    fifo->head = (fifo->head + 1) % HOST_PIO_FIFO_DEPTH;
+    fifo->level--;
+    return true;
+}
+
+/* Every program gets a slot of its own, offsets only have to be distinct */
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+    uint idx = (uint)(pio - host_pio_hw);
+    (void)program;
+
+    for (uint i = 0; i < 8; i++) {
+        if (!(program_used[idx] & (1u << i))) {
+            program_used[idx] |= (1u << i);
+            return i * 4;
+        }
+    }
+    panic("No program space");
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+    (void)program;
+    program_used[pio - host_pio_hw] &= ~(1u << (loaded_offset / 4));
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    uint idx = (uint)(pio - host_pio_hw);
+
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (!(sm_claimed[idx] & (1u << sm))) {
+            sm_claimed[idx] |= (1u << sm);
+            return (int)sm;
+        }
+    }
+    if (required)
+        panic("No PIO state machines are available");
+    return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+    sm_claimed[pio - host_pio_hw] &= ~(1u << sm);
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    (void)initial_pc;
+    pio->sm[sm].clkdiv = config->clkdiv;
+    pio->sm[sm].execctrl = config->execctrl;
+    pio->sm[sm].shiftctrl = config->shiftctrl;
+    pio->sm[sm].pinctrl = config->pinctrl;
+    pio_sm_clear_fifos(pio, sm);
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr) {
+    uint op = instr & PIO_INSTR_MASK;
+
+    if (op == PIO_INSTR_BITS_OUT || (op == (PIO_INSTR_BITS_PULL & PIO_INSTR_MASK) && (instr & 0x80u))) {
+        pthread_mutex_lock(&fifo_lock);
+        fifo_pop(&sm_fifos(pio, sm)->tx, NULL);
+        pthread_mutex_unlock(&fifo_lock);
+    }
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    sm_fifos_t *f = sm_fifos(pio, sm);
+
+    pthread_mutex_lock(&fifo_lock);
+    f->rx.level = f->rx.head = 0;
+    f->tx.level = f->tx.head = 0;
+    pthread_mutex_unlock(&fifo_lock);
+}
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm) {
+    sm_fifos_t *f = sm_fifos(pio, sm);
+
+    pthread_mutex_lock(&fifo_lock);
+    f->tx.level = f->tx.head = 0;
+    pthread_mutex_unlock(&fifo_lock);
+}
+
+/* The firmware polls these in bare loops without tight_loop_contents, the
+ * state it would wait on yields so the other side gets to run */
+static bool fifo_poll(bool waiting) {
+    if (waiting)
+        tight_loop_contents();
+    return waiting;
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    return fifo_poll(__atomic_load_n(&sm_fifos(pio, sm)->rx.level, __ATOMIC_ACQUIRE) == 0);
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+    return __atomic_load_n(&sm_fifos(pio, sm)->tx.level, __ATOMIC_ACQUIRE) == 0;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+    return fifo_poll(__atomic_load_n(&sm_fifos(pio, sm)->tx.level, __ATOMIC_ACQUIRE) == HOST_PIO_FIFO_DEPTH);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+    uint32_t data = 0;
+
+    pthread_mutex_lock(&fifo_lock);
+    fifo_pop(&sm_fifos(pio, sm)->rx, &data);
+    pthread_mutex_unlock(&fifo_lock);
+    return data;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    pthread_mutex_lock(&fifo_lock);
+    bool pushed = fifo_push(&sm_fifos(pio, sm)->tx, data);
+    pthread_mutex_unlock(&fifo_lock);
+
+    if (pushed && put_cb)
+        put_cb(pio, sm, data);
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+    while (pio_sm_is_tx_fifo_full(pio, sm))
+        tight_loop_contents();
+    pio_sm_put(pio, sm, data);
+}
+
+bool host_pio_rx_push(PIO pio, uint sm, uint32_t data) {
+    pthread_mutex_lock(&fifo_lock);
+    bool pushed = fifo_push(&sm_fifos(pio, sm)->rx, data);
+    pthread_mutex_unlock(&fifo_lock);
+    return pushed;
+}
+
+bool host_pio_tx_pop(PIO pio, uint sm, uint32_t *data) {
+    pthread_mutex_lock(&fifo_lock);
+    bool popped = fifo_pop(&sm_fifos(pio, sm)->tx, data);
+    pthread_mutex_unlock(&fifo_lock);
+    return popped;
+}
+
+uint host_pio_tx_level(PIO pio, uint sm) {
+    return __atomic_load_n(&sm_fifos(pio, sm)->tx.level, __ATOMIC_ACQUIRE);
+}
+
+void host_pio_set_put_cb(host_pio_put_cb_t cb) {
+    put_cb = cb;
+}
@@ -0,0 +1,368 @@
+/* Runs the PS1 card manager and dirty flusher on the host.
+ *
+ *   ps1_check check
+ *       A folder with random images for channels 1 to 3 and none for 4.
+ *       Checks that:
+ *       - open loads the active channel only, ps1_cardman_task then loads
+ *         channels 2 and 3 into slots of their own and leaves 4 alone;
+ *       - switching to a loaded channel does not touch the SD card;
+ *       - pages written through the data interface, consecutive and
+ *         scattered, reach the image of their channel once the flusher ran,
+ *         and the other images stay as they were;
+ *       - PSRAM list transfers move segments that cross pages, skip empty
+ *         ones and call back once.
+ *
+ *   ps1_check bench [rounds]
+ *       Simulated time of a card load, a switch to a loaded channel and
+ *       flushes of consecutive and scattered pages, with the SD latencies of
+ *       sio2_replay. The load and the flushes are also timed the way they
+ *       were done before, one 128 byte read or seek and write per page. */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps1_cardman.h"
+#include "ps1_dirty.h"
+#include "ps1_mc_data_interface.h"
+#include "psram.h"
+#include "sd.h"
+#include "sd_posix.h"
+#include "settings.h"
+
+#include "hardware/timer.h"
+#include "host_clock.h"
+
+#define CHANNELS        3
+#define FOLDER          "MemoryCards/PS1/Card1"
+#define FLUSH_PAGES     64
+
+static uint8_t images[CHANNELS + 1][PS1_CARD_SIZE];
+static int failures;
+
+#define EXPECT(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void fill(uint8_t *buf, size_t count, uint32_t seed) {
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+static void image_path(int chan, char *path, size_t size) {
+    snprintf(path, size, FOLDER "/Card1-%d.mcd", chan);
+}
+
+static bool read_image(int chan, uint8_t *buf) {
+    char path[64];
+    int fd;
+    bool ok;
+
+    image_path(chan, path, sizeof(path));
+    fd = sd_open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    ok = sd_read(fd, buf, PS1_CARD_SIZE) == PS1_CARD_SIZE;
+    sd_close(fd);
+    return ok;
+}
+
+static void write_images(void) {
+    char path[64];
+
+    sd_mkdir("MemoryCards");
+    sd_mkdir("MemoryCards/PS1");
+    sd_mkdir(FOLDER);
+    for (int chan = 1; chan <= CHANNELS; chan++) {
+        int fd;
+
+        fill(images[chan], PS1_CARD_SIZE, chan);
+        image_path(chan, path, sizeof(path));
+        fd = sd_open(path, O_RDWR | O_CREAT | O_TRUNC);
+        if ((fd < 0) || (sd_write(fd, images[chan], PS1_CARD_SIZE) != PS1_CARD_SIZE)) {
+            printf("cannot write %s\n", path);
+            exit(1);
+        }
+        sd_close(fd);
+    }
+}
+
+/* Slot whose PSRAM holds the image, -1 if none does */
+static int slot_of(const uint8_t *image) {
+    static uint8_t buf[PS1_CARD_SIZE];
+
+    for (int slot = 0; slot < PS1_CARD_SLOTS; slot++) {
+        psram_read(slot * PS1_CARD_SIZE, buf, sizeof(buf));
+        if (memcmp(buf, image, sizeof(buf)) == 0)
+            return slot;
+    }
+    return -1;
+}
+
+static void setup(void) {
+    static char root[] = "/tmp/ps1_check.XXXXXX";
+
+    /* settings are written back to the card, keep them out of the cwd */
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    sd_posix_set_root(root);
+    host_clock_set_simulated(true);
+    sd_posix_set_delay_cb(host_clock_advance);
+    settings_init();
+    write_images();
+    psram_init();
+    ps1_dirty_init();
+    ps1_cardman_init();
+}
+
+/* Preloading waits for the console to be quiet for the dirty lockout */
+static void run_preload(void) {
+    host_clock_advance(200 * 1000);
+    for (int i = 0; i < CHANNELS * PS1_CARD_SIZE / 1024; i++)
+        ps1_cardman_task();
+}
+
+/* Console writes of the active channel, the page contents go to image too */
+static void console_write(int page, uint8_t *image, uint32_t seed) {
+    uint8_t buf[PS1_PAGE_SIZE];
+
+    fill(buf, sizeof(buf), seed);
+    ps1_mc_data_interface_commit_write(page, buf);
+    ps1_mc_data_interface_write_mc(page);
+    memcpy(&image[page * PS1_PAGE_SIZE], buf, sizeof(buf));
+}
+
+/* Waits out the lockout and runs the flusher until nothing is left */
+static void flush(void) {
+    host_clock_advance(200 * 1000);
+    do {
+        ps1_dirty_task();
+    } while (ps1_dirty_activity);
+}
+
+static int list_done;
+
+static void on_list_done(void) {
+    list_done++;
+}
+
+static void check_lists(void) {
+    static uint8_t out[8192], in[8192];
+    const psram_segment_t writes[] = {
+        { 1000, out, 100 },
+        { 4096, out + 100, 0 },
+        { 5000, out + 100, 3000 },
+        { 2047, out + 3100, 2 },
+    };
+    const psram_segment_t reads[] = {
+        { 1000, in, 24 },
+        { 1024, in + 24, 76 },
+        { 5000, in + 100, 3002 },
+    };
+
+    fill(out, sizeof(out), 99);
+    memset(in, 0, sizeof(in));
+
+    list_done = 0;
+    psram_write_list_dma(writes, count_of(writes), on_list_done);
+    psram_wait_for_dma();
+    EXPECT(list_done == 1, "write list called back %d times", list_done);
+
+    list_done = 0;
+    psram_read_list_dma(reads, count_of(reads), on_list_done);
+    psram_wait_for_dma();
+    EXPECT(list_done == 1, "read list called back %d times", list_done);
+    EXPECT(memcmp(in, out, 3100) == 0, "list read back differs");
+
+    psram_read(2047, in, 2);
+    EXPECT(memcmp(in, out + 3100, 2) == 0, "segment across the page boundary differs");
+
+    list_done = 0;
+    psram_write_list_dma(&writes[1], 1, on_list_done);
+    EXPECT(list_done == 1, "empty list called back %d times", list_done);
+}
+
+static int check(void) {
+    static uint8_t buf[PS1_CARD_SIZE];
+    sd_posix_stat_t sd;
+    int slot;
+
+    setup();
+    sd_posix_configure(NULL);
+
+    ps1_cardman_open();
+    EXPECT(slot_of(images[1]) >= 0, "channel 1 not loaded");
+    EXPECT(slot_of(images[2]) < 0, "channel 2 loaded by open");
+
+    run_preload();
+    for (int chan = 1; chan <= CHANNELS; chan++)
+        EXPECT(slot_of(images[chan]) >= 0, "channel %d not preloaded", chan);
+    EXPECT(!sd_exists(FOLDER "/Card1-4.mcd"), "preload created channel 4");
+
+    /* channel 1 is written, then channel 2 after the switch */
+    console_write(5, images[1], 1);
+    flush();
+
+    sd_posix_reset_stat();
+    ps1_cardman_next_channel();
+    ps1_cardman_open();
+    sd_posix_get_stat(&sd);
+    /* only the card .ini is opened, to see whether it changed */
+    EXPECT(sd.ops[SD_POSIX_OP_READ] == 0 && sd.ops[SD_POSIX_OP_OPEN] <= 1,
+           "switch to a loaded channel opened %u and read %u times", sd.ops[SD_POSIX_OP_OPEN], sd.ops[SD_POSIX_OP_READ]);
+
+    slot = slot_of(images[2]);
+    for (int page = 0; page < 12; page++)
+        console_write(page, images[2], 100 + page);
+    for (int page = 40; page < PS1_CARD_PAGES; page += 97)
+        console_write(page, images[2], 200 + page);
+    console_write(PS1_CARD_PAGES - 1, images[2], 300);
+    flush();
+
+    EXPECT(ps1_dirty_get_marked() == -1, "dirty pages left after the flush");
+    EXPECT((slot >= 0) && (slot_of(images[2]) == slot), "channel 2 moved or PSRAM differs from the writes");
+    for (int chan = 1; chan <= CHANNELS; chan++)
+        EXPECT(read_image(chan, buf) && (memcmp(buf, images[chan], sizeof(buf)) == 0),
+               "image of channel %d differs after the flush", chan);
+
+    check_lists();
+
+    ps1_cardman_close();
+    ps1_cardman_unload();
+
+    printf("%s, %d failures\n", failures ? "FAILED" : "passed", failures);
+    return failures ? 1 : 0;
+}
+
+/* Rough figures for a class 10 card behind the 25MHz SPI bus, as in
+ * sio2_replay */
+static const sd_posix_config_t sd_typical = {
+    .latency = {
+        [SD_POSIX_OP_OPEN]  = { .min_us = 800, .max_us = 2500 },
+        [SD_POSIX_OP_CLOSE] = { .min_us = 200, .max_us = 600 },
+        [SD_POSIX_OP_READ]  = { .min_us = 250, .max_us = 700, .spike_us = 5000, .spike_permille = 2 },
+        [SD_POSIX_OP_WRITE] = { .min_us = 300, .max_us = 900, .spike_us = 40000, .spike_permille = 10 },
+        [SD_POSIX_OP_SEEK]  = { .min_us = 0, .max_us = 50 },
+        [SD_POSIX_OP_FLUSH] = { .min_us = 500, .max_us = 2000, .spike_us = 40000, .spike_permille = 20 },
+        [SD_POSIX_OP_META]  = { .min_us = 500, .max_us = 3000 },
+    },
+    .read_bytes_per_s = 2500000,
+    .write_bytes_per_s = 1500000,
+    .seed = 1,
+};
+
+/* The load before extents, a read and a PSRAM write per page */
+static void legacy_load(int chan) {
+    static uint8_t buf[PS1_PAGE_SIZE];
+    char path[64];
+    int fd;
+
+    image_path(chan, path, sizeof(path));
+    fd = sd_open(path, O_RDWR);
+    for (int page = 0; page < PS1_CARD_PAGES; page++) {
+        sd_read(fd, buf, sizeof(buf));
+        psram_write_dma(page * PS1_PAGE_SIZE, buf, sizeof(buf), NULL);
+        psram_wait_for_dma();
+    }
+    sd_close(fd);
+}
+
+/* The flush before runs, a seek and a write per dirty page */
+static void legacy_flush(int chan, int first, int step) {
+    static uint8_t buf[PS1_PAGE_SIZE];
+    char path[64];
+    int fd;
+
+    image_path(chan, path, sizeof(path));
+    fd = sd_open(path, O_RDWR);
+    for (int i = 0, page = first; i < FLUSH_PAGES; i++, page += step) {
+        psram_read(page * PS1_PAGE_SIZE, buf, sizeof(buf));
+        sd_seek(fd, page * PS1_PAGE_SIZE, SEEK_SET);
+        sd_write(fd, buf, sizeof(buf));
+    }
+    sd_flush(fd);
+    sd_close(fd);
+}
+
+static uint64_t time_flush(int first, int step) {
+    uint64_t start;
+
+    for (int i = 0, page = first; i < FLUSH_PAGES; i++, page += step)
+        console_write(page, images[1], page);
+    host_clock_advance(200 * 1000);
+    start = time_us_64();
+    do {
+        ps1_dirty_task();
+    } while (ps1_dirty_activity);
+    return time_us_64() - start;
+}
+
+static int bench(int rounds) {
+    uint64_t load = 0, old_load = 0, sw = 0, run = 0, old_run = 0, scatter = 0, old_scatter = 0;
+    uint64_t start;
+
+    setup();
+    sd_posix_configure(&sd_typical);
+
+    for (int round = 0; round < rounds; round++) {
+        start = time_us_64();
+        ps1_cardman_open();
+        load += time_us_64() - start;
+        run_preload();
+
+        start = time_us_64();
+        ps1_cardman_next_channel();
+        ps1_cardman_open();
+        sw += time_us_64() - start;
+        ps1_cardman_prev_channel();
+        ps1_cardman_open();
+
+        run += time_flush(0, 1);
+        scatter += time_flush(1, PS1_CARD_PAGES / FLUSH_PAGES);
+
+        ps1_cardman_unload();
+
+        start = time_us_64();
+        legacy_load(1);
+        old_load += time_us_64() - start;
+
+        start = time_us_64();
+        legacy_flush(1, 0, 1);
+        old_run += time_us_64() - start;
+
+        start = time_us_64();
+        legacy_flush(1, 1, PS1_CARD_PAGES / FLUSH_PAGES);
+        old_scatter += time_us_64() - start;
+    }
+
+    printf("%-28s %10s %10s\n", "simulated ms per round", "now", "per page");
+    printf("%-28s %10.1f %10.1f\n", "card load", load / 1e3 / rounds, old_load / 1e3 / rounds);
+    printf("%-28s %10.1f %10s\n", "switch to loaded channel", sw / 1e3 / rounds, "-");
+    printf("%-28s %10.1f %10.1f\n", "flush 64 consecutive pages", run / 1e3 / rounds, old_run / 1e3 / rounds);
+    printf("%-28s %10.1f %10.1f\n", "flush 64 scattered pages", scatter / 1e3 / rounds, old_scatter / 1e3 / rounds);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if ((argc > 1) && (strcmp(argv[1], "bench") == 0)) {
+        int rounds = (argc > 2) ? atoi(argv[2]) : 4;
+        return bench(rounds > 0 ? rounds : 1);
+    }
+    if ((argc > 1) && (strcmp(argv[1], "check") != 0)) {
+        fprintf(stderr, "usage: %s [check | bench [rounds]]\n", argv[0]);
+        return 1;
+    }
+    return check();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+/* Stand-in for the header pioasm generates from ps1_mc_spi.pio. The state
+ * check only drives mc_do_state, the programs are never started */
+
+#include "hardware/pio.h"
+
+#define PIN_PSX_ACK 16
+#define PIN_PSX_SEL 17
+#define PIN_PSX_CLK 18
+#define PIN_PSX_CMD 19
+#define PIN_PSX_DAT 20
+
+static const uint16_t ps1_state_check_program_instructions[] = { 0x0000 };
+
+static const struct pio_program cmd_reader_program = {
+    .instructions = ps1_state_check_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static const struct pio_program dat_writer_program = {
+    .instructions = ps1_state_check_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static inline void cmd_reader_program_init(PIO pio, uint sm, uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+static inline void dat_writer_program_init(PIO pio, uint sm, uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+
+    pio_sm_init(pio, sm, offset, &c);
+}
@@ -0,0 +1,225 @@
+/* Checks mc_do_state of ps1_memory_card.c against the one it replaced.
+ *
+ *   ps1_state_check [frames] [seed]
+ *
+ * Both state machines get the same generated frames byte by byte: status,
+ * reads, writes with good and broken checksums, Memcard Pro pings, game IDs
+ * and channel and card switches, unknown commands and frames for other
+ * devices, some of them cut short or running on past their end. The
+ * responses have to match after every byte. The pages read, written and
+ * marked dirty, the flag, the ODE command and the game ID have to match
+ * after every frame.
+ *
+ * The data interface is faked, page reads come from a set of random pages.
+ * There is no recorded PS1 traffic in the tree, the frames are generated
+ * from what each command accepts. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps1_state_check.h"
+
+/* mc_do_state and its state are static */
+#include "ps1/ps1_memory_card.c"
+
+#define NUM_PAGES       64
+#define MAX_EVENTS      8
+#define MAX_FRAME       264
+
+enum { SIDE_NEW = 0, SIDE_OLD };
+enum { EV_READ = 1, EV_COMMIT, EV_DIRTY };
+
+typedef struct {
+    int type;
+    uint32_t page;
+    uint32_t sum;
+} event_t;
+
+static uint8_t pages[NUM_PAGES][PS1_PAGE_SIZE];
+static event_t events[2][MAX_EVENTS];
+static int num_events[2];
+static int side;
+
+static void log_event(int type, uint32_t page, uint32_t sum) {
+    if (num_events[side] < MAX_EVENTS)
+        events[side][num_events[side]] = (event_t){ type, page, sum };
+    num_events[side]++;
+}
+
+/* Data interface */
+
+void ps1_mc_data_interface_setup_read_page(uint32_t page) {
+    log_event(EV_READ, page, 0);
+}
+
+uint8_t *ps1_mc_data_interface_get_page(uint32_t page) {
+    return pages[page % NUM_PAGES];
+}
+
+void ps1_mc_data_interface_wait_for_byte(uint32_t offset) {
+    (void)offset;
+}
+
+void ps1_mc_data_interface_commit_write(uint32_t page, uint8_t *buf) {
+    uint32_t sum = 2166136261u;
+
+    for (size_t i = 0; i < PS1_PAGE_SIZE; i++)
+        sum = (sum ^ buf[i]) * 16777619u;
+    log_event(EV_COMMIT, page, sum);
+}
+
+void ps1_mc_data_interface_write_mc(uint32_t page) {
+    log_event(EV_DIRTY, page, 0);
+}
+
+/* Frames */
+
+static const char *const game_ids[] = {
+    "SLUS_012.34;1", "SCES_000.01", "SLPS-12345", "cdrom:\\SLES_123.45;1", "PAPX_900.10", "BOOT", "",
+};
+
+static size_t make_frame(uint8_t *frame) {
+    static const uint8_t cmds[] = { 'S', 'R', 'W', 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x42, 0x00 };
+    uint8_t cmd = cmds[rand() % count_of(cmds)];
+    size_t len;
+
+    for (size_t i = 0; i < MAX_FRAME; i++)
+        frame[i] = (rand() % 4) ? 0x00 : rand();
+    frame[0] = (rand() % 16) ? 0x81 : 0x01;
+    frame[1] = cmd;
+
+    switch (cmd) {
+        case 'S':
+            len = 10;
+            break;
+        case 'R':
+            len = 140;
+            frame[4] = (rand() % 8) ? rand() % 4 : rand();
+            frame[5] = rand();
+            break;
+        case 'W': {
+            uint8_t chk;
+
+            len = 138;
+            frame[4] = (rand() % 8) ? rand() % 4 : rand();
+            frame[5] = rand();
+            chk = frame[4] ^ frame[5];
+            for (size_t i = 6; i < 6 + PS1_PAGE_SIZE; i++) {
+                frame[i] = rand();
+                chk ^= frame[i];
+            }
+            frame[134] = (rand() % 4) ? chk : (uint8_t)(chk ^ (1 + rand() % 255));
+            break;
+        }
+        case 0x21: {
+            const char *id = game_ids[rand() % count_of(game_ids)];
+            size_t id_len = strlen(id);
+
+            if (rand() % 4 == 0)
+                id_len = rand() % 256;
+            else
+                memcpy(&frame[4], id, id_len);
+            frame[3] = id_len;
+            len = 4 + id_len;
+            break;
+        }
+        default:
+            len = 6;
+            break;
+    }
+
+    if (rand() % 8 == 0)
+        len = rand() % len + 1;
+    else if (rand() % 8 == 0)
+        len += rand() % 8;
+    if (len > MAX_FRAME)
+        len = MAX_FRAME;
+
+    return len;
+}
+
+static void print_frame(const uint8_t *frame, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        printf("%02x%s", frame[i], (i + 1 < len) ? " " : "\n");
+}
+
+static void new_state_get(ps1_state_t *state) {
+    state->flag = flag;
+    state->mc_pro_command = mc_pro_command;
+    memcpy(state->game_id, received_game_id, sizeof(state->game_id));
+    state->reading = curr_page != NULL;
+}
+
+/* Runs a frame through both, false if they differ */
+static bool run_frame(const uint8_t *frame, size_t len) {
+    ps1_state_t new_state, old_state;
+
+    num_events[SIDE_NEW] = num_events[SIDE_OLD] = 0;
+    byte_count = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        int new_resp, old_resp;
+
+        side = SIDE_NEW;
+        new_resp = mc_do_state(frame[i]);
+        side = SIDE_OLD;
+        old_resp = legacy_state_byte(frame[i], i == 0);
+
+        if (new_resp != old_resp) {
+            printf("byte %zu answered %d, expected %d: ", i, new_resp, old_resp);
+            print_frame(frame, len);
+            return false;
+        }
+        /* mc_main_loop ignores the rest of the frame */
+        if (new_resp == -1)
+            break;
+    }
+
+    new_state_get(&new_state);
+    legacy_state_get(&old_state);
+    if ((num_events[SIDE_NEW] != num_events[SIDE_OLD])
+        || (memcmp(events[SIDE_NEW], events[SIDE_OLD], sizeof(event_t) * (num_events[SIDE_NEW] < MAX_EVENTS ? num_events[SIDE_NEW] : MAX_EVENTS)) != 0)) {
+        printf("data interface calls differ: ");
+        print_frame(frame, len);
+        return false;
+    }
+    if (memcmp(&new_state, &old_state, sizeof(new_state)) != 0) {
+        printf("state differs, flag %u/%u, ODE command %u/%u, game ID \"%s\"/\"%s\": ", new_state.flag, old_state.flag,
+               new_state.mc_pro_command, old_state.mc_pro_command, new_state.game_id, old_state.game_id);
+        print_frame(frame, len);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    unsigned long frames = (argc > 1) ? strtoul(argv[1], NULL, 0) : 200000;
+    unsigned long mismatches = 0, run;
+    uint8_t frame[MAX_FRAME];
+
+    srand((argc > 2) ? strtoul(argv[2], NULL, 0) : 1);
+    for (size_t i = 0; i < NUM_PAGES; i++)
+        for (size_t j = 0; j < PS1_PAGE_SIZE; j++)
+            pages[i][j] = rand();
+
+    /* as mc_main_loop starts */
+    flag = 8;
+    legacy_state_reset();
+
+    for (run = 0; run < frames;) {
+        size_t len = make_frame(frame);
+
+        run++;
+        if (!run_frame(frame, len) && (++mismatches >= 10)) {
+            printf("giving up after %lu mismatches\n", mismatches);
+            break;
+        }
+    }
+
+    printf("%lu frames, %lu mismatches\n", run, mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* What a frame leaves behind besides its responses */
+typedef struct {
+    uint8_t flag;
+    uint8_t mc_pro_command;
+    char game_id[0x10];
+    bool reading;
+} ps1_state_t;
+
+/* The state machine before the step tables, see ps1_state_legacy.c */
+void legacy_state_reset(void);
+int legacy_state_byte(uint8_t ch, bool first);
+void legacy_state_get(ps1_state_t *state);
@@ -0,0 +1,207 @@
+/* mc_do_state of ps1_memory_card.c before the step tables, the reference
+ * for ps1_state_check. The body is unchanged except for the game ID, which
+ * is only matched from the first byte of the ID on, as the tables do */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "game_db/game_db.h"
+#include "ps1/ps1_memory_card.h"
+#include "ps1_mc_data_interface.h"
+#include "ps1_state_check.h"
+
+static size_t byte_count;
+static uint8_t flag;
+static uint8_t* curr_page = NULL;
+
+static size_t game_id_length;
+static char received_game_id[0x10];
+static uint8_t mc_pro_command;
+
+static int mc_do_state(uint8_t ch) {
+    static uint8_t payload[256];
+    if (byte_count >= sizeof(payload))
+        return -1;
+    payload[byte_count++] = ch;
+
+    if (byte_count == 1) {
+        /* First byte - determine the device the command is for */
+        if (ch == 0x81)
+            return flag;
+    } else if (payload[0] == 0x81) {
+        /* Command for the memory card */
+        uint8_t cmd = payload[1];
+
+        if (cmd == 'S') {
+            /* Memory card status */
+            switch (byte_count) {
+                case 2: return 0x5A;
+                case 3: return 0x5D;
+                case 4: return 0x5C;
+                case 5: return 0x5D;
+                case 6: return 0x04;
+                case 7: return 0x00;
+                case 8: return 0x00;
+                case 9: return 0x80;
+            }
+        } else if (cmd == 'R') {
+            /* Memory card read */
+            #define MSB (payload[4])
+            #define LSB (payload[5])
+            #define PAGE (MSB * 256 + LSB)
+            #define ADDR (PAGE * 128)
+            #define OFF (byte_count - 10)
+
+            static uint8_t chk;
+
+            switch (byte_count) {
+                case 2: return 0x5A;
+                case 3: return 0x5D;
+                case 4: return 0x00;
+                case 5: return MSB;
+                case 6: return 0x5C;
+                case 7: return 0x5D;
+                case 8: return MSB;
+                case 9:
+                    chk = MSB ^ LSB;
+                    ps1_mc_data_interface_setup_read_page(PAGE);
+                    return LSB;
+                case 10 ... 137: {
+                    ps1_mc_data_interface_wait_for_byte(OFF);
+                    curr_page = ps1_mc_data_interface_get_page(PAGE);
+                    chk ^= curr_page[OFF];
+                    return curr_page[OFF];
+                }
+                case 138: return chk;
+                case 139: {
+                    curr_page = NULL;
+                    QPRINTF("Done Reading sector %u\n", PAGE);
+                    return 0x47;
+                }
+            }
+
+            #undef MSB
+            #undef LSB
+            #undef ADDR
+            #undef OFF
+            #undef PAGE
+        } else if (cmd == 'W') {
+            /* Memory card write */
+            #define MSB (payload[4])
+            #define LSB (payload[5])
+            #define PAGE (MSB * 256 + LSB)
+            #define OFF (byte_count - 7)
+
+            static uint8_t chk;
+            static uint8_t buf[PS1_PAGE_SIZE];
+
+            switch (byte_count) {
+                case 2: flag = 0; return 0x5A;
+                case 3: return 0x5D;
+                case 4: return 0x00;
+                case 5: return MSB;
+                case 6: return LSB;
+                case 7: chk = MSB ^ LSB; // fallthrough
+                case 8 ... 134: {
+                    buf[OFF] = payload[byte_count - 1];
+                    chk ^= payload[byte_count - 1];
+                    return payload[byte_count - 1];
+                }
+                case 135: return 0x5C;
+                case 136: return 0x5D;
+                case 137: {
+                    if (chk == payload[byte_count - 3]) {
+                        ps1_mc_data_interface_commit_write(PAGE, buf);
+                        ps1_mc_data_interface_write_mc(PAGE);
+                        return 0x47;
+                    } else
+                        return 0x4E;
+                }
+            }
+
+            #undef MSB
+            #undef LSB
+            #undef OFF
+        }
+        // Memcard Pro Commands after this line
+        // See https://gitlab.com/chriz2600/ps1-game-id-transmission
+        else if (cmd == 0x20) {   // MCP Ping Command
+            switch (byte_count) {
+                case 2:
+                case 3: return 0x00;
+                case 4: return 0x27;
+                case 5: return 0xFF;
+            }
+        } else if (cmd == 0x21) { // MCP Game ID
+            if ((byte_count >= 5) && (byte_count == game_id_length + 4))
+            {
+                game_db_extract_title_id(&payload[4], received_game_id, game_id_length, sizeof(received_game_id));
+                if (!game_db_sanity_check_title_id(received_game_id))
+                    memset(received_game_id, 0, sizeof(received_game_id));
+                mc_pro_command = MCP_GAME_ID;
+            }
+            switch (byte_count) {
+                case 2: memset(received_game_id, 0, sizeof(received_game_id)); return 0x00;
+                case 3: return 0x00;
+                case 4: game_id_length = payload[byte_count - 1]; return 0x00;
+                case 5 ... 255: return payload[byte_count - 1];
+            }
+        } else if (cmd == 0x22) { // MCP Prv Channel
+            switch (byte_count) {
+                case 2:
+                case 3: return 0x00;
+                case 4: return 0x20;
+                case 5: mc_pro_command = MCP_PRV_CH; return 0xFF;
+            }
+        } else if (cmd == 0x23) { // MCP Nxt Channel
+            switch (byte_count) {
+                case 2:
+                case 3: return 0x00;
+                case 4: return 0x20;
+                case 5: mc_pro_command = MCP_NXT_CH; return 0xFF;
+            }
+        } else if (cmd == 0x24) { // MCP Prv Card
+
+            switch (byte_count) {
+                case 2:
+                case 3: return 0x00;
+                case 4: return 0x20;
+                case 5: mc_pro_command = MCP_PRV_CARD; return 0xFF;
+            }
+        } else if (cmd == 0x25) { // MCP Nxt Card
+
+            switch (byte_count) {
+                case 2:
+                case 3: return 0x00;
+                case 4: return 0x20;
+                case 5: mc_pro_command = MCP_NXT_CARD; return 0xFF;
+            }
+        } else {
+            DPRINTF("Received unknown command: %u\n", ch);
+        }
+    }
+
+    return -1;
+}
+
+void legacy_state_reset(void) {
+    byte_count = 0;
+    flag = 8;
+    game_id_length = 0;
+    memset(received_game_id, 0, sizeof(received_game_id));
+    mc_pro_command = 0;
+}
+
+int legacy_state_byte(uint8_t ch, bool first) {
+    if (first)
+        byte_count = 0;
+    return mc_do_state(ch);
+}
+
+void legacy_state_get(ps1_state_t *state) {
+    state->flag = flag;
+    state->mc_pro_command = mc_pro_command;
+    memcpy(state->game_id, received_game_id, sizeof(state->game_id));
+    state->reading = curr_page != NULL;
+}
@@ -0,0 +1,80 @@
+#include "psram.h"
+
+#include <string.h>
+
+#include "pico/platform.h"
+
+/* 8MB part as fitted to the boards. Transfers complete before returning,
+ * so completion callbacks run in the caller's context */
+#define PSRAM_SIZE (8 * 1024 * 1024)
+
+static uint8_t psram[PSRAM_SIZE];
+
+static bool psram_range_ok(uint32_t addr, size_t sz) {
+    if ((uint64_t)addr + sz > PSRAM_SIZE)
+        panic("PSRAM access out of range: 0x%08x + %zu", addr, sz);
+    return true;
+}
+
+/* Single transfers would wrap within a page on the real part */
+static void psram_page_ok(uint32_t addr, size_t sz) {
+    if (sz > PSRAM_PAGE_SIZE - addr % PSRAM_PAGE_SIZE)
+        panic("PSRAM transfer crosses a page: 0x%08x + %zu", addr, sz);
+}
+
+static void psram_store(uint32_t addr, const void *buf, size_t sz) {
+    psram_range_ok(addr, sz);
+    memcpy(&psram[addr], buf, sz);
+}
+
+void psram_init(void) {
+    memset(psram, 0, sizeof(psram));
+}
+
+void psram_read(uint32_t addr, void *buf, size_t sz) {
+    psram_range_ok(addr, sz);
+    memcpy(buf, &psram[addr], sz);
+}
+
+void psram_write(uint32_t addr, void *buf, size_t sz) {
+    psram_page_ok(addr, sz);
+    psram_store(addr, buf, sz);
+}
+
+void psram_read_dma(uint32_t addr, void *buf, size_t sz, void (*cb)(void)) {
+    psram_page_ok(addr, sz);
+    psram_read(addr, buf, sz);
+    if (cb)
+        cb();
+}
+
+void psram_write_dma(uint32_t addr, void *buf, size_t sz, void (*cb)(void)) {
+    psram_write(addr, buf, sz);
+    if (cb)
+        cb();
+}
+
+void psram_read_list_dma(const psram_segment_t *segs, size_t count, void (*cb)(void)) {
+    for (size_t i = 0; i < count; i++)
+        psram_read(segs[i].addr, segs[i].buf, segs[i].sz);
+    if (cb)
+        cb();
+}
+
+void psram_write_list_dma(const psram_segment_t *segs, size_t count, void (*cb)(void)) {
+    for (size_t i = 0; i < count; i++)
+        psram_store(segs[i].addr, segs[i].buf, segs[i].sz);
+    if (cb)
+        cb();
+}
+
+uint32_t psram_write_dma_remaining() {
+    return 0;
+}
+
+uint32_t psram_read_dma_remaining() {
+    return 0;
+}
+
+void psram_wait_for_dma() {
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+/* Stand-in for the header pioasm generates from ps2_mc_spi.pio. The
+ * programs don't run on the host, their init functions hand the state
+ * machines over to the replay tool instead */
+
+#include "hardware/pio.h"
+
+#define PIN_PSX_ACK 16
+#define PIN_PSX_SEL 17
+#define PIN_PSX_CLK 18
+#define PIN_PSX_CMD 19
+#define PIN_PSX_DAT 20
+
+enum {
+    SIO2_REPLAY_CMD_READER = 0,
+    SIO2_REPLAY_DAT_WRITER,
+    SIO2_REPLAY_CLOCK_PROBE,
+};
+
+void sio2_replay_attach(int role, PIO pio, uint sm);
+
+static const uint16_t sio2_replay_program_instructions[] = { 0x0000 };
+
+static const struct pio_program cmd_reader_program = {
+    .instructions = sio2_replay_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static const struct pio_program dat_writer_program = {
+    .instructions = sio2_replay_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static const struct pio_program clock_probe_program = {
+    .instructions = sio2_replay_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static inline void cmd_reader_program_init(PIO pio, uint sm, uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+
+    sm_config_set_in_shift(&c, true, true, 8);
+    pio_sm_init(pio, sm, offset, &c);
+    sio2_replay_attach(SIO2_REPLAY_CMD_READER, pio, sm);
+}
+
+static inline void dat_writer_program_init(PIO pio, uint sm, uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+
+    sm_config_set_out_shift(&c, true, true, 8);
+    pio_sm_init(pio, sm, offset, &c);
+    sio2_replay_attach(SIO2_REPLAY_DAT_WRITER, pio, sm);
+}
+
+static inline void clock_probe_program_init(PIO pio, uint sm, uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+
+    sm_config_set_in_shift(&c, true, true, 1);
+    pio_sm_init(pio, sm, offset, &c);
+    sio2_replay_attach(SIO2_REPLAY_CLOCK_PROBE, pio, sm);
+}
@@ -0,0 +1,681 @@
+/* Replays SIO2 traffic against the PS2 card emulation on the host.
+ *
+ * Core 1 runs the real ps2_memory_card.c loop and command handlers, the PIO
+ * FIFOs are fed from a trace and the main thread plays both the console and
+ * core 0. Time is simulated: the bus charges byte_us per byte, firmware
+ * sleeps and SD latencies of the POSIX backend advance the clock, pure
+ * computation is free unless --cpu-scale is given.
+ *
+ * Trace format, one frame per line:
+ *   # comment
+ *   [+<idle us>] <hex bytes>     raw frame, e.g. "81 26 00 00 00 00 00 00 00 00 00 00 00"
+ *   idle <us>                    bus idle, core 0 keeps running
+ *   read <page> [count]          mcman style page reads (set address, 4x128 data, 16 ecc)
+ *   write <page> [count]         page writes, erasing each block before its first page
+ *   erase <page> [count]         erase of the blocks starting at page
+ *   specs                        GET_SPECS
+ *
+ * A frame ends by deasserting SEL. The console waits for each ACK before it
+ * clocks the next byte, so the interval between two responses is what gets
+ * checked against the PS2_MAX_ACK_DELAY_* budget of the command. */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "card_emu/ps2_mc_commands.h"
+#include "card_emu/ps2_mc_data_interface.h"
+#include "card_emu/ps2_memory_card.h"
+#include "history_tracker/ps2_history_tracker.h"
+#include "mmceman/ps2_mmceman.h"
+#include "mmceman/ps2_mmceman_fs.h"
+#include "ps2_cardman.h"
+#include "ps2_mc_spi.pio.h"
+#include "psram.h"
+#include "des.h"
+#include "sd.h"
+#include "sd_posix.h"
+#include "settings.h"
+
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "host_clock.h"
+#include "host_irq.h"
+#include "host_pio.h"
+#include "pico/multicore.h"
+
+#define MAX_FRAME           1024
+/* Handlers bail out without an ACK only right after the identifier or the
+ * sub command, past that a missing ACK means the firmware is stuck */
+#define NO_ACK_QUIET_NS     (50ull * 1000 * 1000)
+#define STUCK_QUIET_NS      (5000ull * 1000 * 1000)
+#define MMCE_CMD_IDENTIFIER 0x8B
+
+#define ERASE_BLOCK_PAGES   16
+
+/* keystore.c needs flash, the replay runs without a CIV and with MagicGate on */
+uint8_t ps2_civ[8];
+int ps2_magicgate = 1;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t no_ack;
+    uint32_t misses;
+    uint32_t max_gap_us;
+    uint64_t total_us;
+    uint64_t di_us;
+    uint64_t sd_us;
+    uint64_t des_cpu_us;
+} cmd_stat_t;
+
+/* 0x81 sub commands, then MMCE sub commands, then everything else */
+#define STAT_PS2    0x000
+#define STAT_MMCE   0x100
+#define STAT_OTHER  0x200
+static cmd_stat_t stats[STAT_OTHER + 1];
+
+static struct {
+    uint32_t byte_us;
+    uint32_t cpu_scale;
+    bool verbose;
+    FILE *csv;
+} opt = {
+    .byte_us = 4,
+};
+
+static PIO sio2_pio;
+static uint cmd_sm, dat_sm;
+
+/* Written by core 1 */
+static volatile uint32_t resp_count;
+static volatile uint64_t resp_time;
+
+/* Attribution, only core 1 time is accounted */
+static volatile uint64_t di_us, des_cpu_ns;
+
+static uint32_t frame_idx;
+
+void sio2_replay_attach(int role, PIO pio, uint sm) {
+    sio2_pio = pio;
+    if (role == SIO2_REPLAY_CMD_READER)
+        cmd_sm = sm;
+    else if (role == SIO2_REPLAY_DAT_WRITER)
+        dat_sm = sm;
+}
+
+static void on_put(PIO pio, uint sm, uint32_t data) {
+    if (pio != sio2_pio || sm != dat_sm)
+        return;
+    (void)data;
+    resp_time = time_us_64();
+    __atomic_add_fetch(&resp_count, 1, __ATOMIC_SEQ_CST);
+}
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Linked with --wrap, see CMakeLists.txt */
+
+#define WRAP_DI(ret, name, args, call)          \
+    ret __real_##name args;                     \
+    ret __wrap_##name args {                    \
+        uint64_t start = time_us_64();          \
+        ret r = __real_##name call;             \
+        if (get_core_num() == 1)                \
+            di_us += time_us_64() - start;      \
+        return r;                               \
+    }
+
+#define WRAP_DI_VOID(name, args, call)          \
+    void __real_##name args;                    \
+    void __wrap_##name args {                   \
+        uint64_t start = time_us_64();          \
+        __real_##name call;                     \
+        if (get_core_num() == 1)                \
+            di_us += time_us_64() - start;      \
+    }
+
+WRAP_DI_VOID(ps2_mc_data_interface_setup_read_page, (uint32_t page, bool readahead, bool wait), (page, readahead, wait))
+WRAP_DI(volatile ps2_mcdi_page_t *, ps2_mc_data_interface_get_page, (uint32_t page), (page))
+WRAP_DI_VOID(ps2_mc_data_interface_wait_for_byte, (uint32_t offset), (offset))
+WRAP_DI_VOID(ps2_mc_data_interface_write_mc, (uint32_t page, void *buf), (page, buf))
+WRAP_DI_VOID(ps2_mc_data_interface_erase, (uint32_t page), (page))
+
+static void des_account(uint64_t start) {
+    uint64_t ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - start;
+
+    des_cpu_ns += ns;
+    if (opt.cpu_scale)
+        host_clock_advance(ns * opt.cpu_scale / 1000);
+}
+
+void __real_desEncryptBlock(DesContext *context, const uint8_t *input, uint8_t *output);
+void __wrap_desEncryptBlock(DesContext *context, const uint8_t *input, uint8_t *output) {
+    uint64_t start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    __real_desEncryptBlock(context, input, output);
+    des_account(start);
+}
+
+void __real_desDecryptBlock(DesContext *context, const uint8_t *input, uint8_t *output);
+void __wrap_desDecryptBlock(DesContext *context, const uint8_t *input, uint8_t *output) {
+    uint64_t start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    __real_desDecryptBlock(context, input, output);
+    des_account(start);
+}
+
+/* What ps2_task does, minus the UI */
+static void core0_task(void) {
+    ps2_mmceman_task();
+    ps2_cardman_task();
+    ps2_mmceman_fs_run();
+
+    if (ps2_cardman_is_accessible()) {
+        ps2_history_tracker_task();
+        ps2_mc_data_interface_task();
+    }
+}
+
+static void run_idle(uint64_t us) {
+    uint64_t target = time_us_64() + us;
+
+    while (time_us_64() < target) {
+        uint64_t before = time_us_64();
+        core0_task();
+        if (time_us_64() == before)
+            host_clock_advance(MIN(100, target - before));
+    }
+}
+
+static uint32_t sd_op_count(void) {
+    sd_posix_stat_t sd;
+    uint32_t count = 0;
+
+    sd_posix_get_stat(&sd);
+    for (int op = 0; op < SD_POSIX_OP_COUNT; op++)
+        count += sd.ops[op];
+    return count;
+}
+
+/* Waits for the ACK of the last byte. Core 1 has settled without one once
+ * neither the clock nor the SD card moved for quiet_ns of host time */
+static bool wait_response(uint32_t expected, uint64_t quiet_ns) {
+    uint64_t last_clock = time_us_64();
+    uint32_t last_ops = sd_op_count();
+    uint64_t quiet_since = clock_ns(CLOCK_MONOTONIC);
+
+    while (__atomic_load_n(&resp_count, __ATOMIC_SEQ_CST) == expected) {
+        core0_task();
+        sched_yield();
+
+        uint64_t now = time_us_64();
+        uint32_t ops = sd_op_count();
+        if (now != last_clock || ops != last_ops) {
+            last_clock = now;
+            last_ops = ops;
+            quiet_since = clock_ns(CLOCK_MONOTONIC);
+        } else if (clock_ns(CLOCK_MONOTONIC) - quiet_since > quiet_ns) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char *cmd_name(int key) {
+    static char buf[16];
+
+    switch (key) {
+        case STAT_PS2 | PS2_SIO2_CMD_0x11: return "0x11";
+        case STAT_PS2 | PS2_SIO2_CMD_0x12: return "0x12";
+        case STAT_PS2 | PS2_SIO2_CMD_SET_ERASE_ADDRESS: return "set_erase_addr";
+        case STAT_PS2 | PS2_SIO2_CMD_SET_WRITE_ADDRESS: return "set_write_addr";
+        case STAT_PS2 | PS2_SIO2_CMD_SET_READ_ADDRESS: return "set_read_addr";
+        case STAT_PS2 | PS2_SIO2_CMD_GET_SPECS: return "get_specs";
+        case STAT_PS2 | PS2_SIO2_CMD_SET_TERMINATOR: return "set_term";
+        case STAT_PS2 | PS2_SIO2_CMD_GET_TERMINATOR: return "get_term";
+        case STAT_PS2 | PS2_SIO2_CMD_WRITE_DATA: return "write_data";
+        case STAT_PS2 | PS2_SIO2_CMD_READ_DATA: return "read_data";
+        case STAT_PS2 | PS2_SIO2_CMD_COMMIT_DATA: return "commit";
+        case STAT_PS2 | PS2_SIO2_CMD_ERASE: return "erase";
+        case STAT_PS2 | PS2_SIO2_CMD_BF: return "0xbf";
+        case STAT_PS2 | PS2_SIO2_CMD_AUTH_RESET: return "auth_reset";
+        case STAT_PS2 | PS2_SIO2_CMD_KEY_SELECT: return "key_select";
+        case STAT_PS2 | PS2_SIO2_CMD_AUTH: return "auth";
+        case STAT_PS2 | PS2_SIO2_CMD_SESSION_KEY_0: return "session_key_0";
+        case STAT_PS2 | PS2_SIO2_CMD_SESSION_KEY_1: return "session_key_1";
+        case STAT_OTHER: return "other";
+        default: break;
+    }
+    snprintf(buf, sizeof(buf), "%s_0x%02x", key >= STAT_MMCE ? "mmce" : "ps2", key & 0xFF);
+    return buf;
+}
+
+/* Budgets as paced by delayed_response, 0 where the handlers don't pace */
+static uint32_t cmd_budget(int key) {
+    switch (key) {
+        case STAT_PS2 | PS2_SIO2_CMD_SET_ERASE_ADDRESS:
+        case STAT_PS2 | PS2_SIO2_CMD_COMMIT_DATA:
+        case STAT_PS2 | PS2_SIO2_CMD_ERASE:
+            return PS2_MAX_ACK_DELAY_LONG;
+        case STAT_PS2 | PS2_SIO2_CMD_SET_WRITE_ADDRESS:
+        case STAT_PS2 | PS2_SIO2_CMD_WRITE_DATA:
+        case STAT_PS2 | PS2_SIO2_CMD_READ_DATA:
+            return PS2_MAX_ACK_DELAY_MID;
+        case STAT_PS2 | PS2_SIO2_CMD_SET_READ_ADDRESS:
+            return PS2_MAX_ACK_DELAY_SHORT;
+        default:
+            return 0;
+    }
+}
+
+static void print_bytes(const char *prefix, const uint8_t *buf, size_t len) {
+    printf("%s", prefix);
+    for (size_t i = 0; i < len; i++)
+        printf(" %02x", buf[i]);
+    printf("\n");
+}
+
+static void replay_frame(const uint8_t *tx, size_t len) {
+    uint8_t rx[MAX_FRAME];
+    sd_posix_stat_t sd_before, sd_after;
+    uint64_t prev_resp = 0;
+    uint32_t max_gap = 0, misses = 0;
+    size_t acked = 0;
+    bool no_ack = false;
+
+    if (len == 0)
+        return;
+
+    int key = STAT_OTHER;
+    if (len > 1 && tx[0] == PS2_SIO2_CMD_IDENTIFIER)
+        key = STAT_PS2 | tx[1];
+    else if (len > 1 && tx[0] == MMCE_CMD_IDENTIFIER)
+        key = STAT_MMCE | tx[1];
+    uint32_t budget = cmd_budget(key);
+
+    sd_posix_get_stat(&sd_before);
+    uint64_t di_before = di_us, des_before = des_cpu_ns;
+    uint64_t start = time_us_64();
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t out;
+        uint32_t expected = resp_count;
+
+        /* the byte queued for this slot goes out while the command byte comes in */
+        host_clock_advance(opt.byte_us);
+        rx[i] = host_pio_tx_pop(sio2_pio, dat_sm, &out) ? (uint8_t)out : 0xFF;
+        host_pio_rx_push(sio2_pio, cmd_sm, (uint32_t)tx[i] << 24);
+        acked = i + 1;
+
+        /* ACK of the previous byte to ACK of this one, the last byte has none */
+        if (i + 1 < len) {
+            if (!wait_response(expected, i < 2 ? NO_ACK_QUIET_NS : STUCK_QUIET_NS)) {
+                if (i >= 2)
+                    fprintf(stderr, "frame %u: firmware stuck after byte %zu\n", frame_idx, i);
+                no_ack = true;
+                break;
+            }
+            uint64_t now = resp_time;
+            if (prev_resp) {
+                uint32_t gap = (uint32_t)(now - prev_resp);
+                if (gap > max_gap)
+                    max_gap = gap;
+                if (budget && gap > budget)
+                    misses++;
+            }
+            prev_resp = now;
+        }
+    }
+
+    host_gpio_event(PIN_PSX_SEL, GPIO_IRQ_EDGE_RISE);
+
+    uint64_t dur = time_us_64() - start;
+    sd_posix_get_stat(&sd_after);
+    uint64_t sd_us = 0;
+    for (int op = 0; op < SD_POSIX_OP_COUNT; op++)
+        sd_us += sd_after.delay_us[op] - sd_before.delay_us[op];
+    uint64_t frame_di = di_us - di_before;
+    uint64_t frame_des = (des_cpu_ns - des_before) / 1000;
+
+    cmd_stat_t *s = &stats[key];
+    s->frames++;
+    s->bytes += acked;
+    s->no_ack += no_ack;
+    s->misses += misses;
+    s->max_gap_us = MAX(s->max_gap_us, max_gap);
+    s->total_us += dur;
+    s->di_us += frame_di;
+    s->sd_us += sd_us;
+    s->des_cpu_us += frame_des;
+
+    if (opt.verbose) {
+        print_bytes(">", tx, len);
+        print_bytes("<", rx, acked);
+        if (no_ack)
+            printf("  no ACK after byte %zu\n", acked);
+    }
+
+    if (opt.csv)
+        fprintf(opt.csv, "%u,%s,%zu,%" PRIu64 ",%" PRIu64 ",%u,%u,%u,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                frame_idx, cmd_name(key), acked, start, dur, max_gap, budget, misses, no_ack,
+                frame_di, sd_us, frame_des);
+    frame_idx++;
+}
+
+/* Synthetic traffic, laid out the way the handlers in ps2_mc_commands.c
+ * consume it: one byte per receive plus the one clocking out the last
+ * response */
+
+static void frame_set_address(uint8_t sub, uint32_t page) {
+    uint8_t f[9] = { PS2_SIO2_CMD_IDENTIFIER, sub, page & 0xFF, (page >> 8) & 0xFF, (page >> 16) & 0xFF, (page >> 24) & 0xFF };
+
+    f[6] = f[2] ^ f[3] ^ f[4] ^ f[5];
+    replay_frame(f, sizeof(f));
+}
+
+static void frame_simple(uint8_t sub) {
+    uint8_t f[4] = { PS2_SIO2_CMD_IDENTIFIER, sub };
+
+    replay_frame(f, sizeof(f));
+}
+
+static void frame_read_data(uint8_t sz) {
+    uint8_t f[MAX_FRAME] = { PS2_SIO2_CMD_IDENTIFIER, PS2_SIO2_CMD_READ_DATA, sz };
+
+    replay_frame(f, sz + 6);
+}
+
+static void frame_write_data(const uint8_t *data, uint8_t sz) {
+    uint8_t f[MAX_FRAME] = { PS2_SIO2_CMD_IDENTIFIER, PS2_SIO2_CMD_WRITE_DATA, sz };
+    uint8_t ck = 0;
+
+    for (int i = 0; i < sz; i++) {
+        f[3 + i] = data[i];
+        ck ^= data[i];
+    }
+    f[3 + sz] = ck;
+    replay_frame(f, sz + 6);
+}
+
+static void gen_read(uint32_t page, uint32_t count) {
+    for (uint32_t p = page; p < page + count; p++) {
+        frame_set_address(PS2_SIO2_CMD_SET_READ_ADDRESS, p);
+        for (int i = 0; i < 4; i++)
+            frame_read_data(128);
+        frame_read_data(16);
+    }
+}
+
+static void gen_erase(uint32_t page, uint32_t count) {
+    for (uint32_t p = page; p < page + count * ERASE_BLOCK_PAGES; p += ERASE_BLOCK_PAGES) {
+        frame_set_address(PS2_SIO2_CMD_SET_ERASE_ADDRESS, p);
+        frame_simple(PS2_SIO2_CMD_ERASE);
+    }
+}
+
+static void gen_write(uint32_t page, uint32_t count) {
+    uint8_t data[128];
+
+    for (uint32_t p = page; p < page + count; p++) {
+        if (p == page || (p % ERASE_BLOCK_PAGES) == 0)
+            gen_erase(p - (p % ERASE_BLOCK_PAGES), 1);
+
+        frame_set_address(PS2_SIO2_CMD_SET_WRITE_ADDRESS, p);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < (int)sizeof(data); j++)
+                data[j] = (uint8_t)(p + i * sizeof(data) + j);
+            frame_write_data(data, sizeof(data));
+        }
+        memset(data, 0, 16);
+        frame_write_data(data, 16);
+        frame_simple(PS2_SIO2_CMD_COMMIT_DATA);
+    }
+}
+
+static void gen_specs(void) {
+    uint8_t f[13] = { PS2_SIO2_CMD_IDENTIFIER, PS2_SIO2_CMD_GET_SPECS };
+
+    replay_frame(f, sizeof(f));
+}
+
+static int parse_line(char *line, unsigned lineno) {
+    char *p = line;
+    uint8_t frame[MAX_FRAME];
+    size_t len = 0;
+
+    while (isspace((unsigned char)*p))
+        p++;
+    if (*p == '\0' || *p == '#')
+        return 0;
+
+    /* frames are made of hex bytes, anything else starts with a directive */
+    size_t tok = strcspn(p, " \t\r\n#");
+    bool is_byte = tok > 0 && tok <= 2 && strspn(p, "0123456789abcdefABCDEF") >= tok;
+
+    if (*p != '+' && !is_byte) {
+        char word[16];
+        unsigned long a = 0, b = 1;
+        int n = sscanf(p, "%15s %lu %lu", word, &a, &b);
+
+        if (strcmp(word, "idle") == 0 && n >= 2)
+            run_idle(a);
+        else if (strcmp(word, "read") == 0 && n >= 2)
+            gen_read(a, b);
+        else if (strcmp(word, "write") == 0 && n >= 2)
+            gen_write(a, b);
+        else if (strcmp(word, "erase") == 0 && n >= 2)
+            gen_erase(a, b);
+        else if (strcmp(word, "specs") == 0)
+            gen_specs();
+        else {
+            fprintf(stderr, "line %u: unknown directive '%s'\n", lineno, word);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (*p == '+') {
+        run_idle(strtoull(p + 1, &p, 10));
+    }
+
+    while (*p) {
+        char *end;
+        unsigned long byte;
+
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            break;
+        errno = 0;
+        byte = strtoul(p, &end, 16);
+        if (end == p || errno || byte > 0xFF || len == MAX_FRAME) {
+            fprintf(stderr, "line %u: bad frame\n", lineno);
+            return -1;
+        }
+        frame[len++] = (uint8_t)byte;
+        p = end;
+    }
+
+    replay_frame(frame, len);
+    return 0;
+}
+
+static void print_report(void) {
+    sd_posix_stat_t sd;
+    cmd_stat_t total = {0};
+
+    printf("%-16s %7s %9s %7s %6s %9s %7s %10s %10s %10s %10s\n",
+           "cmd", "frames", "bytes", "budget", "misses", "max_gap", "no_ack", "avg_us", "di_us", "sd_us", "des_cpu_us");
+
+    for (int key = 0; key <= STAT_OTHER; key++) {
+        cmd_stat_t *s = &stats[key];
+
+        if (!s->frames)
+            continue;
+        printf("%-16s %7u %9u %7u %6u %9u %7u %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+               cmd_name(key), s->frames, s->bytes, cmd_budget(key), s->misses, s->max_gap_us, s->no_ack,
+               s->total_us / s->frames, s->di_us, s->sd_us, s->des_cpu_us);
+
+        total.frames += s->frames;
+        total.bytes += s->bytes;
+        total.misses += s->misses;
+        total.no_ack += s->no_ack;
+        total.total_us += s->total_us;
+    }
+
+    printf("\n%u frames, %u bytes, %u budget misses, %u without ACK, %" PRIu64 " us on the bus\n",
+           total.frames, total.bytes, total.misses, total.no_ack, total.total_us);
+
+    sd_posix_get_stat(&sd);
+    printf("SD: %u reads (%" PRIu64 " us), %u writes (%" PRIu64 " us), %u flushes (%" PRIu64 " us), "
+           "%u opens, %u seeks, %u metadata (%" PRIu64 " us)\n",
+           sd.ops[SD_POSIX_OP_READ], sd.delay_us[SD_POSIX_OP_READ],
+           sd.ops[SD_POSIX_OP_WRITE], sd.delay_us[SD_POSIX_OP_WRITE],
+           sd.ops[SD_POSIX_OP_FLUSH], sd.delay_us[SD_POSIX_OP_FLUSH],
+           sd.ops[SD_POSIX_OP_OPEN], sd.ops[SD_POSIX_OP_SEEK],
+           sd.ops[SD_POSIX_OP_META], sd.delay_us[SD_POSIX_OP_META]);
+}
+
+/* Rough figures for a class 10 card behind the 25MHz SPI bus */
+static const sd_posix_config_t sd_typical = {
+    .latency = {
+        [SD_POSIX_OP_OPEN]  = { .min_us = 800, .max_us = 2500 },
+        [SD_POSIX_OP_CLOSE] = { .min_us = 200, .max_us = 600 },
+        [SD_POSIX_OP_READ]  = { .min_us = 250, .max_us = 700, .spike_us = 5000, .spike_permille = 2 },
+        [SD_POSIX_OP_WRITE] = { .min_us = 300, .max_us = 900, .spike_us = 40000, .spike_permille = 10 },
+        [SD_POSIX_OP_SEEK]  = { .min_us = 0, .max_us = 50 },
+        [SD_POSIX_OP_FLUSH] = { .min_us = 500, .max_us = 2000, .spike_us = 40000, .spike_permille = 20 },
+        [SD_POSIX_OP_META]  = { .min_us = 500, .max_us = 3000 },
+    },
+    .read_bytes_per_s = 2500000,
+    .write_bytes_per_s = 1500000,
+    .seed = 1,
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] <trace|->\n"
+            "  -r, --root DIR       SD card root (default: $SD2PSX_SD_ROOT or .)\n"
+            "  -s, --card-size MB   size of newly created cards, above 8 runs in SD mode\n"
+            "  -b, --byte-us US     bus time per byte (default 4)\n"
+            "  -l, --sd-latency     model SD latencies instead of instant access\n"
+            "  -S, --seed N         seed for the SD latency model\n"
+            "  -p, --cpu-scale N    charge N times the host CPU time of DES to the clock\n"
+            "  -n, --no-wait-load   start replaying before the card is fully loaded\n"
+            "  -c, --csv FILE       write per frame results\n"
+            "  -v, --verbose        print every frame\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_opts[] = {
+        { "root", required_argument, NULL, 'r' },
+        { "card-size", required_argument, NULL, 's' },
+        { "byte-us", required_argument, NULL, 'b' },
+        { "sd-latency", no_argument, NULL, 'l' },
+        { "seed", required_argument, NULL, 'S' },
+        { "cpu-scale", required_argument, NULL, 'p' },
+        { "no-wait-load", no_argument, NULL, 'n' },
+        { "csv", required_argument, NULL, 'c' },
+        { "verbose", no_argument, NULL, 'v' },
+        { NULL, 0, NULL, 0 }
+    };
+    sd_posix_config_t sd_config = sd_typical;
+    bool sd_latency = false, wait_load = true;
+    int card_size = 0;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "r:s:b:lS:p:nc:v", long_opts, NULL)) != -1) {
+        switch (c) {
+            case 'r': sd_posix_set_root(optarg); break;
+            case 's': card_size = atoi(optarg); break;
+            case 'b': opt.byte_us = strtoul(optarg, NULL, 0); break;
+            case 'l': sd_latency = true; break;
+            case 'S': sd_config.seed = strtoul(optarg, NULL, 0); break;
+            case 'p': opt.cpu_scale = strtoul(optarg, NULL, 0); break;
+            case 'n': wait_load = false; break;
+            case 'c':
+                opt.csv = fopen(optarg, "w");
+                if (!opt.csv) {
+                    perror(optarg);
+                    return 1;
+                }
+                fprintf(opt.csv, "idx,cmd,bytes,start_us,dur_us,max_gap_us,budget_us,misses,no_ack,di_us,sd_us,des_cpu_us\n");
+                break;
+            case 'v': opt.verbose = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *trace = strcmp(argv[optind], "-") == 0 ? stdin : fopen(argv[optind], "r");
+    if (!trace) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    host_clock_set_simulated(true);
+    sd_posix_set_delay_cb(host_clock_advance);
+    sd_posix_configure(sd_latency ? &sd_config : NULL);
+    host_pio_set_put_cb(on_put);
+
+    settings_init();
+    if (card_size)
+        settings_set_ps2_cardsize(card_size);
+    psram_init();
+
+    /* same order as ps2_init */
+    mmceman_mcman_retry_counter = 0;
+    multicore_launch_core1(ps2_memory_card_main);
+    ps2_history_tracker_init();
+    ps2_memory_card_enter();
+    ps2_mc_data_interface_init();
+    ps2_cardman_init();
+    ps2_cardman_open();
+    ps2_mmceman_fs_init();
+
+    while (wait_load && !ps2_cardman_is_idle())
+        core0_task();
+
+    sd_posix_reset_stat();
+    printf("card ready after %" PRIu64 " us, replaying\n", time_us_64());
+
+    char line[4 * MAX_FRAME];
+    unsigned lineno = 0;
+    int ret = 0;
+
+    while (fgets(line, sizeof(line), trace)) {
+        if (parse_line(line, ++lineno) != 0) {
+            ret = 1;
+            break;
+        }
+    }
+
+    /* same as ps2_deinit, without dropping the card */
+    ps2_memory_card_exit();
+    while (ps2_mc_data_interface_write_occured())
+        ps2_mc_data_interface_task();
+    ps2_cardman_close();
+
+    print_report();
+
+    if (opt.csv)
+        fclose(opt.csv);
+    if (trace != stdin)
+        fclose(trace);
+    return ret;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* DMA of the SPI mock, see spi_mock.h. Only channels paced by the SPI DREQs
+ * move data, at the wire rate of the mock SD card, and only while
+ * dma_channel_is_busy polls them */
+
+#define NUM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    uint dreq;
+    bool read_increment;
+    bool write_increment;
+} dma_channel_config;
+
+typedef struct {
+    volatile uint32_t read_addr;
+    volatile uint32_t write_addr;
+    volatile uint32_t transfer_count;
+    volatile uint32_t ctrl_trig;
+} dma_channel_hw_t;
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+bool dma_channel_is_claimed(uint channel);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_start_channel_mask(uint32_t chan_mask);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_abort(uint channel);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SPI peripheral of the SPI mock, see spi_mock.h. Bytes go to the mock SD
+ * card as they are clocked, the FIFOs are not modelled */
+
+typedef volatile uint32_t io_rw_32;
+
+typedef struct {
+    io_rw_32 cr0;
+    io_rw_32 cr1;
+    io_rw_32 dr;
+    io_rw_32 sr;
+} spi_hw_t;
+
+typedef struct spi_inst {
+    spi_hw_t hw;
+    uint32_t baud;
+} spi_inst_t;
+
+extern spi_inst_t host_spi[2];
+#define spi0 (&host_spi[0])
+#define spi1 (&host_spi[1])
+
+typedef enum {
+    SPI_CPHA_0 = 0,
+    SPI_CPHA_1 = 1
+} spi_cpha_t;
+
+typedef enum {
+    SPI_CPOL_0 = 0,
+    SPI_CPOL_1 = 1
+} spi_cpol_t;
+
+typedef enum {
+    SPI_LSB_FIRST = 0,
+    SPI_MSB_FIRST = 1
+} spi_order_t;
+
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_deinit(spi_inst_t *spi);
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+
+int spi_write_read_blocking(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+int spi_write16_read16_blocking(spi_inst_t *spi, const uint16_t *src, uint16_t *dst, size_t len);
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi);
+uint spi_get_index(const spi_inst_t *spi);
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx);
+bool spi_is_busy(const spi_inst_t *spi);
+/* Reading DR after it returned true is what pops the RX FIFO */
+bool spi_is_readable(const spi_inst_t *spi);
+
+#ifdef __cplusplus
+}
+#endif
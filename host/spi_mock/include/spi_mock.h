@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Host model of the RP2040 SPI and DMA blocks, enough to run SPI.cpp
+ * against a mock SD card.
+ *
+ * The card answers every byte it is clocked with spi_mock_response(tx,
+ * index), index counting the bytes since spi_mock_reset, and logs what it
+ * was sent. Time runs on the simulated host clock: the wire takes 8 bits at
+ * the baud rate spi_init settled on and the CPU side is charged from
+ * spi_mock_cost_t. The costs are estimates for a 125 MHz RP2040, not
+ * measurements, so results compare paths rather than predict hardware */
+
+typedef struct {
+    uint32_t cpu_byte_ns;       // SDK blocking loops per byte, the wire may be faster
+    uint32_t call_ns;           // per SDK SPI call
+    uint32_t format_ns;         // spi_set_format
+    uint32_t dma_setup_ns;      // per dma_channel_configure
+    uint32_t poll_ns;           // per dma_channel_is_busy
+} spi_mock_cost_t;
+
+extern const spi_mock_cost_t spi_mock_default_cost;
+
+#define SPI_MOCK_LOG_SIZE   (64 * 1024)
+#define SPI_MOCK_NO_STALL   UINT32_MAX
+
+void spi_mock_reset(const spi_mock_cost_t *cost);
+/* The card stops answering DMA traffic after that many more bytes */
+void spi_mock_stall_after(uint32_t bytes);
+
+uint8_t spi_mock_response(uint8_t tx, uint32_t index);
+uint32_t spi_mock_bytes(void);
+/* Byte index i was sent as spi_mock_tx_log()[i % SPI_MOCK_LOG_SIZE] */
+const uint8_t *spi_mock_tx_log(void);
+uint32_t spi_mock_rx_fifo_level(void);
+uint64_t spi_mock_ns(void);
+uint32_t spi_mock_baud(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,262 @@
+/* Runs the SD card SPI driver (SPI.cpp) against the SPI mock.
+ *
+ *   spi_check check
+ *       Bulk transfers of several sizes, in place, with separate buffers and
+ *       without a TX or RX buffer. The card has to see the bytes that were
+ *       sent and the buffers have to hold its answers. Also checks that:
+ *       - DMA channels are taken from the top;
+ *       - with no free channel, transfers fall back to the CPU;
+ *       - a stalled card times the DMA out, drains the RX FIFO and raises
+ *         transferError() exactly once;
+ *       - end() gives the channels back.
+ *
+ *   spi_check bench [--cpu-byte-ns n] [--call-ns n] [--format-ns n]
+ *                   [--dma-setup-ns n] [--poll-ns n]
+ *       Simulated time of one transfer per size and SPI clock through the
+ *       byte loop transfer(void*, size_t) used before DMA, the blocking SDK
+ *       call, and transfer() as it is now. The costs are the estimates of
+ *       spi_mock_default_cost unless overridden, see spi_mock.h. */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SPI.h"
+
+extern "C" {
+#include "hardware/dma.h"
+#include "spi_mock.h"
+}
+
+#define MAX_XFER    4096
+#define SD_CLOCK    25000000
+
+static int failures;
+
+#define EXPECT(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void fill(uint8_t *buf, size_t count, uint8_t seed) {
+    for (size_t i = 0; i < count; i++)
+        buf[i] = (uint8_t)(seed + i * 31);
+}
+
+/* The card saw sent[] (all 0xFF if NULL) from index start on and answered
+ * into received[] (not checked if NULL) */
+static void expect_wire(const char *what, uint32_t start, const uint8_t *sent, const uint8_t *received, size_t count) {
+    const uint8_t *log = spi_mock_tx_log();
+
+    EXPECT(spi_mock_bytes() - start == count, "%s: %u bytes clocked, expected %zu", what, spi_mock_bytes() - start, count);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t tx = sent ? sent[i] : 0xFF;
+        uint32_t index = start + i;
+
+        if (log[index % SPI_MOCK_LOG_SIZE] != tx) {
+            EXPECT(false, "%s: byte %zu sent as %02x, expected %02x", what, i, log[index % SPI_MOCK_LOG_SIZE], tx);
+            return;
+        }
+        if (received && (received[i] != spi_mock_response(tx, index))) {
+            EXPECT(false, "%s: byte %zu received as %02x, expected %02x", what, i, received[i], spi_mock_response(tx, index));
+            return;
+        }
+    }
+}
+
+static void check_sizes(void) {
+    static const size_t sizes[] = { 1, 8, SPI_DMA_MIN_XFER - 1, SPI_DMA_MIN_XFER, SPI_DMA_MIN_XFER + 1, 512, MAX_XFER };
+    static uint8_t buf[MAX_XFER], orig[MAX_XFER], rx[MAX_XFER + 1];
+    char what[64];
+
+    for (size_t s = 0; s < count_of(sizes); s++) {
+        size_t n = sizes[s];
+        uint32_t start;
+
+        fill(orig, n, s);
+        memcpy(buf, orig, n);
+        start = spi_mock_bytes();
+        SPI.transfer(buf, n);
+        snprintf(what, sizeof(what), "in place %zu", n);
+        expect_wire(what, start, orig, buf, n);
+
+        memset(rx, 0, sizeof(rx));
+        start = spi_mock_bytes();
+        SPI.transfer(orig, rx, n);
+        snprintf(what, sizeof(what), "tx/rx %zu", n);
+        expect_wire(what, start, orig, rx, n);
+        EXPECT(rx[n] == 0, "%s: wrote past the end", what);
+
+        start = spi_mock_bytes();
+        SPI.transfer(nullptr, rx, n);
+        snprintf(what, sizeof(what), "rx only %zu", n);
+        expect_wire(what, start, nullptr, rx, n);
+
+        start = spi_mock_bytes();
+        SPI.transfer(orig, nullptr, n);
+        snprintf(what, sizeof(what), "tx only %zu", n);
+        expect_wire(what, start, orig, nullptr, n);
+
+        EXPECT(!SPI.transferError(), "size %zu raised a transfer error", n);
+    }
+}
+
+static void check_stall(void) {
+    static uint8_t buf[512], orig[512];
+    uint64_t start_ns = spi_mock_ns(), wire_ns = 512ull * 8 * 1000000000ull / spi_mock_baud();
+    uint32_t start;
+
+    fill(orig, sizeof(orig), 7);
+    memcpy(buf, orig, sizeof(buf));
+    spi_mock_stall_after(100);
+    SPI.transfer(buf, sizeof(buf));
+    EXPECT(SPI.transferError(), "stalled transfer did not raise an error");
+    EXPECT(!SPI.transferError(), "transfer error did not clear");
+    EXPECT(spi_mock_rx_fifo_level() == 0, "RX FIFO not drained, %u left", spi_mock_rx_fifo_level());
+    EXPECT(spi_mock_ns() - start_ns >= 4 * wire_ns, "timed out after %llu ns, before 4x the wire time",
+           (unsigned long long)(spi_mock_ns() - start_ns));
+
+    spi_mock_stall_after(SPI_MOCK_NO_STALL);
+    memcpy(buf, orig, sizeof(buf));
+    start = spi_mock_bytes();
+    SPI.transfer(buf, sizeof(buf));
+    expect_wire("after stall", start, orig, buf, sizeof(buf));
+    EXPECT(!SPI.transferError(), "transfer after the stall failed");
+}
+
+static int check(void) {
+    static uint8_t buf[512], orig[512];
+    uint32_t start;
+
+    spi_mock_reset(nullptr);
+
+    /* the PSRAM driver holds the low channels */
+    for (uint ch = 0; ch < 4; ch++)
+        dma_channel_claim(ch);
+
+    SPI.begin();
+    SPI.beginTransaction(SPISettings(SD_CLOCK, MSBFIRST, SPI_MODE0));
+
+    check_sizes();
+    EXPECT(dma_channel_is_claimed(NUM_DMA_CHANNELS - 1) && dma_channel_is_claimed(NUM_DMA_CHANNELS - 2),
+           "DMA channels not taken from the top");
+    check_stall();
+
+    SPI.end();
+    EXPECT(!dma_channel_is_claimed(NUM_DMA_CHANNELS - 1) && !dma_channel_is_claimed(NUM_DMA_CHANNELS - 2),
+           "end() kept the DMA channels");
+
+    /* no channel left, bulk transfers stay on the CPU */
+    for (uint ch = 4; ch < NUM_DMA_CHANNELS; ch++)
+        dma_channel_claim(ch);
+    SPI.begin();
+    SPI.beginTransaction(SPISettings(SD_CLOCK, MSBFIRST, SPI_MODE0));
+    check_sizes();
+    SPI.end();
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++)
+        dma_channel_unclaim(ch);
+
+    /* LSB first goes byte by byte, the card sees mirrored bytes */
+    SPI.begin();
+    SPI.beginTransaction(SPISettings(SD_CLOCK, LSBFIRST, SPI_MODE0));
+    fill(orig, sizeof(orig), 3);
+    memcpy(buf, orig, sizeof(buf));
+    start = spi_mock_bytes();
+    SPI.transfer(buf, 64);
+    for (size_t i = 0; i < 64; i++) {
+        uint8_t mirrored = 0;
+        for (int bit = 0; bit < 8; bit++)
+            mirrored |= ((orig[i] >> bit) & 1) << (7 - bit);
+        orig[i] = mirrored;
+    }
+    expect_wire("lsb first", start, orig, nullptr, 64);
+    SPI.end();
+
+    printf("%s, %d failures\n", failures ? "FAILED" : "passed", failures);
+    return failures ? 1 : 0;
+}
+
+static double mb_per_s(size_t count, uint64_t ns) {
+    return ns ? (double)count * 1000.0 / ns : 0.0;
+}
+
+static int bench(int argc, char **argv) {
+    static const struct option long_opts[] = {
+        { "cpu-byte-ns", required_argument, nullptr, 'b' },
+        { "call-ns", required_argument, nullptr, 'c' },
+        { "format-ns", required_argument, nullptr, 'f' },
+        { "dma-setup-ns", required_argument, nullptr, 'd' },
+        { "poll-ns", required_argument, nullptr, 'p' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    static const uint32_t clocks[] = { 12500000, 25000000, 50000000 };
+    static const size_t sizes[] = { 8, 16, 31, 32, 64, 512, MAX_XFER };
+    static uint8_t buf[MAX_XFER];
+    spi_mock_cost_t cost = spi_mock_default_cost;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "", long_opts, nullptr)) != -1) {
+        switch (c) {
+            case 'b': cost.cpu_byte_ns = strtoul(optarg, nullptr, 0); break;
+            case 'c': cost.call_ns = strtoul(optarg, nullptr, 0); break;
+            case 'f': cost.format_ns = strtoul(optarg, nullptr, 0); break;
+            case 'd': cost.dma_setup_ns = strtoul(optarg, nullptr, 0); break;
+            case 'p': cost.poll_ns = strtoul(optarg, nullptr, 0); break;
+            default: return 1;
+        }
+    }
+
+    printf("costs: cpu byte %u ns, call %u ns, format %u ns, dma setup %u ns, poll %u ns\n",
+           cost.cpu_byte_ns, cost.call_ns, cost.format_ns, cost.dma_setup_ns, cost.poll_ns);
+    printf("%8s %6s %12s %12s %12s %9s\n", "clock", "bytes", "byte loop", "blocking", "transfer()", "MB/s");
+
+    for (size_t k = 0; k < count_of(clocks); k++) {
+        for (size_t s = 0; s < count_of(sizes); s++) {
+            size_t n = sizes[s];
+            uint64_t t0, loop_ns, blocking_ns, transfer_ns;
+
+            spi_mock_reset(&cost);
+            SPI.begin();
+            SPI.beginTransaction(SPISettings(clocks[k], MSBFIRST, SPI_MODE0));
+            /* claim the channels outside of the timed transfer */
+            SPI.transfer(buf, SPI_DMA_MIN_XFER);
+
+            t0 = spi_mock_ns();
+            for (size_t i = 0; i < n; i++)
+                buf[i] = SPI.transfer(buf[i]);
+            loop_ns = spi_mock_ns() - t0;
+
+            t0 = spi_mock_ns();
+            spi_set_format(spi0, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+            spi_write_read_blocking(spi0, buf, buf, n);
+            blocking_ns = spi_mock_ns() - t0;
+
+            t0 = spi_mock_ns();
+            SPI.transfer(buf, n);
+            transfer_ns = spi_mock_ns() - t0;
+
+            SPI.end();
+
+            printf("%5.1fMHz %6zu %9.2f us %9.2f us %9.2f us %4.1f/%4.1f\n", spi_mock_baud() / 1e6, n,
+                   loop_ns / 1e3, blocking_ns / 1e3, transfer_ns / 1e3,
+                   mb_per_s(n, blocking_ns), mb_per_s(n, transfer_ns));
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if ((argc > 1) && (strcmp(argv[1], "bench") == 0))
+        return bench(argc - 1, argv + 1);
+    if ((argc > 1) && (strcmp(argv[1], "check") != 0)) {
+        fprintf(stderr, "usage: %s [check | bench [options]]\n", argv[0]);
+        return 1;
+    }
+    return check();
+}
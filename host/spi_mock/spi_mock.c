@@ -0,0 +1,305 @@
+#include <string.h>
+
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "host_clock.h"
+#include "spi_mock.h"
+
+#define CLK_PERI_HZ     125000000u
+#define MAX_BAUD        (CLK_PERI_HZ / 2)
+/* Bytes in flight when the card stalls, the drain in SPI.cpp has to read them */
+#define STALL_FIFO      4
+
+typedef struct {
+    bool claimed;
+    bool busy;
+    dma_channel_config cfg;
+    uintptr_t read_addr;
+    uintptr_t write_addr;
+} dma_channel_t;
+
+spi_inst_t host_spi[2];
+
+const spi_mock_cost_t spi_mock_default_cost = {
+    .cpu_byte_ns = 128,     // 16 cycles through the FIFO status checks
+    .call_ns = 200,
+    .format_ns = 240,
+    .dma_setup_ns = 400,
+    .poll_ns = 48,
+};
+
+static spi_mock_cost_t cost;
+static dma_channel_hw_t dma_hw[NUM_DMA_CHANNELS];
+static dma_channel_t dma[NUM_DMA_CHANNELS];
+
+static uint8_t tx_log[SPI_MOCK_LOG_SIZE];
+static uint32_t bytes;
+static uint32_t stall_at = SPI_MOCK_NO_STALL;
+static uint32_t rx_fifo;
+
+static uint64_t now_ns;
+static uint64_t clock_us;
+
+static int dma_tx = -1, dma_rx = -1;
+static uint64_t dma_start_ns;
+static uint32_t dma_done;
+
+static void charge(uint64_t ns) {
+    now_ns += ns;
+    if (now_ns / 1000 > clock_us) {
+        host_clock_advance(now_ns / 1000 - clock_us);
+        clock_us = now_ns / 1000;
+    }
+}
+
+static uint64_t wire_ns(uint32_t count) {
+    return (uint64_t)count * 8 * 1000000000ull / host_spi[0].baud;
+}
+
+/* Sends one byte to the card and returns its answer */
+static uint8_t clock_byte(uint8_t tx) {
+    uint8_t rx = spi_mock_response(tx, bytes);
+
+    tx_log[bytes % SPI_MOCK_LOG_SIZE] = tx;
+    bytes++;
+    return rx;
+}
+
+uint8_t spi_mock_response(uint8_t tx, uint32_t index) {
+    return (uint8_t)((tx ^ 0xA5) + index * 13);
+}
+
+void spi_mock_reset(const spi_mock_cost_t *new_cost) {
+    cost = new_cost ? *new_cost : spi_mock_default_cost;
+    host_clock_set_simulated(true);
+    memset(tx_log, 0, sizeof(tx_log));
+    bytes = 0;
+    stall_at = SPI_MOCK_NO_STALL;
+    rx_fifo = 0;
+    now_ns = 0;
+    clock_us = 0;
+}
+
+void spi_mock_stall_after(uint32_t count) {
+    stall_at = (count == SPI_MOCK_NO_STALL) ? SPI_MOCK_NO_STALL : bytes + count;
+}
+
+uint32_t spi_mock_bytes(void) {
+    return bytes;
+}
+
+const uint8_t *spi_mock_tx_log(void) {
+    return tx_log;
+}
+
+uint32_t spi_mock_rx_fifo_level(void) {
+    return rx_fifo;
+}
+
+uint64_t spi_mock_ns(void) {
+    return now_ns;
+}
+
+uint32_t spi_mock_baud(void) {
+    return host_spi[0].baud;
+}
+
+/* SPI */
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    uint32_t div = (CLK_PERI_HZ + baudrate - 1) / baudrate;
+
+    /* the prescaler only divides by even numbers */
+    div = (div < 2) ? 2 : div + (div & 1);
+    spi->baud = CLK_PERI_HZ / div;
+    if (spi->baud > MAX_BAUD)
+        spi->baud = MAX_BAUD;
+    return spi->baud;
+}
+
+void spi_deinit(spi_inst_t *spi) {
+    (void)spi;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+    spi->hw.cr0 = (data_bits - 1) | (cpol << 6) | (cpha << 7);
+    (void)order;
+    charge(cost.format_ns);
+}
+
+/* The CPU keeps the FIFO fed, so a byte takes the longer of wire and loop */
+static void charge_blocking(size_t len) {
+    uint64_t wire = wire_ns(len), cpu = (uint64_t)len * cost.cpu_byte_ns;
+
+    charge(cost.call_ns + (wire > cpu ? wire : cpu));
+}
+
+int spi_write_read_blocking(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len) {
+    (void)spi;
+    for (size_t i = 0; i < len; i++)
+        dst[i] = clock_byte(src[i]);
+    charge_blocking(len);
+    return (int)len;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    (void)spi;
+    for (size_t i = 0; i < len; i++)
+        clock_byte(src[i]);
+    charge_blocking(len);
+    return (int)len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len) {
+    (void)spi;
+    for (size_t i = 0; i < len; i++)
+        dst[i] = clock_byte(repeated_tx_data);
+    charge_blocking(len);
+    return (int)len;
+}
+
+int spi_write16_read16_blocking(spi_inst_t *spi, const uint16_t *src, uint16_t *dst, size_t len) {
+    (void)spi;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t hi = clock_byte(src[i] >> 8);
+        dst[i] = (hi << 8) | clock_byte(src[i] & 0xFF);
+    }
+    charge_blocking(len * 2);
+    return (int)len;
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    return &spi->hw;
+}
+
+uint spi_get_index(const spi_inst_t *spi) {
+    return spi == spi1;
+}
+
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx) {
+    return (spi == spi1) ? (is_tx ? DREQ_SPI1_TX : DREQ_SPI1_RX) : (is_tx ? DREQ_SPI0_TX : DREQ_SPI0_RX);
+}
+
+bool spi_is_busy(const spi_inst_t *spi) {
+    (void)spi;
+    return false;
+}
+
+bool spi_is_readable(const spi_inst_t *spi) {
+    (void)spi;
+    if (rx_fifo == 0)
+        return false;
+    rx_fifo--;
+    return true;
+}
+
+/* DMA */
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    return &dma_hw[channel];
+}
+
+void dma_channel_claim(uint channel) {
+    if (dma[channel].claimed)
+        panic("DMA channel %u is already claimed", channel);
+    dma[channel].claimed = true;
+}
+
+void dma_channel_unclaim(uint channel) {
+    dma[channel].claimed = false;
+}
+
+bool dma_channel_is_claimed(uint channel) {
+    return dma[channel].claimed;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c = { DMA_SIZE_32, 0x3f, true, false };
+
+    (void)channel;
+    return c;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    if (config->size != DMA_SIZE_8)
+        panic("SPI mock only moves bytes");
+
+    dma[channel].cfg = *config;
+    dma[channel].read_addr = (uintptr_t)read_addr;
+    dma[channel].write_addr = (uintptr_t)write_addr;
+    dma_hw[channel].transfer_count = transfer_count;
+    charge(cost.dma_setup_ns);
+    if (trigger)
+        dma_start_channel_mask(1u << channel);
+}
+
+/* A transfer is a TX channel on the SPI TX DREQ and an RX channel on the RX
+ * one, started together */
+void dma_start_channel_mask(uint32_t chan_mask) {
+    dma_tx = dma_rx = -1;
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (!(chan_mask & (1u << ch)) || dma_hw[ch].transfer_count == 0)
+            continue;
+        dma[ch].busy = true;
+        if (dma[ch].cfg.dreq == DREQ_SPI0_TX)
+            dma_tx = ch;
+        else if (dma[ch].cfg.dreq == DREQ_SPI0_RX)
+            dma_rx = ch;
+        else
+            panic("SPI mock only serves SPI0 DREQs");
+    }
+    if ((dma_tx < 0) || (dma_rx < 0) || (dma_hw[dma_tx].transfer_count != dma_hw[dma_rx].transfer_count))
+        panic("SPI mock needs a TX and an RX channel of the same length");
+    dma_start_ns = now_ns;
+    dma_done = 0;
+}
+
+/* Moves the bytes the wire had time for since the start */
+static void dma_pump(void) {
+    uint32_t due;
+
+    if ((dma_tx < 0) || (dma_rx < 0) || !dma[dma_tx].busy || !dma[dma_rx].busy)
+        return;
+
+    due = (uint32_t)((now_ns - dma_start_ns) * host_spi[0].baud / 8 / 1000000000ull);
+    while ((dma_done < due) && (dma_hw[dma_rx].transfer_count > 0)) {
+        dma_channel_t *tx = &dma[dma_tx], *rx = &dma[dma_rx];
+        uint8_t byte;
+
+        if (bytes == stall_at) {
+            rx_fifo = STALL_FIFO;
+            return;
+        }
+
+        byte = clock_byte(*(const uint8_t *)tx->read_addr);
+        *(uint8_t *)rx->write_addr = byte;
+        if (tx->cfg.read_increment)
+            tx->read_addr++;
+        if (rx->cfg.write_increment)
+            rx->write_addr++;
+        dma_hw[dma_tx].transfer_count--;
+        dma_hw[dma_rx].transfer_count--;
+        dma_done++;
+    }
+
+    if (dma_hw[dma_rx].transfer_count == 0) {
+        dma[dma_tx].busy = false;
+        dma[dma_rx].busy = false;
+        dma_tx = dma_rx = -1;
+    }
+}
+
+bool dma_channel_is_busy(uint channel) {
+    charge(cost.poll_ns);
+    dma_pump();
+    return dma[channel].busy;
+}
+
+void dma_channel_abort(uint channel) {
+    dma[channel].busy = false;
+    if ((int)channel == dma_tx)
+        dma_tx = -1;
+    if ((int)channel == dma_rx)
+        dma_rx = -1;
+}
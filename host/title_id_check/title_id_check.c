@@ -0,0 +1,433 @@
+/* Title ID parser checks for the host build.
+ *
+ *   title_id_check fuzz [-n iterations] <corpus>...
+ *       Runs every corpus line and random mutations of it through the sanity
+ *       check and the lookup split of game_db.c for PS1, PS2 and COH, and
+ *       compares which prefix and numeric ID would be looked up against a
+ *       copy of the strtok and atoi code they replaced. The mutations insert,
+ *       delete, replace and duplicate bytes, biased towards letters, digits
+ *       and separators, and truncate.
+ *
+ *       The old code crashes on IDs without a second '-' token and overflows
+ *       its buffer on IDs of 10 or more characters after the '-', those
+ *       inputs are only counted. Two differences are intended and counted
+ *       apart: the old sanity check only saw the first 15 bytes, and IDs of
+ *       more than 9 digits are rejected instead of cut to 9.
+ *
+ *   title_id_check bench [-n rounds] <corpus>...
+ *       Times the sanity check and the lookup split over the corpus IDs the
+ *       old code handled, against the old code.
+ *
+ * One corpus entry per line, an empty line is the empty ID. The host build
+ * passes the hand written corpus.txt and the title IDs of the synthetic game
+ * databases. */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "game_db/game_db.h"
+#include "settings.h"
+
+#define MAX_INPUT       64
+#define ALPHA           "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+#define DIGITS          "0123456789"
+
+typedef enum {
+    SYSTEM_PS1,
+    SYSTEM_PS2,
+    SYSTEM_COH,
+    SYSTEM_COUNT
+} system_t;
+
+static const char *const system_names[SYSTEM_COUNT] = { "ps1", "ps2", "coh" };
+
+/* The prefix and numeric ID a lookup searches for, if any */
+typedef struct {
+    bool found;
+    char prefix[5];
+    uint32_t numeric_id;
+} lookup_key_t;
+
+static char (*corpus)[MAX_INPUT];
+static size_t corpus_size, corpus_capacity;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool load_corpus(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[256];
+
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (corpus_size == corpus_capacity) {
+            corpus_capacity = corpus_capacity ? corpus_capacity * 2 : 1024;
+            corpus = realloc(corpus, corpus_capacity * sizeof(*corpus));
+            if (!corpus) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        line[strcspn(line, "\n")] = '\0';
+        line[MAX_INPUT - 1] = '\0';
+        memcpy(corpus[corpus_size++], line, MAX_INPUT);
+    }
+    fclose(f);
+
+    return true;
+}
+
+static void set_system(system_t system) {
+    settings_set_mode((system == SYSTEM_PS1) ? MODE_PS1 : MODE_PS2);
+    settings_set_ps2_variant((system == SYSTEM_COH) ? PS2_VARIANT_COH : PS2_VARIANT_RETAIL);
+}
+
+/* game_db_sanity_check_title_id before the one pass parser. Returns false
+ * where it would have dereferenced NULL */
+static bool baseline_sanity_check(const char *title_id, bool coh, bool *sane) {
+    uint8_t i = 0U;
+
+    *sane = false;
+    if (coh) {
+        if ((title_id[0] != 'N') || (title_id[1] != 'M')) {
+            return true;
+        } else {
+            i = 2;
+            while (title_id[i] != 0x00) {
+                if (!isdigit((int)title_id[i])) {
+                    return true;
+                }
+                i++;
+            }
+
+        }
+    } else {
+        char splittable_game_id[16];
+        strlcpy(splittable_game_id, title_id, sizeof(splittable_game_id));
+        char* prefix = strtok(splittable_game_id, "-");
+        char* id = strtok(NULL, "-");
+
+        if (prefix == NULL)
+            return false;
+        while (prefix[i] != 0x00) {
+            if (!isalpha((int)prefix[i])) {
+                return true;
+            }
+            i++;
+        }
+        if (i == 0) {
+            return true;
+        } else {
+            i = 0;
+        }
+
+        if (id == NULL)
+            return false;
+        while (id[i] != 0x00) {
+            if (!isdigit((int)id[i])) {
+                return true;
+            }
+            i++;
+        }
+    }
+
+    *sane = (i > 0);
+    return true;
+}
+
+/* The split of find_game_lookup before the one pass parser. Returns false
+ * where it would have dereferenced NULL or overflowed idString */
+static bool baseline_game_key(const char *game_id, lookup_key_t *key) {
+    char prefixString[5] = {};
+    char idString[10] = {};
+    uint32_t numeric_id = 0;
+
+    memset(key, 0x00, sizeof(*key));
+    if (game_id != NULL && game_id[0]) {
+        char* copy = strdup(game_id);
+        char* split = strtok(copy, "-");
+
+        if (split == NULL) {
+            free(copy);
+            return false;
+        }
+        if (strlen(split) > 0) {
+            strlcpy(prefixString, split, sizeof(prefixString));
+            for (uint8_t i = 0; i < sizeof(prefixString) - 1; i++) {
+                prefixString[i] = toupper((unsigned char)prefixString[i]);
+            }
+        }
+
+        split = strtok(NULL, "-");
+
+        if ((split == NULL) || (strlen(split) >= sizeof(idString))) {
+            free(copy);
+            return false;
+        }
+        if (strlen(split) > 0) {
+            strlcpy(idString, split, sizeof(idString));
+            numeric_id = atoi(idString);
+        }
+
+        free(copy);
+    }
+
+    if (numeric_id != 0) {
+        key->found = true;
+        memcpy(key->prefix, prefixString, sizeof(key->prefix));
+        key->numeric_id = numeric_id;
+    }
+    return true;
+}
+
+/* The split of find_arcade_lookup before the one pass parser */
+static void baseline_arcade_key(const char *game_id, lookup_key_t *key) {
+    char idString[10] = {};
+    uint32_t numeric_id = 0;
+
+    memset(key, 0x00, sizeof(*key));
+    if (game_id != NULL && game_id[0] == 'N' && game_id[1] == 'M') {
+        strlcpy(idString, &game_id[2], 10);
+        numeric_id = atoi(idString);
+    }
+
+    if (numeric_id != 0) {
+        key->found = true;
+        memcpy(key->prefix, "NM", 3);
+        key->numeric_id = numeric_id;
+    }
+}
+
+/* Every title ID reaching a lookup went through the sanity check first */
+static bool baseline_lookup(const char *title_id, system_t system, lookup_key_t *key) {
+    bool sane;
+
+    memset(key, 0x00, sizeof(*key));
+    if (!baseline_sanity_check(title_id, system == SYSTEM_COH, &sane))
+        return false;
+    if (!sane)
+        return true;
+    if (system == SYSTEM_COH) {
+        baseline_arcade_key(title_id, key);
+        return true;
+    }
+    return baseline_game_key(title_id, key);
+}
+
+/* The settings must match the system */
+static void lookup(const char *title_id, system_t system, lookup_key_t *key) {
+    game_db_title_id_t parsed;
+
+    memset(key, 0x00, sizeof(*key));
+    if (!game_db_sanity_check_title_id(title_id) || !game_db_parse_title_id(title_id, &parsed) || (parsed.numeric_id == 0))
+        return;
+
+    key->found = true;
+    memcpy(key->prefix, (system == SYSTEM_COH) ? "NM" : parsed.prefix, sizeof(key->prefix));
+    key->numeric_id = parsed.numeric_id;
+}
+
+static bool same_key(const lookup_key_t *a, const lookup_key_t *b) {
+    return (a->found == b->found)
+        && (!a->found || ((strcmp(a->prefix, b->prefix) == 0) && (a->numeric_id == b->numeric_id)));
+}
+
+static bool has_long_id(const char *id) {
+    for (const char *p = id; *p; p++) {
+        size_t digits = strspn(p, DIGITS);
+        if (digits > 9)
+            return true;
+        p += digits ? digits - 1 : 0;
+    }
+    return false;
+}
+
+typedef struct {
+    unsigned long checked, undefined, truncated, long_ids, found, failures;
+} fuzz_stats_t;
+
+static void print_key(const lookup_key_t *key) {
+    if (key->found)
+        printf("%s %u", key->prefix, key->numeric_id);
+    else
+        printf("none");
+}
+
+static void check(const char *id, system_t system, fuzz_stats_t *stats) {
+    lookup_key_t key, expected;
+
+    stats->checked++;
+    if (!baseline_lookup(id, system, &expected)) {
+        stats->undefined++;
+        return;
+    }
+    lookup(id, system, &key);
+    stats->found += key.found;
+    if (same_key(&key, &expected))
+        return;
+
+    if (strlen(id) > 15) {
+        stats->truncated++;
+    } else if (has_long_id(id)) {
+        stats->long_ids++;
+    } else {
+        stats->failures++;
+        printf("mismatch on %s \"%s\": ", system_names[system], id);
+        print_key(&key);
+        printf(", expected ");
+        print_key(&expected);
+        printf("\n");
+    }
+}
+
+static char random_byte(void) {
+    static const char interesting[] = ALPHA DIGITS "-_.;:\\/ ";
+
+    if (rand() % 8 == 0)
+        return (char)(rand() % 255 + 1);
+    return interesting[rand() % (sizeof(interesting) - 1)];
+}
+
+static void mutate(char *id) {
+    size_t len = strlen(id);
+    size_t pos = len ? rand() % len : 0;
+
+    switch (rand() % 5) {
+        case 0:
+            if (len < MAX_INPUT - 1) {
+                memmove(&id[pos + 1], &id[pos], len - pos + 1);
+                id[pos] = random_byte();
+            }
+            break;
+        case 1:
+            if (len)
+                memmove(&id[pos], &id[pos + 1], len - pos);
+            break;
+        case 2:
+            if (len)
+                id[pos] = random_byte();
+            break;
+        case 3:
+            if ((len < MAX_INPUT - 1) && len) {
+                memmove(&id[pos + 1], &id[pos], len - pos + 1);
+            }
+            break;
+        default:
+            id[pos] = '\0';
+            break;
+    }
+}
+
+/* Every system goes through the same mutations */
+static int fuzz(unsigned long iterations) {
+    fuzz_stats_t stats = {};
+
+    for (system_t system = 0; system < SYSTEM_COUNT; system++) {
+        set_system(system);
+
+        for (size_t i = 0; i < corpus_size; i++)
+            check(corpus[i], system, &stats);
+
+        srand(1);
+        for (unsigned long i = 0; i < iterations; i++) {
+            char id[MAX_INPUT];
+            int mutations = rand() % 4 + 1;
+
+            memcpy(id, corpus[rand() % corpus_size], MAX_INPUT);
+            while (mutations--)
+                mutate(id);
+            check(id, system, &stats);
+        }
+    }
+
+    printf("%zu corpus entries, %lu mutations, %lu lookups (%lu found)\n",
+           corpus_size, iterations, stats.checked, stats.found);
+    printf("%lu undefined in the old code, %lu past its 15 byte copy, %lu with over 9 digits, %lu mismatches\n",
+           stats.undefined, stats.truncated, stats.long_ids, stats.failures);
+    return stats.failures ? 1 : 0;
+}
+
+static int bench(int rounds) {
+    const char **ids = malloc(corpus_size * sizeof(*ids));
+    size_t count = 0;
+    volatile uint32_t sink = 0;
+    uint64_t start, ns;
+
+    set_system(SYSTEM_PS2);
+    for (size_t i = 0; i < corpus_size; i++) {
+        lookup_key_t key;
+        if (baseline_lookup(corpus[i], SYSTEM_PS2, &key))
+            ids[count++] = corpus[i];
+    }
+
+    start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < count; i++) {
+            game_db_title_id_t parsed;
+            if (game_db_sanity_check_title_id(ids[i])) {
+                game_db_parse_title_id(ids[i], &parsed);
+                sink += parsed.numeric_id;
+            }
+        }
+    }
+    ns = now_ns() - start;
+    printf("one pass  %8zu IDs %7.1f ns/ID\n", count * rounds, (double)ns / (count * rounds));
+
+    start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < count; i++) {
+            lookup_key_t key;
+            bool sane;
+            baseline_sanity_check(ids[i], false, &sane);
+            if (sane) {
+                baseline_game_key(ids[i], &key);
+                sink += key.numeric_id;
+            }
+        }
+    }
+    ns = now_ns() - start;
+    printf("strtok    %8zu IDs %7.1f ns/ID\n", count * rounds, (double)ns / (count * rounds));
+
+    free(ids);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned long count = 0;
+    int arg = 2;
+
+    if ((argc > 3) && (strcmp(argv[2], "-n") == 0)) {
+        count = strtoul(argv[3], NULL, 0);
+        arg = 4;
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "usage: %s fuzz|bench [-n iterations|rounds] <corpus>...\n", argv[0]);
+        return 1;
+    }
+    for (; arg < argc; arg++)
+        if (!load_corpus(argv[arg]))
+            return 1;
+    if (corpus_size == 0) {
+        fprintf(stderr, "empty corpus\n");
+        return 1;
+    }
+
+    if (strcmp(argv[1], "fuzz") == 0)
+        return fuzz(count ? count : 1000000);
+    else if (strcmp(argv[1], "bench") == 0)
+        return bench(count ? (int)count : 100);
+
+    fprintf(stderr, "unknown mode %s\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,45 @@
+#include <stdbool.h>
+#include "wear_leveling/wear_leveling.h"
+#include "wear_leveling/wear_leveling_internal.h"
+
+/* Settings storage kept in RAM, every run starts from erased settings */
+static backing_store_int_t backing[WEAR_LEVELING_BACKING_SIZE / sizeof(backing_store_int_t)];
+
+bool backing_store_init(void) {
+    return true;
+}
+
+bool backing_store_unlock(void) {
+    return true;
+}
+
+bool backing_store_erase(void) {
+    memset(backing, 0, sizeof(backing));
+    return true;
+}
+
+bool backing_store_write(uint32_t address, backing_store_int_t value) {
+    return backing_store_write_bulk(address, &value, 1);
+}
+
+bool backing_store_write_bulk(uint32_t address, backing_store_int_t *values, size_t item_count) {
+    if (address + item_count * sizeof(backing_store_int_t) > sizeof(backing))
+        return false;
+    memcpy((uint8_t *)backing + address, values, item_count * sizeof(backing_store_int_t));
+    return true;
+}
+
+bool backing_store_lock(void) {
+    return true;
+}
+
+bool backing_store_read(uint32_t address, backing_store_int_t *value) {
+    return backing_store_read_bulk(address, value, 1);
+}
+
+bool backing_store_read_bulk(uint32_t address, backing_store_int_t *values, size_t item_count) {
+    if (address + item_count * sizeof(backing_store_int_t) > sizeof(backing))
+        return false;
+    memcpy(values, (const uint8_t *)backing + address, item_count * sizeof(backing_store_int_t));
+    return true;
+}
@@ -8,8 +8,7 @@
 #endif
 typedef union {
     struct {
-        uint16_t dirty_heap[1024];
-        uint8_t dirty_map[1024]; /* every 128 byte block */
+        uint32_t dirty_map[8 * 1024 / 32]; /* one bit per 128 byte block of all PS1_CARD_SLOTS */
     } ps1;
     struct {
         uint16_t dirty_heap[8 * 1024 * 1024 / 512];
@@ -20,6 +20,65 @@
 #define MAX_CFG_PATH_LENGTH         (64)
 #define CUSTOM_CARDS_CONFIG_PATH    (".sd2psx/Game2Folder.ini")
 
+/* Game2Folder.ini and the per card .ini files are parsed once and kept in RAM
+ * until their size or modification time changes. Whatever does not fit the
+ * caches is looked up in the file, like before, and the last few results of
+ * those lookups are kept as well */
+#define MAX_FOLDER_MAPPINGS         (64)
+#define FOLDER_MAPPING_SLOTS        (128)   // power of 2
+#define FOLDER_LOOKUP_HISTORY       (4)
+#define MAX_MAPPING_SECTION_LENGTH  (4)     // PS1, PS2, PROT, COH
+#define MAX_MAPPING_GAME_ID_LENGTH  (16)
+#define MAX_CARD_CONFIGS            (2)     // boot card and the current one
+#define CHANNEL_NAMES_POOL_SIZE     (256)
+
+typedef struct {
+    uint16_t mdate;
+    uint16_t mtime;
+    size_t size;
+    bool present;
+} config_file_version_t;
+
+typedef struct {
+    uint32_t hash;          // of section and game id
+    char section[MAX_MAPPING_SECTION_LENGTH + 1];
+    char game_id[MAX_MAPPING_GAME_ID_LENGTH + 1];
+    char folder[MAX_FOLDER_NAME_LENGTH + 1];
+} folder_mapping_t;
+
+/* Result of a file lookup past the table, folder is empty when not found */
+typedef struct {
+    bool found;
+    folder_mapping_t mapping;
+} folder_lookup_t;
+
+typedef struct {
+    bool valid;
+    bool overflow;
+    config_file_version_t version;
+    uint8_t count;
+    uint8_t slots[FOLDER_MAPPING_SLOTS];     // index + 1 into mappings, 0 when empty
+    folder_mapping_t mappings[MAX_FOLDER_MAPPINGS];
+    uint8_t lookups_next;
+    folder_lookup_t lookups[FOLDER_LOOKUP_HISTORY];
+} folder_mapping_cache_t;
+
+typedef struct {
+    bool valid;
+    bool overflow;
+    uint32_t last_used;
+    config_file_version_t version;
+    char path[MAX_CFG_PATH_LENGTH];
+    uint8_t card_size;
+    uint8_t max_channels;
+    uint16_t names_used;
+    char names[CHANNEL_NAMES_POOL_SIZE];    // "<channel>\0<name>\0" pairs
+} card_config_cache_t;
+
+static folder_mapping_cache_t folder_mappings;
+static card_config_cache_t card_configs[MAX_CARD_CONFIGS];
+static uint32_t card_config_uses;
+
 typedef struct {
     const char *channel_number;
     char *channel_name;
@@ -56,7 +115,7 @@ static int parse_card_configuration(void *user, const char *section, const char
 
     #define MATCH(s, n) strcmp(section, s) == 0 && strcmp(name, n) == 0
     if (MATCH("ChannelName", ctx->channel_number)) {
-        if (strlen(value) <= ctx->channel_name_max_len) {
+        if (strlen(value) < ctx->channel_name_max_len) {
             strcpy(ctx->channel_name, value);
         }
     } else if (MATCH("Settings", "CardSize")) {
@@ -85,6 +144,117 @@ static int parse_card_configuration(void *user, const char *section, const char
     return 1;
 }
 
+/* FNV-1a over both strings including their terminators */
+static uint32_t config_hash(const char *a, const char *b) {
+    uint32_t hash = 0x811c9dc5;
+
+    do {
+        hash = (hash ^ (uint8_t)*a) * 0x01000193;
+    } while (*a++);
+    do {
+        hash = (hash ^ (uint8_t)*b) * 0x01000193;
+    } while (*b++);
+
+    return hash;
+}
+
+static void config_file_get_version(int fd, config_file_version_t *version) {
+    sd_file_stat_t stat = {};
+
+    memset(version, 0, sizeof(*version));
+    if (fd >= 0) {
+        sd_getStat(fd, &stat);
+        version->mdate = stat.mdate;
+        version->mtime = stat.mtime;
+        version->size = stat.size;
+        version->present = true;
+    }
+}
+
+static bool config_file_changed(const config_file_version_t *a, const config_file_version_t *b) {
+    return (a->present != b->present) || (a->size != b->size) || (a->mdate != b->mdate) || (a->mtime != b->mtime);
+}
+
+static bool folder_mapping_matches(const folder_mapping_t *mapping, uint32_t hash, const char *section, const char *game_id) {
+    return (mapping->hash == hash) && (strcmp(mapping->section, section) == 0) && (strcmp(mapping->game_id, game_id) == 0);
+}
+
+static int find_folder_mapping(uint32_t hash, const char *section, const char *game_id) {
+    for (uint32_t i = 0; i < FOLDER_MAPPING_SLOTS; i++) {
+        uint8_t idx = folder_mappings.slots[(hash + i) & (FOLDER_MAPPING_SLOTS - 1)];
+        if (idx == 0)
+            break;
+        if (folder_mapping_matches(&folder_mappings.mappings[idx - 1], hash, section, game_id))
+            return idx - 1;
+    }
+    return -1;
+}
+
+static folder_lookup_t *find_folder_lookup(uint32_t hash, const char *section, const char *game_id) {
+    for (int i = 0; i < FOLDER_LOOKUP_HISTORY; i++) {
+        folder_lookup_t *lookup = &folder_mappings.lookups[i];
+        if ((lookup->mapping.section[0] != '\0') && folder_mapping_matches(&lookup->mapping, hash, section, game_id))
+            return lookup;
+    }
+    return NULL;
+}
+
+static int cache_folder_mapping(void *user, const char *section, const char *name, const char *value) {
+    uint32_t hash = config_hash(section, name);
+    int idx = find_folder_mapping(hash, section, name);
+    (void)user;
+
+    if (strlen(section) > MAX_MAPPING_SECTION_LENGTH) {
+        /* not a mode, never looked up */
+    } else if ((strlen(name) > MAX_MAPPING_GAME_ID_LENGTH) || (strlen(value) > MAX_FOLDER_NAME_LENGTH)) {
+        folder_mappings.overflow = true;
+    } else if (idx >= 0) {
+        strlcpy(folder_mappings.mappings[idx].folder, value, sizeof(folder_mappings.mappings[idx].folder));
+    } else if (folder_mappings.count == MAX_FOLDER_MAPPINGS) {
+        folder_mappings.overflow = true;
+    } else {
+        folder_mapping_t *mapping = &folder_mappings.mappings[folder_mappings.count];
+        uint32_t slot = hash;
+        while (folder_mappings.slots[slot & (FOLDER_MAPPING_SLOTS - 1)] != 0)
+            slot++;
+        mapping->hash = hash;
+        strlcpy(mapping->section, section, sizeof(mapping->section));
+        strlcpy(mapping->game_id, name, sizeof(mapping->game_id));
+        strlcpy(mapping->folder, value, sizeof(mapping->folder));
+        folder_mappings.slots[slot & (FOLDER_MAPPING_SLOTS - 1)] = ++folder_mappings.count;
+    }
+
+    return 1;
+}
+
+static int cache_card_configuration(void *user, const char *section, const char *name, const char *value) {
+    card_config_cache_t *entry = user;
+    parse_card_config_t ctx = {
+        .channel_number = NULL,
+        .channel_name = NULL,
+        .channel_name_max_len = 0,
+        .card_size = entry->card_size,
+        .max_channels = entry->max_channels
+    };
+
+    if (strcmp(section, "ChannelName") == 0) {
+        size_t name_len = strlen(name) + 1, value_len = strlen(value) + 1;
+        if (entry->names_used + name_len + value_len > CHANNEL_NAMES_POOL_SIZE) {
+            entry->overflow = true;
+        } else {
+            memcpy(&entry->names[entry->names_used], name, name_len);
+            memcpy(&entry->names[entry->names_used + name_len], value, value_len);
+            entry->names_used += name_len + value_len;
+        }
+    } else {
+        parse_card_configuration(&ctx, section, name, value);
+        entry->card_size = ctx.card_size;
+        entry->max_channels = ctx.max_channels;
+    }
+
+    return 1;
+}
+
 static void card_config_get_ini_name(const char* card_folder, const char* card_base, char* config_path) {
     if (settings_get_mode() == MODE_PS1) {
         snprintf(config_path, MAX_CFG_PATH_LENGTH, "MemoryCards/PS1/%s/%s.ini", card_folder, card_base);
@@ -106,73 +276,106 @@ static void card_config_get_ini_name(const char* card_folder, const char* card_b
 
 }
 
-void card_config_read_channel_name(const char* card_folder, const char* card_base, const char* channel_number, char* name, size_t name_max_len) {
-    char config_path[64];
+/* Returns the cached config of the card, parsing the file if it is not cached
+ * or changed since */
+static card_config_cache_t *card_config_load(const char *config_path) {
+    card_config_cache_t *entry = NULL;
+    config_file_version_t version;
     int fd;
 
-    card_config_get_ini_name(card_folder, card_base, config_path);
+    for (int i = 0; i < MAX_CARD_CONFIGS; i++) {
+        if (card_configs[i].valid && (strcmp(card_configs[i].path, config_path) == 0)) {
+            entry = &card_configs[i];
+            break;
+        }
+        if (!entry || (card_configs[i].last_used < entry->last_used))
+            entry = &card_configs[i];
+    }
 
     fd = sd_open(config_path, O_RDONLY);
-    if (fd >= 0) {
-        parse_card_config_t ctx = {
-            .channel_number = channel_number,
-            .channel_name = name,
-            .channel_name_max_len = name_max_len,
-            .card_size = 0,
-            .max_channels = 8
-        };
-        ini_parse_sd_file(fd, parse_card_configuration, &ctx);
-        sd_close(fd);
+    config_file_get_version(fd, &version);
+
+    if (!entry->valid || (strcmp(entry->path, config_path) != 0) || config_file_changed(&entry->version, &version)) {
+        log(LOG_TRACE, "parsing config_path=%s\n", config_path);
+        memset(entry, 0, sizeof(*entry));
+        strlcpy(entry->path, config_path, sizeof(entry->path));
+        entry->version = version;
+        entry->max_channels = 8;
+        if (fd >= 0)
+            ini_parse_sd_file(fd, cache_card_configuration, entry);
+        entry->valid = true;
     }
+    if (fd >= 0)
+        sd_close(fd);
+    entry->last_used = ++card_config_uses;
+
+    return entry;
 }
 
-uint8_t card_config_get_ps2_cardsize(const char* card_folder, const char* card_base) {
-    char config_path[64];
+void card_config_read_channel_name(const char* card_folder, const char* card_base, const char* channel_number, char* name, size_t name_max_len) {
+    char config_path[MAX_CFG_PATH_LENGTH];
+    card_config_cache_t *entry;
+    const char *channel_name = NULL;
     int fd;
-    parse_card_config_t ctx = {
-        .channel_number = NULL,
-        .channel_name = NULL,
-        .channel_name_max_len = 0,
-        .card_size = 0,
-        .max_channels = 8
-    };
 
     card_config_get_ini_name(card_folder, card_base, config_path);
+    entry = card_config_load(config_path);
 
-    fd = sd_open(config_path, O_RDONLY);
-    if (fd >= 0) {
-        ini_parse_sd_file(fd, parse_card_configuration, &ctx);
-        sd_close(fd);
+    /* the last one wins, as when parsing */
+    for (uint16_t pos = 0; pos < entry->names_used; ) {
+        const char *number = &entry->names[pos];
+        const char *value = number + strlen(number) + 1;
+        if (strcmp(number, channel_number) == 0)
+            channel_name = value;
+        pos = (value + strlen(value) + 1) - entry->names;
+    }
+
+    if (channel_name) {
+        if (strlen(channel_name) < name_max_len)
+            strcpy(name, channel_name);
+    } else if (entry->overflow) {
+        fd = sd_open(config_path, O_RDONLY);
+        if (fd >= 0) {
+            parse_card_config_t ctx = {
+                .channel_number = channel_number,
+                .channel_name = name,
+                .channel_name_max_len = name_max_len,
+                .card_size = 0,
+                .max_channels = 8
+            };
+            ini_parse_sd_file(fd, parse_card_configuration, &ctx);
+            sd_close(fd);
+        }
     }
-    return ctx.card_size;
+}
+
+uint8_t card_config_get_ps2_cardsize(const char* card_folder, const char* card_base) {
+    char config_path[MAX_CFG_PATH_LENGTH];
+
+    card_config_get_ini_name(card_folder, card_base, config_path);
+
+    return card_config_load(config_path)->card_size;
 }
 
 uint8_t card_config_get_max_channels(const char* card_folder, const char* card_base) {
     char config_path[MAX_CFG_PATH_LENGTH];
-    int fd;
-    parse_card_config_t ctx = {
-        .channel_number = NULL,
-        .channel_name = NULL,
-        .channel_name_max_len = 0,
-        .card_size = 0,
-        .max_channels = 8
-    };
+    uint8_t max_channels;
 
     card_config_get_ini_name(card_folder, card_base, config_path);
+    max_channels = card_config_load(config_path)->max_channels;
 
-    fd = sd_open(config_path, O_RDONLY);
-    if (fd >= 0) {
-        log(LOG_TRACE, "config_path=%s\n", config_path);
-        ini_parse_sd_file(fd, parse_card_configuration, &ctx);
-        sd_close(fd);
-    }
-    log(LOG_TRACE, "max_channels=%d\n", ctx.max_channels);
-    return ctx.max_channels;
+    log(LOG_TRACE, "max_channels=%d\n", max_channels);
+    return max_channels;
 }
 
 
 void card_config_get_card_folder(const char* game_id, char* card_folder, size_t card_folder_max_len) {
     char mode[6];
+    config_file_version_t version;
+    folder_lookup_t *lookup;
+    uint32_t hash;
+    int fd;
+    int idx;
     parse_custom_card_folder_t ctx = {
         .game_id = game_id,
         .mode = mode,
@@ -196,13 +399,49 @@ void card_config_get_card_folder(const char* game_id, char* card_folder, size_t
             break;
         }
     }
-    int fd = sd_open(CUSTOM_CARDS_CONFIG_PATH, O_RDONLY);
     log(LOG_TRACE, "Looking for game_id=%s mode=%s \n", game_id, ctx.mode);
 
-    if (fd >= 0) {
-        ini_parse_sd_file(fd, parse_custom_card_folder, &ctx);
-        sd_close(fd);
+    fd = sd_open(CUSTOM_CARDS_CONFIG_PATH, O_RDONLY);
+    config_file_get_version(fd, &version);
+    if (!folder_mappings.valid || config_file_changed(&folder_mappings.version, &version)) {
+        memset(&folder_mappings, 0, sizeof(folder_mappings));
+        folder_mappings.version = version;
+        if (fd >= 0)
+            ini_parse_sd_file(fd, cache_folder_mapping, NULL);
+        folder_mappings.valid = true;
+        log(LOG_TRACE, "cached %u folder mappings\n", folder_mappings.count);
+    }
+
+    hash = config_hash(mode, game_id);
+    idx = find_folder_mapping(hash, mode, game_id);
+    if (idx >= 0) {
+        if (strlen(folder_mappings.mappings[idx].folder) <= card_folder_max_len)
+            strlcpy(card_folder, folder_mappings.mappings[idx].folder, card_folder_max_len);
+    } else if (folder_mappings.overflow && (lookup = find_folder_lookup(hash, mode, game_id))) {
+        if (lookup->found && (strlen(lookup->mapping.folder) <= card_folder_max_len))
+            strlcpy(card_folder, lookup->mapping.folder, card_folder_max_len);
+    } else if (folder_mappings.overflow && (fd >= 0)) {
+        sd_seek(fd, 0, SEEK_SET);
+        if (strlen(game_id) > MAX_MAPPING_GAME_ID_LENGTH) {
+            ini_parse_sd_file(fd, parse_custom_card_folder, &ctx);
+        } else {
+            /* scanned into the history entry, then handed out like a table hit */
+            lookup = &folder_mappings.lookups[folder_mappings.lookups_next];
+            folder_mappings.lookups_next = (folder_mappings.lookups_next + 1) % FOLDER_LOOKUP_HISTORY;
+            memset(lookup, 0, sizeof(*lookup));
+            ctx.card_folder = lookup->mapping.folder;
+            ctx.card_folder_max_len = sizeof(lookup->mapping.folder);
+            ini_parse_sd_file(fd, parse_custom_card_folder, &ctx);
+            lookup->found = (lookup->mapping.folder[0] != '\0');
+            lookup->mapping.hash = hash;
+            strlcpy(lookup->mapping.section, mode, sizeof(lookup->mapping.section));
+            strlcpy(lookup->mapping.game_id, game_id, sizeof(lookup->mapping.game_id));
+            if (lookup->found && (strlen(lookup->mapping.folder) <= card_folder_max_len))
+                strlcpy(card_folder, lookup->mapping.folder, card_folder_max_len);
+        }
     }
+    if (fd >= 0)
+        sd_close(fd);
 
     log(LOG_TRACE, "found card_folder=%s\n", card_folder);
 }
@@ -13,6 +13,7 @@
 #define LOG_LEVEL_PS2_MAIN   2
 #define LOG_LEVEL_PS2_MC     2
 #define LOG_LEVEL_PS2_HT     2
+#define LOG_LEVEL_PS2_SI     2
 #define LOG_LEVEL_PS2_S2M    2
 #define LOG_LEVEL_GUI        2
 #define LOG_LEVEL_CARD_CONF  2
@@ -1,12 +1,10 @@
 
 #include "game_db.h"
 
-#include <ctype.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include "pico/platform.h"
@@ -20,65 +18,97 @@
 #define MAX_STRING_ID_LENGTH (10)
 #define MAX_PATH_LENGTH      (64)
 
+#define DB_MAGIC             "GMDB"
+#define DB_VERSION           (4)
+#define DB_HEADER_SIZE       (48)
+#define DB_GAME_ENTRY_SIZE   (12)
+#define DB_NAME_BLOCK_SIZE   (16)
+#define DB_MAX_GAME_ID       (0xFFFFFF)
+#define DB_NO_NAME           (UINT32_MAX)
+
 extern const char _binary_gamedbps1_dat_start, _binary_gamedbps1_dat_size;
 extern const char _binary_gamedbps2_dat_start, _binary_gamedbps2_dat_size;
 extern const char _binary_gamedbcoh_dat_start, _binary_gamedbcoh_dat_size;
 
+typedef struct {
+    uint32_t num_buckets;
+    uint32_t num_slots;
+    uint32_t num_games;
+    uint32_t seed;
+    uint32_t num_prefixes;
+    uint32_t prefixes_offset;
+    uint32_t buckets_offset;
+    uint32_t games_offset;
+    uint32_t num_names;
+    uint32_t name_blocks_offset;
+} game_db_header;
+
 typedef struct {
     size_t offset;
     uint32_t game_id;
     uint32_t parent_id;
     int mode;
     int id_length;
-    const char* name;
+    const char* db_start;
+    size_t db_size;
+    uint32_t name_index;
     char prefix[MAX_PREFIX_LENGTH];
 } game_lookup;
 
 static game_lookup current_game;
 
-bool __time_critical_func(game_db_sanity_check_title_id)(const char* const title_id) {
-    uint8_t i = 0U;
+/* Letters, then an optional run of '-', then up to 9 digits. A '-' may end
+ * the ID early, anything after it is ignored. Leading '-'s are skipped, like
+ * strtok did */
+bool __time_critical_func(game_db_parse_title_id)(const char* const title_id, game_db_title_id_t* const parsed) {
+    size_t i = 0U, prefix_length = 0U;
 
-    if ((settings_get_mode() == MODE_PS2) && (settings_get_ps2_variant() == PS2_VARIANT_COH)) {
-        if ((title_id[0] != 'N') || (title_id[1] != 'M')) {
-            return false;
-        } else {
-            i = 2;
-            while (title_id[i] != 0x00) {
-                if (!isdigit((int)title_id[i])) {
-                    return false;
-                }
-                i++;
-            }
+    memset(parsed, 0x00, sizeof(*parsed));
 
-        }
-    } else {
-        char splittable_game_id[MAX_GAME_ID_LENGTH];
-        strlcpy(splittable_game_id, title_id, MAX_GAME_ID_LENGTH);
-        char* prefix = strtok(splittable_game_id, "-");
-        char* id = strtok(NULL, "-");
-
-        while (prefix[i] != 0x00) {
-            if (!isalpha((int)prefix[i])) {
-                return false;
-            }
-            i++;
-        }
-        if (i == 0) {
-            return false;
-        } else {
-            i = 0;
-        }
+    if (title_id == NULL)
+        return false;
 
-        while (id[i] != 0x00) {
-            if (!isdigit((int)id[i])) {
-                return false;
-            }
-            i++;
-        }
+    while (title_id[i] == '-')
+        i++;
+
+    while (((title_id[i] >= 'A') && (title_id[i] <= 'Z')) || ((title_id[i] >= 'a') && (title_id[i] <= 'z'))) {
+        if (prefix_length < sizeof(parsed->prefix) - 1)
+            parsed->prefix[prefix_length++] = title_id[i] & ~0x20;
+        i++;
+    }
+    if (prefix_length == 0)
+        return false;
+
+    while (title_id[i] == '-') {
+        parsed->separated = true;
+        i++;
+    }
+
+    while ((title_id[i] >= '0') && (title_id[i] <= '9')) {
+        if (parsed->id_length == 9)
+            return false;
+        parsed->numeric_id = parsed->numeric_id * 10 + (title_id[i] - '0');
+        parsed->id_length++;
+        i++;
     }
 
-    return (i > 0);
+    return (parsed->id_length > 0) && ((title_id[i] == 0x00) || (title_id[i] == '-'));
+}
+
+/* Arcade IDs are an upper case NM directly followed by the digits */
+static bool __time_critical_func(game_db_parse_arcade_id)(const char* const title_id, game_db_title_id_t* const parsed) {
+    return game_db_parse_title_id(title_id, parsed)
+        && (title_id[0] == 'N') && (title_id[1] == 'M')
+        && (title_id[2 + parsed->id_length] == 0x00);
+}
+
+bool __time_critical_func(game_db_sanity_check_title_id)(const char* const title_id) {
+    game_db_title_id_t parsed;
+
+    if ((settings_get_mode() == MODE_PS2) && (settings_get_ps2_variant() == PS2_VARIANT_COH))
+        return game_db_parse_arcade_id(title_id, &parsed);
+    else
+        return game_db_parse_title_id(title_id, &parsed) && parsed.separated;
 }
 
 #pragma GCC diagnostic ignored "-Warray-bounds"
@@ -90,119 +120,199 @@ static uint32_t game_db_char_array_to_uint32(const char in[4]) {
 }
 #pragma GCC diagnostic pop
 
-static uint32_t game_db_find_prefix_offset(uint32_t numericPrefix, const char* const db_start) {
-    uint32_t offset = UINT32_MAX;
+/* FNV-1a and the murmur3 finalizer, same as gameHash in database/gamedb_writer.py */
+static uint32_t game_db_hash(const char prefix[4], uint32_t numeric_id, uint32_t seed) {
+    uint32_t hash = 0x811c9dc5 ^ seed;
 
-    const char* pointer = db_start;
+    for (uint8_t i = 0; i < 4; i++) {
+        hash ^= (uint8_t)prefix[i];
+        hash *= 0x01000193;
+    }
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        hash ^= (numeric_id >> shift) & 0xFF;
+        hash *= 0x01000193;
+    }
 
-    while (offset == UINT32_MAX) {
-        uint32_t currentprefix = game_db_char_array_to_uint32(pointer), currentoffset = game_db_char_array_to_uint32(&pointer[4]);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
 
-        if (currentprefix == numericPrefix) {
-            offset = currentoffset;
-        }
-        if ((currentprefix == 0U) && (currentoffset == 0U)) {
-            break;
-        }
-        pointer += 8;
+    return hash;
+}
+
+/* See database/gamedb_writer.py for the layout */
+static bool game_db_read_header(const char* const db_start, const size_t db_size, game_db_header* header) {
+    if ((db_size < DB_HEADER_SIZE)
+        || (memcmp(db_start, DB_MAGIC, 4) != 0)
+        || (game_db_char_array_to_uint32(&db_start[4]) != DB_VERSION))
+        return false;
+
+    header->num_buckets = game_db_char_array_to_uint32(&db_start[8]);
+    header->num_slots = game_db_char_array_to_uint32(&db_start[12]);
+    header->num_games = game_db_char_array_to_uint32(&db_start[16]);
+    header->seed = game_db_char_array_to_uint32(&db_start[20]);
+    header->num_prefixes = game_db_char_array_to_uint32(&db_start[24]);
+    header->prefixes_offset = game_db_char_array_to_uint32(&db_start[28]);
+    header->buckets_offset = game_db_char_array_to_uint32(&db_start[32]);
+    header->games_offset = game_db_char_array_to_uint32(&db_start[36]);
+    header->num_names = game_db_char_array_to_uint32(&db_start[40]);
+    header->name_blocks_offset = game_db_char_array_to_uint32(&db_start[44]);
+
+    return (header->num_games != 0) && (header->num_games <= header->num_slots)
+        && ((header->num_buckets != 0) || (header->num_games == header->num_slots))
+        && (header->prefixes_offset <= db_size) && (header->num_prefixes <= (db_size - header->prefixes_offset) / 4)
+        && (header->buckets_offset <= db_size) && (header->num_buckets <= (db_size - header->buckets_offset) / 2)
+        && (header->games_offset <= db_size) && (header->num_slots <= (db_size - header->games_offset) / DB_GAME_ENTRY_SIZE)
+        && (header->name_blocks_offset <= db_size)
+        && ((header->num_names + DB_NAME_BLOCK_SIZE - 1) / DB_NAME_BLOCK_SIZE <= (db_size - header->name_blocks_offset) / 4);
+}
+
+/* Entries start with the prefix index + 1 in the top byte and the ID below,
+ * 0 if the prefix is not in the DB or the ID cannot be */
+static uint32_t game_db_entry_key(const char* const db_start, const game_db_header* header, const char prefix[4], uint32_t numeric_id) {
+    if (numeric_id > DB_MAX_GAME_ID)
+        return 0;
+
+    for (uint32_t i = 0; i < header->num_prefixes; i++) {
+        if (memcmp(&db_start[header->prefixes_offset + i * 4], prefix, 4) == 0)
+            return ((i + 1) << 24) | numeric_id;
     }
 
+    return 0;
+}
+
+/* Binary search over the entries, which are sorted when the DB was written
+ * without a hash, see gamedb_writer.py */
+static uint32_t game_db_search_game_offset(const char* const db_start, const game_db_header* header, uint32_t key) {
+    uint32_t lo = 0, hi = header->num_games;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t offset = header->games_offset + mid * DB_GAME_ENTRY_SIZE;
+        uint32_t current_key = game_db_char_array_to_uint32(&db_start[offset]);
+
+        if (current_key == key)
+            return offset;
+        if (current_key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return UINT32_MAX;
+}
+
+/* Perfect hash over (prefix, ID) */
+static uint32_t game_db_find_game_offset(const char* const db_start, const game_db_header* header, const char prefix[4], uint32_t numeric_id) {
+    uint32_t bucket, slot, offset;
+    uint16_t displacement;
+    uint32_t key = game_db_entry_key(db_start, header, prefix, numeric_id);
+
+    if (key == 0)
+        return UINT32_MAX;
+
+    if (header->num_buckets == 0)
+        return game_db_search_game_offset(db_start, header, key);
+
+    bucket = game_db_hash(prefix, numeric_id, header->seed) % header->num_buckets;
+    offset = header->buckets_offset + bucket * 2;
+    displacement = ((uint8_t)db_start[offset] << 8) | (uint8_t)db_start[offset + 1];
+    slot = game_db_hash(prefix, numeric_id, displacement) % header->num_slots;
+    offset = header->games_offset + slot * DB_GAME_ENTRY_SIZE;
+
+    /* IDs that are not in the DB land on some other entry or an empty slot */
+    if (game_db_char_array_to_uint32(&db_start[offset]) != key)
+        return UINT32_MAX;
+
     return offset;
 }
 
-static game_lookup build_game_lookup(const char* const db_start, const size_t db_size, const size_t offset) {
-    game_lookup game = {};
-    size_t name_offset;
-    game.game_id = game_db_char_array_to_uint32(&(db_start)[offset]);
-    game.offset = offset;
-    game.parent_id = game_db_char_array_to_uint32(&(db_start)[offset + 8]);
-    name_offset = game_db_char_array_to_uint32(&(db_start)[offset + 4]);
-    if ((name_offset < db_size) && ((db_start)[name_offset] != 0x00))
-        game.name = &((db_start)[name_offset]);
-    else
-        game.name = NULL;
+/* Names are front coded in blocks, decoding one walks its block up to it */
+static void game_db_read_name(const char* const db_start, const size_t db_size, uint32_t name_index, char* const name, const size_t name_size) {
+    game_db_header header;
+    size_t pos, length = 0;
 
-    return game;
+    name[0] = 0x00;
+
+    if (!game_db_read_header(db_start, db_size, &header) || (name_index >= header.num_names))
+        return;
+
+    pos = game_db_char_array_to_uint32(&db_start[header.name_blocks_offset + (name_index / DB_NAME_BLOCK_SIZE) * 4]);
+
+    for (uint32_t i = 0; i <= name_index % DB_NAME_BLOCK_SIZE; i++) {
+        if (pos >= db_size)
+            break;
+        uint8_t shared = (uint8_t)db_start[pos++];
+        length = MIN(shared, length);
+        while ((pos < db_size) && (db_start[pos] != 0x00)) {
+            if (length < name_size - 1)
+                name[length++] = db_start[pos];
+            pos++;
+        }
+        pos++;
+    }
+
+    name[length] = 0x00;
 }
 
-static game_lookup build_arcade_lookup(const char* const db_start, const size_t db_size, const size_t offset) {
+static game_lookup build_game_lookup(const char* const db_start, const size_t db_size, const size_t offset) {
     game_lookup game = {};
-    size_t name_offset;
-    game.game_id = game_db_char_array_to_uint32(&(db_start)[offset]);
+    game.game_id = game_db_char_array_to_uint32(&(db_start)[offset]) & DB_MAX_GAME_ID;
     game.offset = offset;
-    game.parent_id = game.game_id;
-    name_offset = game_db_char_array_to_uint32(&(db_start)[offset + 4]);
-    if ((name_offset < db_size) && ((db_start)[name_offset] != 0x00))
-        game.name = &((db_start)[name_offset]);
-    else
-        game.name = NULL;
+    game.parent_id = game_db_char_array_to_uint32(&(db_start)[offset + 8]);
+    game.db_start = db_start;
+    game.db_size = db_size;
+    game.name_index = game_db_char_array_to_uint32(&(db_start)[offset + 4]);
 
     return game;
 }
 
-static game_lookup find_game_lookup(const char* game_id, int mode) {
-    char prefixString[MAX_PREFIX_LENGTH] = {};
-    char idString[10] = {};
-    uint32_t numeric_id = 0, numeric_prefix = 0;
-
-    const char* const db_start = mode == MODE_PS1 ? &_binary_gamedbps1_dat_start : &_binary_gamedbps2_dat_start;
-    const char* const db_size = mode == MODE_PS1 ? &_binary_gamedbps1_dat_size : &_binary_gamedbps2_dat_size;
-
-    uint32_t prefixOffset = 0;
-    game_lookup ret = {
+/* Prefixes are stored padded with ws to 4 chars */
+static game_lookup find_db_lookup(const char* const db_start, const size_t db_size, const char* const prefix, uint32_t numeric_id) {
+    char padded_prefix[4] = {' ', ' ', ' ', ' '};
+    game_db_header header;
+    uint32_t offset;
+    game_lookup game = {
         .game_id = 0U,
         .parent_id = 0U,
         .mode = -1,
         .id_length = 0,
-        .name = NULL,
+        .name_index = DB_NO_NAME,
         .prefix = {}
     };
 
+    for (uint8_t i = 0; (i < 4) && prefix[i]; i++)
+        padded_prefix[i] = prefix[i];
 
-    if (game_id != NULL && game_id[0]) {
-        char* copy = strdup(game_id);
-        char* split = strtok(copy, "-");
-
-        if (strlen(split) > 0) {
-            strlcpy(prefixString, split, MAX_PREFIX_LENGTH);
-            for (uint8_t i = 0; i < MAX_PREFIX_LENGTH - 1; i++) {
-                prefixString[i] = toupper((unsigned char)prefixString[i]);
-            }
+    if ((numeric_id != 0) && game_db_read_header(db_start, db_size, &header)) {
+        offset = game_db_find_game_offset(db_start, &header, padded_prefix, numeric_id);
+        if (offset != UINT32_MAX) {
+            game = build_game_lookup(db_start, db_size, offset);
+            DPRINTF("Found ID - Name Index: %u, Parent ID: %d\n", (unsigned)game.name_index, game.parent_id);
         }
-
-        split = strtok(NULL, "-");
-
-        if (strlen(split) > 0) {
-            strlcpy(idString, split, 11);
-            numeric_id = atoi(idString);
-        }
-
-        free(copy);
     }
 
-    numeric_prefix = game_db_char_array_to_uint32(prefixString);
+    return game;
+}
+
+static game_lookup find_game_lookup(const char* game_id, int mode) {
+    game_db_title_id_t parsed;
 
-    if (numeric_id != 0) {
+    const char* const db_start = mode == MODE_PS1 ? &_binary_gamedbps1_dat_start : &_binary_gamedbps2_dat_start;
+    const char* const db_size = mode == MODE_PS1 ? &_binary_gamedbps1_dat_size : &_binary_gamedbps2_dat_size;
 
-        prefixOffset = game_db_find_prefix_offset(numeric_prefix, db_start);
+    game_lookup ret;
 
-        if (prefixOffset < (size_t)db_size) {
-            uint32_t offset = prefixOffset;
-            game_lookup game;
-            do {
-                game = build_game_lookup(db_start, (size_t)db_size, offset);
+    if (!game_db_parse_title_id(game_id, &parsed) || !parsed.separated)
+        parsed.numeric_id = 0;
 
-                if (game.game_id == numeric_id) {
-                    ret = game;
-                    DPRINTF("Found ID - Name Offset: %d, Parent ID: %d\n", (int)game.name, game.parent_id);
-                    DPRINTF("Name:%s\n", game.name);
-                    ret.mode = mode;
-                    ret.id_length = strlen(idString);
-                    memcpy(ret.prefix, prefixString, 4);
-                }
-                offset += 12;
-            } while ((game.game_id != 0) && (offset < (size_t)db_size) && (ret.game_id == 0));
-        }
+    ret = find_db_lookup(db_start, (size_t)db_size, parsed.prefix, parsed.numeric_id);
+    if (ret.game_id != 0) {
+        ret.mode = mode;
+        ret.id_length = parsed.id_length;
+        memcpy(ret.prefix, parsed.prefix, 4);
     }
 
     return ret;
@@ -210,47 +320,21 @@ static game_lookup find_game_lookup(const char* game_id, int mode) {
 
 
 static game_lookup find_arcade_lookup(const char* game_id) {
-    char idString[10] = {};
-    uint32_t numeric_id = 0;
+    game_db_title_id_t parsed;
 
     const char* const db_start = &_binary_gamedbcoh_dat_start;
     const char* const db_size = &_binary_gamedbcoh_dat_size;
 
-    game_lookup ret = {
-        .game_id = 0U,
-        .parent_id = 0U,
-        .mode = -1,
-        .id_length = 0,
-        .name = NULL,
-        .prefix = {}
-    };
+    game_lookup ret;
 
+    if (!game_db_parse_arcade_id(game_id, &parsed))
+        parsed.numeric_id = 0;
 
-    if (game_id != NULL && game_id[0] == 'N' && game_id[1] == 'M') {
-        strlcpy(idString, &game_id[2], 10);
-        numeric_id = atoi(idString);
-    }
-
-    if (numeric_id != 0) {
-
-        uint32_t offset = 0;
-        game_lookup game;
-        do {
-            game = build_arcade_lookup(db_start, (size_t)db_size, offset);
-
-            if (game.game_id == numeric_id) {
-                ret = game;
-                DPRINTF("Found ID - Name Offset: %d, Parent ID: %d\n", (int)game.name, game.parent_id);
-                DPRINTF("Name:%s\n", game.name);
-                ret.mode = MODE_PS2;
-                ret.id_length = strlen(idString);
-                memcpy(ret.prefix, "NM", 2);
-            } else {
-                DPRINTF("Game ID: %d - %s\n", game.game_id, game.name);
-            }
-            offset += 8;
-        } while ((game.game_id != 0) && (offset < (size_t)db_size) && (ret.game_id == 0));
-
+    ret = find_db_lookup(db_start, (size_t)db_size, "NM", parsed.numeric_id);
+    if (ret.game_id != 0) {
+        ret.mode = MODE_PS2;
+        ret.id_length = parsed.id_length;
+        memcpy(ret.prefix, "NM", 2);
     }
 
     return ret;
@@ -280,8 +364,8 @@ void __time_critical_func(game_db_extract_title_id)(const uint8_t* const in_titl
 void game_db_get_current_name(char* const game_name) {
     strlcpy(game_name, "", MAX_GAME_NAME_LENGTH);
 
-    if ((current_game.name != NULL) && (current_game.name[0] != 0)) {
-        strlcpy(game_name, current_game.name, MAX_GAME_NAME_LENGTH);
+    if (current_game.name_index != DB_NO_NAME) {
+        game_db_read_name(current_game.db_start, current_game.db_size, current_game.name_index, game_name, MAX_GAME_NAME_LENGTH);
     }
 }
 
@@ -309,7 +393,7 @@ int game_db_update_game(const char* const game_id) {
         current_game = find_game_lookup(game_id, MODE_PS1);
     }
 
-    if (current_game.name == NULL)
+    if (current_game.name_index == DB_NO_NAME)
     {
         current_game.parent_id = current_game.game_id;
     }
@@ -321,7 +405,7 @@ int game_db_update_arcade(const char* const game_id) {
 
     current_game = find_arcade_lookup(game_id);
 
-    if (current_game.name == NULL)
+    if (current_game.name_index == DB_NO_NAME)
     {
         current_game.parent_id = current_game.game_id;
     }
@@ -330,17 +414,21 @@ int game_db_update_arcade(const char* const game_id) {
 }
 
 void game_db_get_game_name(const char* game_id, char* game_name) {
+    char name[MAX_GAME_NAME_LENGTH];
+    game_lookup lookup;
+
     if (!game_db_sanity_check_title_id(game_id))
         return;
 
-    if ((settings_get_mode() == MODE_PS2) && (settings_get_ps2_variant() == PS2_VARIANT_COH)) {
-        game_lookup lookup = find_arcade_lookup(game_id);
-        if (lookup.name && lookup.name[0])
-            strlcpy(game_name, lookup.name, MAX_GAME_NAME_LENGTH);
-    } else {
-        game_lookup lookup = find_game_lookup(game_id, settings_get_mode());
-        if (lookup.name && lookup.name[0])
-            strlcpy(game_name, lookup.name, MAX_GAME_NAME_LENGTH);
+    if ((settings_get_mode() == MODE_PS2) && (settings_get_ps2_variant() == PS2_VARIANT_COH))
+        lookup = find_arcade_lookup(game_id);
+    else
+        lookup = find_game_lookup(game_id, settings_get_mode());
+
+    if (lookup.name_index != DB_NO_NAME) {
+        game_db_read_name(lookup.db_start, lookup.db_size, lookup.name_index, name, sizeof(name));
+        if (name[0])
+            strlcpy(game_name, name, MAX_GAME_NAME_LENGTH);
     }
 }
 
@@ -349,6 +437,6 @@ void game_db_init(void) {
     current_game.parent_id = 0U;
     current_game.mode = -1;
     current_game.id_length = 0;
-    current_game.name = NULL;
+    current_game.name_index = DB_NO_NAME;
     memset(current_game.prefix, 0x00, MAX_PREFIX_LENGTH);
 }
\ No newline at end of file
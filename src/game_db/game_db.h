@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <pico/platform.h>
@@ -7,6 +8,15 @@
 
 #define MAX_GAME_ID_LENGTH   (16)
 
+/* A title ID like SLUS-20002 or NM00003, split into its parts */
+typedef struct {
+    char prefix[5];         // upper case, only the first 4 letters are kept
+    uint32_t numeric_id;
+    uint8_t id_length;      // digits in the ID, leading zeros included
+    bool separated;         // prefix and ID were separated by a '-'
+} game_db_title_id_t;
+
+bool game_db_parse_title_id(const char* const title_id, game_db_title_id_t* const parsed);
 void game_db_extract_title_id(const uint8_t* const in_title_id, char* const out_title_id, const size_t in_title_id_length, const size_t out_buffer_size);
 bool game_db_sanity_check_title_id(const char* const title_id);
 
@@ -44,6 +44,7 @@ void ps1_init() {
 bool ps1_task() {
     ps1_odeman_task();
     ps1_dirty_task();
+    ps1_cardman_task();
 
 #if WITH_GUI
     gui_task();
@@ -67,6 +68,7 @@ void ps1_deinit(void) {
     while(ps1_dirty_activity)
         ps1_dirty_task();
     ps1_cardman_close();
+    ps1_cardman_unload();
     multicore_reset_core1();
     ps1_memory_card_unload();
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include "card_config.h"
 
+#include "ps1_dirty.h"
 #include "ps1_mc_data_interface.h"
 #include "sd.h"
 #include "debug.h"
@@ -21,10 +22,31 @@
 
 #include "hardware/timer.h"
 
-#define CARD_SIZE (128 * 1024)
+#define CARD_SIZE PS1_CARD_SIZE
 #define BLOCK_SIZE 128
-static uint8_t flushbuf[BLOCK_SIZE];
-static int fd = -1;
+/* the card is loaded and created in extents of this many blocks, PSRAM
+ * gets them in 1 KB transfers */
+#define EXTENT_BLOCKS 64
+#define PSRAM_CHUNK 1024
+static uint8_t flushbuf[BLOCK_SIZE * EXTENT_BLOCKS];
+
+/* Every channel of the folder that exists on the SD card stays loaded in a
+ * slot of its own, switching between them only changes the active slot */
+static int slot_fd[PS1_CARD_SLOTS];
+static int slot_chan[PS1_CARD_SLOTS]; /* 0 when unused */
+static int active_slot;
+static char resident_folder[MAX_FOLDER_NAME_LENGTH];
+static ps1_cardman_state_t resident_state;
+
+/* The other channels are loaded from ps1_cardman_task once the active one
+ * is served, the slot of the one in progress is not in use yet */
+static bool preload_pending;
+static struct {
+    int slot;
+    int chan; /* 0 when idle */
+    int fd;
+    size_t pos;
+} preload;
 
 #define IDX_MIN 1
 #define CHAN_MIN 1
@@ -109,39 +131,53 @@ static bool try_set_prev_named_card() {
 }
 
 void ps1_cardman_init(void) {
+    named_card_folders_invalidate();
+    for (int i = 0; i < PS1_CARD_SLOTS; i++) {
+        slot_fd[i] = -1;
+        slot_chan[i] = 0;
+    }
     if (!try_set_boot_card() && !try_set_game_id_card())
         set_default_card();
 }
 
-int ps1_cardman_read_sector(int sector, void *buf128) {
+int ps1_cardman_read_sectors(int sector, int count, void *buf) {
+    if ((sector < 0) || (sector >= PS1_CARD_SLOTS * PS1_CARD_PAGES))
+        return -1;
+
+    int fd = slot_fd[sector / PS1_CARD_PAGES];
     if (fd < 0)
         return -1;
 
-    if (sd_seek(fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
+    if (sd_seek(fd, (sector % PS1_CARD_PAGES) * BLOCK_SIZE, SEEK_SET) != 0)
         return -2;
 
-    if (sd_read(fd, buf128, BLOCK_SIZE) != BLOCK_SIZE)
+    if (sd_read(fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
         return -3;
 
     return 0;
 }
 
-int ps1_cardman_write_sector(int sector, void *buf512) {
+int ps1_cardman_write_sectors(int sector, int count, void *buf) {
+    if ((sector < 0) || (sector >= PS1_CARD_SLOTS * PS1_CARD_PAGES))
+        return -1;
+
+    int fd = slot_fd[sector / PS1_CARD_PAGES];
     if (fd < 0)
         return -1;
 
-    if (sd_seek(fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
+    if (sd_seek(fd, (sector % PS1_CARD_PAGES) * BLOCK_SIZE, SEEK_SET) != 0)
         return -1;
 
-    if (sd_write(fd, buf512, BLOCK_SIZE) != BLOCK_SIZE)
+    if (sd_write(fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
         return -1;
 
     return 0;
 }
 
 void ps1_cardman_flush(void) {
-    if (fd >= 0)
-        sd_flush(fd);
+    for (int i = 0; i < PS1_CARD_SLOTS; i++)
+        if (slot_fd[i] >= 0)
+            sd_flush(slot_fd[i]);
 }
 
 static void ensuredirs(void) {
@@ -164,68 +200,102 @@ static void genblock(size_t pos, void *buf) {
         memcpy(buf, &ps1_empty_card[pos], BLOCK_SIZE);
 }
 
-void ps1_cardman_open(void) {
-    char path[96];
-    sd_init();
-    ensuredirs();
+static uint8_t get_max_channels(void) {
+    return card_config_get_max_channels(folder_name, (cardman_state == PS1_CM_STATE_BOOT) ? "BootCard" : folder_name);
+}
 
+static void get_card_path(int chan, char *path, size_t size) {
     switch (cardman_state) {
         case PS1_CM_STATE_BOOT:
-            if (card_chan == 1) {
-                snprintf(path, sizeof(path), "MemoryCards/PS1/%s/BootCard-%d.mcd", folder_name, card_chan);
+            if (chan == 1) {
+                snprintf(path, size, "MemoryCards/PS1/%s/BootCard-%d.mcd", folder_name, chan);
                 if (!sd_exists(path)) {
                     // before boot card channels, boot card was located at BOOT/BootCard.mcd, for backwards compatibility check if it exists
-                    snprintf(path, sizeof(path), "MemoryCards/PS1/%s/BootCard.mcd", folder_name);
+                    snprintf(path, size, "MemoryCards/PS1/%s/BootCard.mcd", folder_name);
                     if (!sd_exists(path)) {
                         // go back to BootCard-1.mcd if it doesn't
-                        snprintf(path, sizeof(path), "MemoryCards/PS1/%s/BootCard-%d.mcd", folder_name, card_chan);
+                        snprintf(path, size, "MemoryCards/PS1/%s/BootCard-%d.mcd", folder_name, chan);
                     }
                 }
             } else {
-                snprintf(path, sizeof(path), "MemoryCards/PS1/%s/BootCard-%d.mcd", folder_name, card_chan);
+                snprintf(path, size, "MemoryCards/PS1/%s/BootCard-%d.mcd", folder_name, chan);
             }
-
-            settings_set_ps1_boot_channel(card_chan);
             break;
         case PS1_CM_STATE_NAMED:
         case PS1_CM_STATE_GAMEID:
-            snprintf(path, sizeof(path), "MemoryCards/PS1/%s/%s-%d.mcd", folder_name, folder_name, card_chan);
-            break;
         case PS1_CM_STATE_NORMAL:
-            snprintf(path, sizeof(path), "MemoryCards/PS1/%s/%s-%d.mcd", folder_name, folder_name, card_chan);
-
-            /* this is ok to do on every boot because it wouldn't update if the value is the same as currently stored */
-            settings_set_ps1_card(card_idx);
-            settings_set_ps1_channel(card_chan);
+            snprintf(path, size, "MemoryCards/PS1/%s/%s-%d.mcd", folder_name, folder_name, chan);
             break;
     }
+}
+
+/* Sectors marked dirty are written out with the fd of their slot, which
+ * has to stay open until they are */
+static void drain_dirty(void) {
+    do {
+        ps1_dirty_task();
+    } while (ps1_dirty_activity);
+}
+
+#if WITH_PSRAM
+/* The active card may be in use, PSRAM is only taken a chunk at a time */
+static void store_extent(int slot, size_t pos) {
+    for (size_t off = 0; off < sizeof(flushbuf); off += PSRAM_CHUNK) {
+        psram_segment_t seg = { slot * CARD_SIZE + pos + off, flushbuf + off, PSRAM_CHUNK };
+
+        ps1_dirty_lock();
+        psram_write_list_dma(&seg, 1, NULL);
+        psram_wait_for_dma();
+        ps1_dirty_unlock();
+    }
+}
+#endif
 
-    printf("Switching to card path = %s\n", path);
+static void unload_slot(int slot) {
+    if (slot_fd[slot] >= 0) {
+        sd_flush(slot_fd[slot]);
+        sd_close(slot_fd[slot]);
+    }
+    slot_fd[slot] = -1;
+    slot_chan[slot] = 0;
+}
+
+/* Loads the image of a channel into its slot, a missing image is only
+ * created when asked to */
+static bool load_slot(int slot, int chan, bool create) {
+    char path[96];
+    int fd;
+
+    get_card_path(chan, path, sizeof(path));
 
     if (!sd_exists(path)) {
+        if (!create)
+            return false;
+
         fd = sd_open(path, O_RDWR | O_CREAT | O_TRUNC);
+        named_card_folders_invalidate();
 
         if (fd < 0)
             fatal("cannot open for creating new card");
 
+        // reserve the whole image up front so it ends up contiguous
+        if (sd_preallocate(fd, CARD_SIZE) != 0)
+            printf("could not preallocate card image\n");
+
         printf("create new image at %s... ", path);
         uint64_t cardprog_start = time_us_64();
 
-        for (size_t pos = 0; pos < CARD_SIZE; pos += BLOCK_SIZE) {
-            genblock(pos, flushbuf);
+        for (size_t pos = 0; pos < CARD_SIZE; pos += sizeof(flushbuf)) {
+            for (size_t off = 0; off < sizeof(flushbuf); off += BLOCK_SIZE)
+                genblock(pos + off, flushbuf + off);
 #if WITH_PSRAM
-            psram_write_dma(pos, flushbuf, BLOCK_SIZE, NULL);
+            store_extent(slot, pos);
 #endif
-            if (sd_write(fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
+            if (sd_write(fd, flushbuf, sizeof(flushbuf)) != (int)sizeof(flushbuf))
                 fatal("cannot init memcard");
-#if WITH_PSRAM
-            psram_wait_for_dma();
-#endif
         }
         sd_flush(fd);
 
-        ps1_mc_data_interface_card_changed();
-
         uint64_t end = time_us_64();
         printf("OK!\n");
 
@@ -238,37 +308,203 @@ void ps1_cardman_open(void) {
         if (fd < 0)
             fatal("cannot open card");
 
-        /* read 8 megs of card image */
-        printf("reading card.... ");
+        printf("reading card %s into slot %d... ", path, slot);
         uint64_t cardprog_start = time_us_64();
 #if WITH_PSRAM
-        for (size_t pos = 0; pos < CARD_SIZE; pos += BLOCK_SIZE) {
-            if (sd_read(fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
+        for (size_t pos = 0; pos < CARD_SIZE; pos += sizeof(flushbuf)) {
+            if (sd_read(fd, flushbuf, sizeof(flushbuf)) != (int)sizeof(flushbuf))
                 fatal("cannot read memcard");
 
-            psram_write_dma(pos, flushbuf, BLOCK_SIZE, NULL);
-            psram_wait_for_dma();
+            store_extent(slot, pos);
         }
 #endif
-        ps1_mc_data_interface_card_changed();
         uint64_t end = time_us_64();
         printf("OK!\n");
 
         printf("took = %.2f s; SD read speed = %.2f kB/s\n", (end - cardprog_start) / 1e6,
             1000000.0 * CARD_SIZE / (end - cardprog_start) / 1024);
     }
+
+    slot_fd[slot] = fd;
+    slot_chan[slot] = chan;
+
+    return true;
 }
 
-void ps1_cardman_close(void) {
-    if (fd < 0)
+static int find_slot(int chan) {
+    for (int i = 0; i < PS1_CARD_SLOTS; i++)
+        if (slot_chan[i] == chan)
+            return i;
+
+    return -1;
+}
+
+static int wrap_channel(int chan, int max_chan) {
+    return ((chan - CHAN_MIN) % max_chan + max_chan) % max_chan + CHAN_MIN;
+}
+
+static int channel_distance(int a, int b, int max_chan) {
+    int d = abs(a - b) % max_chan;
+    return (d < max_chan - d) ? d : max_chan - d;
+}
+
+/* Takes an unused slot or frees the one holding the channel furthest away */
+static int evict_slot(int chan) {
+    int max_chan = get_max_channels();
+    int victim = 0;
+
+    for (int i = 0; i < PS1_CARD_SLOTS; i++) {
+        if (slot_chan[i] == 0)
+            return i;
+        if (channel_distance(slot_chan[i], chan, max_chan) > channel_distance(slot_chan[victim], chan, max_chan))
+            victim = i;
+    }
+
+    drain_dirty();
+    unload_slot(victim);
+
+    return victim;
+}
+
+static void preload_cancel(void) {
+    if (preload.chan != 0)
+        sd_close(preload.fd);
+    preload.chan = 0;
+}
+
+/* Starts on the existing channel closest to the active one that is not
+ * loaded yet, false when there is none or no slot left */
+static bool preload_start(void) {
+    int max_chan = get_max_channels();
+    char path[96];
+
+    for (int d = 1; d <= max_chan / 2; d++) {
+        int next[2] = { wrap_channel(card_chan + d, max_chan), wrap_channel(card_chan - d, max_chan) };
+
+        for (int i = 0; i < 2; i++) {
+            int slot = find_slot(0);
+            if (slot < 0)
+                return false;
+            if (find_slot(next[i]) >= 0)
+                continue;
+
+            get_card_path(next[i], path, sizeof(path));
+            if (!sd_exists(path))
+                continue;
+
+            int fd = sd_open(path, O_RDWR);
+            if (fd < 0)
+                continue;
+
+            printf("preloading card %s into slot %d\n", path, slot);
+            preload.slot = slot;
+            preload.chan = next[i];
+            preload.fd = fd;
+            preload.pos = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Loads one extent of the next channel, held back while the console writes */
+void ps1_cardman_task(void) {
+#if WITH_PSRAM
+    if (!preload_pending || ps1_dirty_activity || !ps1_dirty_lockout_expired())
+        return;
+
+    if ((preload.chan == 0) && !preload_start()) {
+        preload_pending = false;
+        return;
+    }
+
+    if (sd_read(preload.fd, flushbuf, sizeof(flushbuf)) != (int)sizeof(flushbuf)) {
+        printf("cannot preload channel %d\n", preload.chan);
+        preload_cancel();
+        preload_pending = false;
         return;
+    }
+    store_extent(preload.slot, preload.pos);
+    preload.pos += sizeof(flushbuf);
+
+    if (preload.pos == CARD_SIZE) {
+        slot_fd[preload.slot] = preload.fd;
+        slot_chan[preload.slot] = preload.chan;
+        preload.chan = 0;
+    }
+#else
+    preload_pending = false;
+#endif
+}
+
+void ps1_cardman_open(void) {
+    preload_cancel();
+
+    sd_init();
+    ensuredirs();
+
+    if ((resident_state != cardman_state) || (strcmp(resident_folder, folder_name) != 0)) {
+        ps1_cardman_unload();
+        resident_state = cardman_state;
+        snprintf(resident_folder, sizeof(resident_folder), "%s", folder_name);
+        preload_pending = true;
+    }
+
+    switch (cardman_state) {
+        case PS1_CM_STATE_BOOT:
+            settings_set_ps1_boot_channel(card_chan);
+            break;
+        case PS1_CM_STATE_NAMED:
+        case PS1_CM_STATE_GAMEID:
+            break;
+        case PS1_CM_STATE_NORMAL:
+            /* this is ok to do on every boot because it wouldn't update if the value is the same as currently stored */
+            settings_set_ps1_card(card_idx);
+            settings_set_ps1_channel(card_chan);
+            break;
+    }
+
+    active_slot = find_slot(card_chan);
+    if (active_slot >= 0) {
+        printf("Switching to channel %d in slot %d\n", card_chan, active_slot);
+    } else {
+        char path[96];
+
+        get_card_path(card_chan, path, sizeof(path));
+        printf("Switching to card path = %s\n", path);
+
+        active_slot = evict_slot(card_chan);
+        load_slot(active_slot, card_chan, true);
+    }
+
+    ps1_mc_data_interface_card_changed(active_slot);
+}
+
+/* The channels stay resident for the next open, only their writes go out */
+void ps1_cardman_close(void) {
     ps1_cardman_flush();
-    sd_close(fd);
-    fd = -1;
+}
+
+void ps1_cardman_unload(void) {
+    bool loaded = false;
+
+    preload_cancel();
+    preload_pending = false;
+
+    for (int i = 0; i < PS1_CARD_SLOTS; i++)
+        loaded |= (slot_fd[i] >= 0);
+
+    if (loaded)
+        drain_dirty();
+
+    for (int i = 0; i < PS1_CARD_SLOTS; i++)
+        unload_slot(i);
+    resident_folder[0] = '\0';
 }
 
 void ps1_cardman_next_channel(void) {
-    uint8_t max_chan = card_config_get_max_channels(folder_name, (cardman_state == PS1_CM_STATE_BOOT) ? "BootCard" : folder_name);
+    uint8_t max_chan = get_max_channels();
     switch (cardman_state) {
         case PS1_CM_STATE_NAMED:
         case PS1_CM_STATE_BOOT:
@@ -282,7 +518,7 @@ void ps1_cardman_next_channel(void) {
 }
 
 void ps1_cardman_prev_channel(void) {
-    uint8_t max_chan = card_config_get_max_channels(folder_name, (cardman_state == PS1_CM_STATE_BOOT) ? "BootCard" : folder_name);
+    uint8_t max_chan = get_max_channels();
 
     switch (cardman_state) {
         case PS1_CM_STATE_NAMED:
@@ -12,11 +12,13 @@ typedef enum {
 } ps1_cardman_state_t;
 
 void ps1_cardman_init(void);
-int ps1_cardman_read_sector(int sector, void *buf128);
-int ps1_cardman_write_sector(int sector, void *buf512);
+int ps1_cardman_read_sectors(int sector, int count, void *buf);
+int ps1_cardman_write_sectors(int sector, int count, void *buf);
 void ps1_cardman_flush(void);
 void ps1_cardman_open(void);
 void ps1_cardman_close(void);
+void ps1_cardman_unload(void);
+void ps1_cardman_task(void);
 int ps1_cardman_get_idx(void);
 int ps1_cardman_get_channel(void);
 const char* ps1_cardman_get_folder_name(void);
@@ -6,7 +6,6 @@
 #endif
 
 #include "bigmem.h"
-#define dirty_heap bigmem.ps1.dirty_heap
 #define dirty_map bigmem.ps1.dirty_map
 
 #include <stdio.h>
@@ -18,67 +17,65 @@ int ps1_dirty_activity;
 
 static int num_dirty;
 
-#define SWAP(a, b) do { \
-    uint16_t tmp = a; \
-    a = b; \
-    b = tmp; \
-} while (0);
+/* Sectors read from PSRAM per pass, consecutive ones are flushed with one
+ * SD write */
+#define FLUSH_RUN 8
+
+#define DIRTY_SECTORS (PS1_CARD_SLOTS * PS1_CARD_PAGES)
+_Static_assert(sizeof(dirty_map) * 8 >= DIRTY_SECTORS, "dirty map too small");
+
+static inline bool dirty_map_is_marked(uint32_t sector) {
+    return dirty_map[sector / 32] & (1u << (sector % 32));
+}
 
 void ps1_dirty_init(void) {
     ps1_dirty_spin_lock = spin_lock_init(spin_lock_claim_unused(1));
+    /* bigmem is shared with PS2 mode */
+    memset(dirty_map, 0x00, sizeof(dirty_map));
+    num_dirty = 0;
 }
 
 void __time_critical_func(ps1_dirty_mark)(uint32_t sector) {
-    if (sector < sizeof(dirty_map)) {
+    if (sector < DIRTY_SECTORS) {
         /* already marked? */
-        if (dirty_map[sector])
+        if (dirty_map_is_marked(sector))
             return;
 
-        /* update map */
-        dirty_map[sector] = 1;
-
-        /* update heap */
-        int cur = num_dirty++;
-        dirty_heap[cur] = sector;
-        while (dirty_heap[cur] < dirty_heap[(cur-1)/2]) {
-            SWAP(dirty_heap[cur], dirty_heap[(cur-1)/2]);
-            cur = (cur-1)/2;
-        }
+        dirty_map[sector / 32] |= (1u << (sector % 32));
+        ++num_dirty;
     }
 }
 
-static void heapify(int i) {
-    int l = i * 2 + 1;
-    int r = i * 2 + 2;
-    int best = i;
-    if (l < num_dirty && dirty_heap[l] < dirty_heap[best])
-        best = l;
-    if (r < num_dirty && dirty_heap[r] < dirty_heap[best])
-        best = r;
-    if (best != i) {
-        SWAP(dirty_heap[i], dirty_heap[best]);
-        heapify(best);
+/* Finds the lowest dirty sector and takes up to max of the dirty sectors
+ * following it in the same slot off the map, returns -1 if none are left */
+static int get_marked_run(int max, int *count) {
+    for (uint32_t word = 0; num_dirty && word < DIRTY_SECTORS / 32; word++) {
+        if (!dirty_map[word])
+            continue;
+
+        int sector = word * 32 + __builtin_ctz(dirty_map[word]);
+        int n = 0;
+        do {
+            dirty_map[(sector + n) / 32] &= ~(1u << ((sector + n) % 32));
+            ++n;
+        } while ((n < max) && ((sector + n) % PS1_CARD_PAGES != 0) && dirty_map_is_marked(sector + n));
+
+        num_dirty -= n;
+        *count = n;
+        return sector;
     }
+
+    return -1;
 }
 
 int ps1_dirty_get_marked(void) {
-    if (num_dirty == 0)
-        return -1;
-
-    uint16_t ret = dirty_heap[0];
+    int count;
 
-    /* update heap */
-    dirty_heap[0] = dirty_heap[--num_dirty];
-    heapify(0);
-
-    /* update map */
-    dirty_map[ret] = 0;
-
-    return ret;
+    return get_marked_run(1, &count);
 }
 
 void ps1_dirty_task(void) {
-    static uint8_t flushbuf[128];
+    static uint8_t flushbuf[PS1_PAGE_SIZE * FLUSH_RUN];
 
     int num_after = 0;
     int hit = 0;
@@ -90,34 +87,65 @@ void ps1_dirty_task(void) {
         if ((time_us_64() - start) > 100 * 1000)
             break;
 
+        /* take runs until the buffer is full, PSRAM reads all of them at once */
+        struct {
+            int sector;
+            int count;
+            uint8_t *buf;
+        } runs[FLUSH_RUN];
+        int num_runs = 0;
+        int used = 0;
+
         ps1_dirty_lock();
-        int sector = ps1_dirty_get_marked();
+        while (used < FLUSH_RUN) {
+            int count;
+            int sector = get_marked_run(FLUSH_RUN - used, &count);
+            if (sector == -1)
+                break;
+            runs[num_runs].sector = sector;
+            runs[num_runs].count = count;
+            runs[num_runs].buf = &flushbuf[used * PS1_PAGE_SIZE];
+            used += count;
+            ++num_runs;
+        }
         num_after = num_dirty;
-        if (sector == -1) {
+        if (num_runs == 0) {
             ps1_dirty_unlock();
             break;
         }
 #if WITH_PSRAM
-        psram_read_dma(sector * 128, flushbuf, 128, NULL);
+        psram_segment_t segs[FLUSH_RUN];
+        for (int i = 0; i < num_runs; i++) {
+            segs[i].addr = runs[i].sector * PS1_PAGE_SIZE;
+            segs[i].buf = runs[i].buf;
+            segs[i].sz = runs[i].count * PS1_PAGE_SIZE;
+        }
+        psram_read_list_dma(segs, num_runs, NULL);
         psram_wait_for_dma();
 #else
-        uint8_t* page = ps1_mc_data_interface_get_page(sector);
-        memcpy(flushbuf, page, PS1_PAGE_SIZE);
+        for (int i = 0; i < num_runs; i++)
+            memcpy(runs[i].buf, ps1_mc_data_interface_get_page(runs[i].sector), runs[i].count * PS1_PAGE_SIZE);
 #endif
         ps1_dirty_unlock();
 
-        ++hit;
+        hit += used;
 
-        printf("ps1 - write sector %d\n", sector);
+        for (int i = 0; i < num_runs; i++) {
+            int sector = runs[i].sector;
+            int count = runs[i].count;
 
-        if (ps1_cardman_write_sector(sector, flushbuf) != 0) {
-            // TODO: do something if we get too many errors?
-            // for now lets push it back into the heap and try again later
-            printf("!! writing sector 0x%x failed\n", sector);
+            printf("ps1 - write sectors %d-%d\n", sector, sector + count - 1);
 
-            ps1_dirty_lock();
-            ps1_dirty_mark(sector);
-            ps1_dirty_unlock();
+            if (ps1_cardman_write_sectors(sector, count, runs[i].buf) != 0) {
+                // TODO: do something if we get too many errors?
+                // for now lets mark them dirty again and try again later
+                printf("!! writing sectors 0x%x-0x%x failed\n", sector, sector + count - 1);
+
+                ps1_dirty_lock();
+                for (int j = 0; j < count; j++)
+                    ps1_dirty_mark(sector + j);
+                ps1_dirty_unlock();
+            }
         }
     }
     /* to make sure writes hit the storage medium */
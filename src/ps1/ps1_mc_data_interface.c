@@ -20,10 +20,11 @@
 
 #define PAGE_CACHE_SIZE 40
 #define MAX_READ_AHEAD 0
-#define PS1_CARD_SIZE 128 * 1024
 
 static bool dma_in_progress = false;
 static bool write_occured = false;
+/* first sector of the active slot */
+static uint32_t slot_base;
 
 
 #define card cache
@@ -36,12 +37,16 @@ static void __time_critical_func(ps1_mc_data_interface_rx_done)() {
     ps1_dirty_unlock();
 }
 
+static void __time_critical_func(ps1_mc_data_interface_tx_done)() {
+    ps1_dirty_unlock();
+}
+
 void __time_critical_func(ps1_mc_data_interface_start_dma)(uint32_t page) {
     ps1_dirty_lockout_renew();
     /* the spinlock will be unlocked by the DMA irq once all data is tx'd */
     ps1_dirty_lock();
     dma_in_progress = true;
-    psram_read_dma(page * PS1_PAGE_SIZE, card, PS1_PAGE_SIZE, ps1_mc_data_interface_rx_done);
+    psram_read_dma((slot_base + page % PS1_CARD_PAGES) * PS1_PAGE_SIZE, card, PS1_PAGE_SIZE, ps1_mc_data_interface_rx_done);
 }
 #endif
 
@@ -59,29 +64,38 @@ uint8_t* __time_critical_func(ps1_mc_data_interface_get_page)(uint32_t page) {
 #ifdef WITH_PSRAM
     ret = card;
 #else
-    ret = &card[page*PS1_PAGE_SIZE];
+    ret = &card[(page % PS1_CARD_PAGES) * PS1_PAGE_SIZE];
 #endif
 
     return ret;
 }
 
-void __time_critical_func(ps1_mc_data_interface_write_byte)(uint32_t address, uint8_t byte) {
+/* Called once the checksum of a write frame matched, the whole page goes
+ * out in one DMA */
+void __time_critical_func(ps1_mc_data_interface_commit_write)(uint32_t page, uint8_t *buf) {
+    if (page >= PS1_CARD_PAGES)
+        return;
+
 #if WITH_PSRAM
-    card[address%PS1_PAGE_SIZE] = byte;
     ps1_dirty_lockout_renew();
+    /* the spinlock will be unlocked by the DMA irq once all data is tx'd */
     ps1_dirty_lock();
-    psram_write_dma(address, &card[address%PS1_PAGE_SIZE], 1, NULL);
-    psram_wait_for_dma();
-
-    ps1_dirty_unlock();
+    memcpy(card, buf, PS1_PAGE_SIZE);
+    psram_write_dma((slot_base + page) * PS1_PAGE_SIZE, card, PS1_PAGE_SIZE, ps1_mc_data_interface_tx_done);
 #else
-    card[address] = byte;
+    memcpy(&card[page * PS1_PAGE_SIZE], buf, PS1_PAGE_SIZE);
 #endif
     write_occured = true;
 }
 
 void __time_critical_func(ps1_mc_data_interface_write_mc)(uint32_t page) {
-    ps1_dirty_mark(page);
+    if (page >= PS1_CARD_PAGES)
+        return;
+
+    /* waits for the DMA of commit_write, the flusher clears bits of the same map words */
+    ps1_dirty_lock();
+    ps1_dirty_mark(slot_base + page);
+    ps1_dirty_unlock();
 }
 
 void __time_critical_func(ps1_mc_data_interface_wait_for_byte)(uint32_t offset) {
@@ -92,14 +106,13 @@ void __time_critical_func(ps1_mc_data_interface_wait_for_byte)(uint32_t offset)
 
 // Core 0
 
-void ps1_mc_data_interface_card_changed(void) {
+void ps1_mc_data_interface_card_changed(int slot) {
+    slot_base = slot * PS1_CARD_PAGES;
 #if WITH_PSRAM != 1
     QPRINTF("Card changed\n");
 
-    for (int i = 0; i < 1024; i++) {
-        if (ps1_cardman_read_sector(i, &card[i*PS1_PAGE_SIZE]) < 0)
-            fatal("Sector %i not read!!!\n", i);
-    }
+    if (ps1_cardman_read_sectors(slot_base, PS1_CARD_PAGES, card) < 0)
+        fatal("Card not read!!!\n");
 #endif
 }
 
@@ -5,11 +5,19 @@
 #include <stdbool.h>
 
 #define PS1_PAGE_SIZE   128
+#define PS1_CARD_SIZE   (128 * 1024)
+#define PS1_CARD_PAGES  (PS1_CARD_SIZE / PS1_PAGE_SIZE)
+
+/* PSRAM holds this many channels of a card folder, one card per slot */
+#if WITH_PSRAM
+#define PS1_CARD_SLOTS  8
+#else
+#define PS1_CARD_SLOTS  1
+#endif
 
 // Core 1
 
 void ps1_mc_data_interface_setup_read_page(uint32_t page);
-void ps1_mc_data_interface_write_byte(uint32_t address, uint8_t byte);
 void ps1_mc_data_interface_write_mc(uint32_t page);
 void ps1_mc_data_interface_erase(uint32_t page);
 uint8_t* ps1_mc_data_interface_get_page(uint32_t page);
@@ -18,6 +26,6 @@ void ps1_mc_data_interface_wait_for_byte(uint32_t offset);
 
 // Core 0
 
-void ps1_mc_data_interface_card_changed(void);
+void ps1_mc_data_interface_card_changed(int slot);
 bool ps1_mc_data_interface_write_occured(void);
 void ps1_mc_data_interface_task(void);
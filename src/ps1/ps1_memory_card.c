@@ -86,167 +86,203 @@ static uint8_t __time_critical_func(recv_cmd)(void) {
     return (uint8_t) (pio_sm_get(pio0, cmd_reader.sm) >> 24);
 }
 
+/* Every command frame is a table of steps indexed by byte_count. Most steps
+ * answer with a constant, the others act on the bytes received so far */
+enum {
+    OP_END = 0,
+    OP_CONST,
+    OP_ECHO,
+    OP_MSB,
+    OP_READ_SETUP,
+    OP_READ_FIRST,
+    OP_READ_DATA,
+    OP_READ_CHK,
+    OP_READ_DONE,
+    OP_WRITE_START,
+    OP_WRITE_FIRST,
+    OP_WRITE_DATA,
+    OP_WRITE_COMMIT,
+    OP_GAME_ID_START,
+    OP_GAME_ID_LENGTH,
+    OP_GAME_ID_DATA,
+    OP_ODE_COMMAND,
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t value;
+} step_t;
+
+#define CONST(x) { OP_CONST, (x) }
+#define STEP(x)  { (x), 0 }
+
+static const step_t __not_in_flash("ps1_steps") status_steps[] = {
+    [2] = CONST(0x5A), [3] = CONST(0x5D), [4] = CONST(0x5C), [5] = CONST(0x5D),
+    [6] = CONST(0x04), [7] = CONST(0x00), [8] = CONST(0x00), [9] = CONST(0x80),
+};
+
+static const step_t __not_in_flash("ps1_steps") read_steps[] = {
+    [2] = CONST(0x5A), [3] = CONST(0x5D), [4] = CONST(0x00), [5] = STEP(OP_ECHO),
+    [6] = CONST(0x5C), [7] = CONST(0x5D), [8] = STEP(OP_MSB), [9] = STEP(OP_READ_SETUP),
+    [10] = STEP(OP_READ_FIRST),
+    [11 ... 137] = STEP(OP_READ_DATA),
+    [138] = STEP(OP_READ_CHK),
+    [139] = STEP(OP_READ_DONE),
+};
+
+static const step_t __not_in_flash("ps1_steps") write_steps[] = {
+    [2] = STEP(OP_WRITE_START), [3] = CONST(0x5D), [4] = CONST(0x00), [5] = STEP(OP_ECHO),
+    [6] = STEP(OP_ECHO),
+    [7] = STEP(OP_WRITE_FIRST),
+    [8 ... 134] = STEP(OP_WRITE_DATA),
+    [135] = CONST(0x5C), [136] = CONST(0x5D),
+    [137] = STEP(OP_WRITE_COMMIT),
+};
+
+// Memcard Pro Commands
+// See https://gitlab.com/chriz2600/ps1-game-id-transmission
+static const step_t __not_in_flash("ps1_steps") mcp_ping_steps[] = {
+    [2] = CONST(0x00), [3] = CONST(0x00), [4] = CONST(0x27), [5] = CONST(0xFF),
+};
+
+static const step_t __not_in_flash("ps1_steps") mcp_game_id_steps[] = {
+    [2] = STEP(OP_GAME_ID_START), [3] = CONST(0x00), [4] = STEP(OP_GAME_ID_LENGTH),
+    [5 ... 256] = STEP(OP_GAME_ID_DATA),
+};
+
+#define MCP_SWITCH_STEPS(command) { \
+    [2] = CONST(0x00), [3] = CONST(0x00), [4] = CONST(0x20), [5] = { OP_ODE_COMMAND, (command) }, \
+}
+
+static const step_t __not_in_flash("ps1_steps") mcp_prv_ch_steps[] = MCP_SWITCH_STEPS(MCP_PRV_CH);
+static const step_t __not_in_flash("ps1_steps") mcp_nxt_ch_steps[] = MCP_SWITCH_STEPS(MCP_NXT_CH);
+static const step_t __not_in_flash("ps1_steps") mcp_prv_card_steps[] = MCP_SWITCH_STEPS(MCP_PRV_CARD);
+static const step_t __not_in_flash("ps1_steps") mcp_nxt_card_steps[] = MCP_SWITCH_STEPS(MCP_NXT_CARD);
+
+#undef CONST
+#undef STEP
+#undef MCP_SWITCH_STEPS
+
 static int __time_critical_func(mc_do_state)(uint8_t ch) {
     static uint8_t payload[256];
+    static const step_t *steps;
+    static size_t num_steps;
+    static uint8_t *data;
+    static uint8_t chk;
+    static uint8_t buf[PS1_PAGE_SIZE];
+
+    #define MSB (payload[4])
+    #define LSB (payload[5])
+    #define PAGE (MSB * 256 + LSB)
+
     if (byte_count >= sizeof(payload))
         return -1;
     payload[byte_count++] = ch;
 
+    /* read data streams from the page fetched on the first data byte */
+    if ((byte_count < num_steps) && (steps[byte_count].op == OP_READ_DATA)) {
+        chk ^= *data;
+        return *data++;
+    }
+
     if (byte_count == 1) {
         /* First byte - determine the device the command is for */
+        num_steps = 0;
         if (ch == 0x81)
             return flag;
-    } else if (payload[0] == 0x81) {
+        return -1;
+    }
+
+    if (byte_count == 2) {
         /* Command for the memory card */
-        uint8_t cmd = payload[1];
-
-        if (cmd == 'S') {
-            /* Memory card status */
-            switch (byte_count) {
-                case 2: return 0x5A;
-                case 3: return 0x5D;
-                case 4: return 0x5C;
-                case 5: return 0x5D;
-                case 6: return 0x04;
-                case 7: return 0x00;
-                case 8: return 0x00;
-                case 9: return 0x80;
-            }
-        } else if (cmd == 'R') {
-            /* Memory card read */
-            #define MSB (payload[4])
-            #define LSB (payload[5])
-            #define PAGE (MSB * 256 + LSB)
-            #define ADDR (PAGE * 128)
-            #define OFF (byte_count - 10)
-
-            static uint8_t chk;
-
-            switch (byte_count) {
-                case 2: return 0x5A;
-                case 3: return 0x5D;
-                case 4: return 0x00;
-                case 5: return MSB;
-                case 6: return 0x5C;
-                case 7: return 0x5D;
-                case 8: return MSB;
-                case 9:
-                    chk = MSB ^ LSB;
-                    ps1_mc_data_interface_setup_read_page(PAGE);
-                    return LSB;
-                case 10 ... 137: {
-                    ps1_mc_data_interface_wait_for_byte(OFF);
-                    curr_page = ps1_mc_data_interface_get_page(PAGE);
-                    chk ^= curr_page[OFF];
-                    return curr_page[OFF];
-                }
-                case 138: return chk;
-                case 139: {
-                    curr_page = NULL;
-                    QPRINTF("Done Reading sector %u\n", PAGE);
-                    return 0x47;
-                }
-            }
+        switch (ch) {
+            case 'S': steps = status_steps; num_steps = count_of(status_steps); break;
+            case 'R': steps = read_steps; num_steps = count_of(read_steps); break;
+            case 'W': steps = write_steps; num_steps = count_of(write_steps); break;
+            case 0x20: steps = mcp_ping_steps; num_steps = count_of(mcp_ping_steps); break;
+            case 0x21: steps = mcp_game_id_steps; num_steps = count_of(mcp_game_id_steps); break;
+            case 0x22: steps = mcp_prv_ch_steps; num_steps = count_of(mcp_prv_ch_steps); break;
+            case 0x23: steps = mcp_nxt_ch_steps; num_steps = count_of(mcp_nxt_ch_steps); break;
+            case 0x24: steps = mcp_prv_card_steps; num_steps = count_of(mcp_prv_card_steps); break;
+            case 0x25: steps = mcp_nxt_card_steps; num_steps = count_of(mcp_nxt_card_steps); break;
+            default:
+                DPRINTF("Received unknown command: %u\n", ch);
+                return -1;
+        }
+    }
 
-            #undef MSB
-            #undef LSB
-            #undef ADDR
-            #undef OFF
-            #undef PAGE
-        } else if (cmd == 'W') {
-            /* Memory card write */
-            #define MSB (payload[4])
-            #define LSB (payload[5])
-            #define PAGE (MSB * 256 + LSB)
-            #define ADDR (PAGE * 128 + byte_count - 7)
-
-            static uint8_t chk;
-
-            switch (byte_count) {
-                case 2: flag = 0; return 0x5A;
-                case 3: return 0x5D;
-                case 4: return 0x00;
-                case 5: return MSB;
-                case 6: return LSB;
-                case 7: chk = MSB ^ LSB; // fallthrough
-                case 8 ... 134: {
-                    ps1_mc_data_interface_write_byte(ADDR, payload[byte_count - 1]);
-                    chk ^= payload[byte_count - 1];
-                    return payload[byte_count - 1];
-                }
-                case 135: return 0x5C;
-                case 136: return 0x5D;
-                case 137: {
-                    if (chk == payload[byte_count - 3]) {
-                        ps1_mc_data_interface_write_mc(PAGE);
-                        return 0x47;
-                    } else
-                        return 0x4E;
-                }
-            }
+    if (byte_count >= num_steps)
+        return -1;
 
-            #undef MSB
-            #undef LSB
-            #undef ADDR
-        }
-        // Memcard Pro Commands after this line
-        // See https://gitlab.com/chriz2600/ps1-game-id-transmission
-        else if (cmd == 0x20) {   // MCP Ping Command
-            switch (byte_count) {
-                case 2:
-                case 3: return 0x00;
-                case 4: return 0x27;
-                case 5: return 0xFF;
-            }
-        } else if (cmd == 0x21) { // MCP Game ID
-            if (byte_count == game_id_length + 4)
-            {
+    const step_t step = steps[byte_count];
+    switch (step.op) {
+        case OP_CONST:
+            return step.value;
+        case OP_ECHO:
+            return ch;
+        case OP_MSB:
+            return MSB;
+        case OP_READ_SETUP:
+            chk = MSB ^ LSB;
+            ps1_mc_data_interface_setup_read_page(PAGE);
+            return LSB;
+        case OP_READ_FIRST:
+            /* the DMA had a byte time to finish, the rest needs no checks */
+            ps1_mc_data_interface_wait_for_byte(PS1_PAGE_SIZE - 1);
+            curr_page = ps1_mc_data_interface_get_page(PAGE);
+            data = curr_page;
+            chk ^= *data;
+            return *data++;
+        case OP_READ_CHK:
+            return chk;
+        case OP_READ_DONE:
+            curr_page = NULL;
+            QPRINTF("Done Reading sector %u\n", PAGE);
+            return 0x47;
+        case OP_WRITE_START:
+            flag = 0;
+            return 0x5A;
+        case OP_WRITE_FIRST:
+            chk = MSB ^ LSB;
+            data = buf;
+            // fallthrough
+        case OP_WRITE_DATA:
+            *data++ = ch;
+            chk ^= ch;
+            return ch;
+        case OP_WRITE_COMMIT:
+            if (chk == payload[byte_count - 3]) {
+                ps1_mc_data_interface_commit_write(PAGE, buf);
+                ps1_mc_data_interface_write_mc(PAGE);
+                return 0x47;
+            } else
+                return 0x4E;
+        case OP_GAME_ID_START:
+            memset(received_game_id, 0, sizeof(received_game_id));
+            return 0x00;
+        case OP_GAME_ID_LENGTH:
+            game_id_length = ch;
+            return 0x00;
+        case OP_GAME_ID_DATA:
+            if (byte_count == game_id_length + 4) {
                 game_db_extract_title_id(&payload[4], received_game_id, game_id_length, sizeof(received_game_id));
                 if (!game_db_sanity_check_title_id(received_game_id))
                     memset(received_game_id, 0, sizeof(received_game_id));
                 mc_pro_command = MCP_GAME_ID;
             }
-            switch (byte_count) {
-                case 2: memset(received_game_id, 0, sizeof(received_game_id)); return 0x00;
-                case 3: return 0x00;
-                case 4: game_id_length = payload[byte_count - 1]; return 0x00;
-                case 5 ... 255: return payload[byte_count - 1];
-            }
-        } else if (cmd == 0x22) { // MCP Prv Channel
-            switch (byte_count) {
-                case 2:
-                case 3: return 0x00;
-                case 4: return 0x20;
-                case 5: mc_pro_command = MCP_PRV_CH; return 0xFF;
-            }
-        } else if (cmd == 0x23) { // MCP Nxt Channel
-            switch (byte_count) {
-                case 2:
-                case 3: return 0x00;
-                case 4: return 0x20;
-                case 5: mc_pro_command = MCP_NXT_CH; return 0xFF;
-            }
-        } else if (cmd == 0x24) { // MCP Prv Card
-
-            switch (byte_count) {
-                case 2:
-                case 3: return 0x00;
-                case 4: return 0x20;
-                case 5: mc_pro_command = MCP_PRV_CARD; return 0xFF;
-            }
-        } else if (cmd == 0x25) { // MCP Nxt Card
-
-            switch (byte_count) {
-                case 2:
-                case 3: return 0x00;
-                case 4: return 0x20;
-                case 5: mc_pro_command = MCP_NXT_CARD; return 0xFF;
-            }
-        } else {
-            DPRINTF("Received unknown command: %u\n", ch);
-        }
+            /* the last byte that fits only ends the frame */
+            if (byte_count == sizeof(payload))
+                return -1;
+            return ch;
+        case OP_ODE_COMMAND:
+            mc_pro_command = step.value;
+            return 0xFF;
     }
 
+    #undef MSB
+    #undef LSB
+    #undef PAGE
+
     return -1;
 }
 
@@ -21,10 +21,6 @@
 #define log(level, fmt, x...) LOG_PRINT(LOG_LEVEL_PS2_MC, level, fmt, ##x)
 #endif
 
-#define PS2_MAX_ACK_DELAY_SHORT         ( 1300 )
-#define PS2_MAX_ACK_DELAY_MID           ( 1500 )
-#define PS2_MAX_ACK_DELAY_LONG          ( 2000 )
-
 uint32_t read_sector, write_sector, erase_sector;
 uint8_t readecc[16];
 uint8_t writetmp[528];
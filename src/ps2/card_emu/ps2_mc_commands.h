@@ -22,6 +22,11 @@
 #define PS2_SIO2_CMD_SESSION_KEY_0      0xF1
 #define PS2_SIO2_CMD_SESSION_KEY_1      0xF2
 
+/* Longest a response may be held back while the data interface catches up */
+#define PS2_MAX_ACK_DELAY_SHORT         ( 1300 )
+#define PS2_MAX_ACK_DELAY_MID           ( 1500 )
+#define PS2_MAX_ACK_DELAY_LONG          ( 2000 )
+
 
 extern void ps2_mc_cmd_0x11(void);
 extern void ps2_mc_cmd_0x12(void);
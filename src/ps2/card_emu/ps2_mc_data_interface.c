@@ -18,6 +18,7 @@
 #endif
 #include "ps2_mc_internal.h"
 #include "ps2_cardman.h"
+#include "ps2_save_index.h"
 
 #include "debug.h"
 
@@ -494,7 +495,8 @@ void ps2_mc_data_interface_task(void) {
                         log(LOG_INFO, "%s Writing page %u\n", __func__, page_p->page);
                         write_occured = true;
                         ps2_cardman_write_sector(page_p->page, page_p->data);
-                        ps2_history_tracker_registerPageWrite(page_p->page);
+                        ps2_history_tracker_registerPageWrite(page_p->page, page_p->data);
+                        ps2_save_index_registerPageWrite(page_p->page, page_p->data);
                         ps2_mc_data_interface_set_page(page_p, 0, PAGE_EMPTY);
                         flush_req = true;
                         break;
@@ -306,6 +306,7 @@ static void __time_critical_func(mc_main_loop)(void) {
                 case MMCEMAN_SET_GAMEID: ps2_mmceman_cmd_set_gameid(); break;
                 case MMCEMAN_UNMOUNT_BOOTCARD: ps2_mmceman_cmd_unmount_bootcard(); break;
                 case MMCEMAN_RESET: ps2_mmceman_cmd_reset(); break;
+                case MMCEMAN_PROFILE: ps2_mmceman_cmd_profile(); break;
 #ifdef FEAT_PS2_MMCE
                 case MMCEMAN_CMD_FS_OPEN: ps2_mmceman_cmd_fs_open(); break;
                 case MMCEMAN_CMD_FS_CLOSE: ps2_mmceman_cmd_fs_close(); break;
@@ -19,6 +19,7 @@
 #include "pico/time.h"
 #include "pico/types.h"
 #include "ps2_cardman.h"
+#include "ps2_save_index.h"
 #if WITH_PSRAM
     #include "psram/psram.h"
 #endif
@@ -36,6 +37,7 @@
 #define HISTORY_WRITE_HYST_US     2 * 1000 * 1000
 #define HISTORY_BOOTUP_DEL        5 * 1000 * 1000
 #define HISTORY_NUMBER_OF_REGIONS 4
+#define HISTORY_PAGES_PER_CLUSTER 2
 
 #define CHAR_CHINA              'C'
 #define CHAR_NORTHAMERICA       'A'
@@ -43,6 +45,7 @@
 #define CHAR_JAPAN              'I'
 #define SYSTEMDATA_DIRNAME      "/B%cDATA-SYSTEM"
 #define HISTORY_FILENAME_FORMAT "/B%cDATA-SYSTEM/history"
+#define HISTORY_FILENAME        "history"
 
 static enum { HISTORY_STATUS_INIT, HISTORY_STATUS_CARD_CHANGED, HISTORY_STATUS_WAITING_WRITE, HISTORY_STATUS_WAITING_REFRESH } status;
 
@@ -53,8 +56,12 @@ static bool writeOccured;
 
 const char regionList[] = {CHAR_CHINA, CHAR_NORTHAMERICA, CHAR_EUROPE, CHAR_JAPAN};
 static uint8_t slotCount[HISTORY_NUMBER_OF_REGIONS][HISTORY_ENTRY_COUNT] = {};
+static uint8_t historyData[HISTORY_NUMBER_OF_REGIONS][HISTORY_FILE_SIZE] = {};
 static uint32_t fileCluster[HISTORY_NUMBER_OF_REGIONS] = {0, 0, 0, 0};
+static uint32_t dataPage[HISTORY_NUMBER_OF_REGIONS] = {0, 0, 0, 0};
 static bool refreshRequired[HISTORY_NUMBER_OF_REGIONS];
+static bool dataUpdated[HISTORY_NUMBER_OF_REGIONS];
+static bool mcioReady;
 
 int page_erase(mcfat_cardspecs_t* info, uint32_t page) {
     (void)info;
@@ -105,17 +112,6 @@ int __time_critical_func(ecc_read)(mcfat_cardspecs_t* info, uint32_t page, uint3
     return 0;
 }
 
-static bool fileExists(char* filename) {
-    int fd = mcio_mcOpen(filename, sceMcFileAttrReadable);
-    log(LOG_TRACE, "File %s status %d\n", filename, fd);
-    if (fd < 0)
-        return false;
-    else
-        mcio_mcClose(fd);
-
-    return true;
-}
-
 static bool dirExists(char* dirname) {
     int fd = mcio_mcDopen(dirname);
     log(LOG_TRACE, "Dir %s status %d\n", dirname, fd);
@@ -129,56 +125,132 @@ static bool dirExists(char* dirname) {
 
 static void readSlots(uint8_t historyFile[HISTORY_FILE_SIZE], uint8_t slots[HISTORY_ENTRY_COUNT]) {
     for (int i = 0; i < HISTORY_ENTRY_COUNT; i++) {
+        slots[i] = 0;
         if (historyFile[i * HISTORY_ENTRY_SIZE]) {
             for (int j = i * HISTORY_ENTRY_SIZE + HISTORY_ENTRY_POS_LAUNCH; j < (i + 1) * HISTORY_ENTRY_SIZE; j++) {
                 slots[i] ^= historyFile[j];
             }
             log(LOG_INFO, "Found game %s with %02x XOR\n", (char*)&historyFile[i * HISTORY_ENTRY_SIZE], historyFile[i * HISTORY_ENTRY_SIZE + HISTORY_ENTRY_POS_LAUNCH]);
-        } else {
-            slots[i] = 0;
         }
     }
 }
 
-void __time_critical_func(ps2_history_tracker_registerPageWrite)(uint32_t page) {
-    uint32_t cluster = page / 2;
+/* The history file fits the first page of its data cluster, so a write to
+ * that page carries the whole new file. Writes to the cluster holding the
+ * directory entry may mean the file moved, those need a walk through mcfat */
+void __time_critical_func(ps2_history_tracker_registerPageWrite)(uint32_t page, const uint8_t* data) {
+    uint32_t cluster = page / HISTORY_PAGES_PER_CLUSTER;
     if (status != HISTORY_STATUS_CARD_CHANGED) {
         for (int i = 0; i < HISTORY_NUMBER_OF_REGIONS; i++) {
             log(LOG_TRACE, "%u vs %u\n", fileCluster[i], cluster);
-            if ((cluster == fileCluster[i]) || (fileCluster[i] == 0)) {
+            if ((dataPage[i] != 0) && (page == dataPage[i])) {
+                memcpy(historyData[i], data, HISTORY_FILE_SIZE);
+                dataUpdated[i] = true;
+            } else if ((cluster == fileCluster[i]) || (fileCluster[i] == 0)) {
                 refreshRequired[i] = true;
-                lastAccess = time_us_64();
-                status = HISTORY_STATUS_WAITING_REFRESH;
+            } else {
+                continue;
             }
+            lastAccess = time_us_64();
+            status = HISTORY_STATUS_WAITING_REFRESH;
         }
     }
 }
 
-static void ps2_history_tracker_readClusters(void) {
-    uint8_t buff[HISTORY_FILE_SIZE] = {0x00};
+/* The save index knows where the system data directories are, the file is
+ * then read straight from its data page */
+static bool ps2_history_tracker_readIndexed(int region) {
+    char dirname[15] = {0x00};
+    ps2_save_file_t file;
+    int slot;
+
+    snprintf(dirname, 15, SYSTEMDATA_DIRNAME, regionList[region]);
+    slot = ps2_save_index_find(&dirname[1]);
+    if ((slot < 0) || !ps2_save_index_find_file(slot, HISTORY_FILENAME, &file))
+        return false;
+
+    fileCluster[region] = file.entry_page / HISTORY_PAGES_PER_CLUSTER;
+    dataPage[region] = file.data_page;
+    if ((file.data_page != 0)
+        && (page_read(&cardspecs, file.data_page, MIN(file.length, HISTORY_FILE_SIZE), historyData[region]) != sceMcResSucceed))
+        return false;
+
+    log(LOG_INFO, "Indexed %s, cluster %u, data page %u\n", dirname, fileCluster[region], dataPage[region]);
+    return true;
+}
+
+static bool ps2_history_tracker_readFile(int region) {
     char filename[23] = {0x00};
-    memset(fileCluster, 0x00, sizeof(fileCluster));
-    mcio_init();
-    log(LOG_INFO, "%s post init \n", __func__);
+    char dirname[15] = {0x00};
+    snprintf(filename, 23, HISTORY_FILENAME_FORMAT, regionList[region]);
+    snprintf(dirname, 15, SYSTEMDATA_DIRNAME, regionList[region]);
+
+    memset(historyData[region], 0x00, HISTORY_FILE_SIZE);
+    fileCluster[region] = 0;
+    dataPage[region] = 0;
+
+    if (ps2_save_index_complete())
+        return ps2_history_tracker_readIndexed(region);
+
+    // Saves past the index, walk the card through mcfat
+    if (!mcioReady) {
+        mcio_init();  // Call init to invalidate caches...
+        mcioReady = true;
+        log(LOG_TRACE, "%s Post Init\n", __func__);
+    }
+    if (!dirExists(dirname))
+        return false;
+
+    int fh = mcio_mcOpen(filename, sceMcFileAttrReadable);
+    log(LOG_INFO, "Reading filename %s, fd %d\n", filename, fh);
+    if (fh < 0)
+        return false;
+
+    int cluster = mcio_mcGetCluster(fh);
+    int data_cluster = mcio_mcGetDataCluster(fh);
+    fileCluster[region] = cluster > 0 ? cluster : 0;
+    dataPage[region] = data_cluster > 0 ? data_cluster * HISTORY_PAGES_PER_CLUSTER : 0;
+    mcio_mcRead(fh, historyData[region], HISTORY_FILE_SIZE);
+    mcio_mcClose(fh);
+
+    log(LOG_INFO, "Registering Cluster %i, data page %u\n", cluster, dataPage[region]);
+    return true;
+}
+
+static void ps2_history_tracker_readClusters(void) {
+    mcioReady = false;
     for (int i = 0; i < HISTORY_NUMBER_OF_REGIONS; i++) {
         // Read current history file for each region
-        snprintf(filename, 23, HISTORY_FILENAME_FORMAT, regionList[i]);
-        memset((void*)buff, 0x00, HISTORY_FILE_SIZE);
-
-        log(LOG_INFO, "%s Start reading\n", __func__);
-        int fh = mcio_mcOpen(filename, sceMcFileAttrReadable);
-        log(LOG_INFO, "Initially reading filename %s, fd %d\n", filename, fh);
-        if (fh >= 0) {
-            int cluster = mcio_mcGetCluster(fh);
-            fileCluster[i] = cluster;
-            mcio_mcRead(fh, buff, HISTORY_FILE_SIZE);
-            readSlots(buff, slotCount[i]);
-
-            log(LOG_INFO, "Registering Cluster %i\n", cluster);
-            mcio_mcClose(fh);
-        } else {
-            memset(slotCount[i], 0x00, HISTORY_ENTRY_COUNT);
+        ps2_history_tracker_readFile(i);
+        readSlots(historyData[i], slotCount[i]);
+        refreshRequired[i] = false;
+        dataUpdated[i] = false;
+    }
+}
+
+static void ps2_history_tracker_refresh(void) {
+    mcioReady = false;
+
+    for (int i = 0; i < HISTORY_NUMBER_OF_REGIONS; i++) {
+        if (refreshRequired[i] && !dataUpdated[i]) {
+            log(LOG_INFO, "Checking region %c\n", regionList[i]);
+            dataUpdated[i] = ps2_history_tracker_readFile(i);
         }
+
+        if (dataUpdated[i]) {
+            uint8_t slots_new[HISTORY_ENTRY_COUNT] = {};
+
+            readSlots(historyData[i], slots_new);
+            for (int j = 0; j < HISTORY_ENTRY_COUNT; j++) {
+                if (slots_new[j] != slotCount[i][j]) {
+                    if (ps2_mmceman_set_gameid(&historyData[i][j * HISTORY_ENTRY_SIZE]))
+                        break;
+                }
+            }
+            memcpy((void*)slotCount[i], (void*)slots_new, HISTORY_ENTRY_COUNT);
+        }
+        refreshRequired[i] = false;
+        dataUpdated[i] = false;
     }
 }
 
@@ -210,6 +282,9 @@ void ps2_history_tracker_init() {
     status = HISTORY_STATUS_INIT;
     writeOccured = false;
     memset(slotCount, 0x00, sizeof(slotCount));
+    memset(dataPage, 0x00, sizeof(dataPage));
+    memset(refreshRequired, 0x00, sizeof(refreshRequired));
+    memset(dataUpdated, 0x00, sizeof(dataUpdated));
 }
 
 void ps2_history_tracker_task() {
@@ -228,45 +303,10 @@ void ps2_history_tracker_task() {
     } else if ((status == HISTORY_STATUS_WAITING_REFRESH)
         && (micros - lastAccess) > HISTORY_WRITE_HYST_US) {
         // If Writing to MC has just finished...
-        uint8_t buff[HISTORY_FILE_SIZE] = {0x00};
-        char filename[23] = {0x00};
-        char dirname[15] = {0x00};
         log(LOG_INFO, "%s refreshing history...\n", __func__);
         writeOccured = false;
 
-        mcio_init();  // Call init to invalidate caches...
-        log(LOG_TRACE, "%s Post Init\n", __func__);
-
-        for (int i = 0; i < HISTORY_NUMBER_OF_REGIONS; i++) {
-            uint8_t slots_new[21] = {};
-            // Read current history file for each region
-            memset((void*)buff, 0x00, HISTORY_FILE_SIZE);
-            snprintf(dirname, 15, SYSTEMDATA_DIRNAME, regionList[i]);
-            snprintf(filename, 23, HISTORY_FILENAME_FORMAT, regionList[i]);
-            log(LOG_INFO, "Checking %s and %s\n", filename, dirname);
-            if (refreshRequired[i] && dirExists(dirname) && fileExists(filename)) {
-                int fh = mcio_mcOpen(filename, sceMcFileAttrReadable);
-                if (fileCluster[i] == 0x0)
-                    fileCluster[i] = mcio_mcGetCluster(fh);
-
-                log(LOG_INFO, "Updating filename %s, fd %d, new cluster %u\n", filename, fh, fileCluster[i]);
-                if (fh >= 0) {
-                    mcio_mcRead(fh, buff, HISTORY_FILE_SIZE);
-                    readSlots(buff, slots_new);
-                    for (int j = 0; j < HISTORY_ENTRY_COUNT; j++) {
-                        if (slots_new[j] != slotCount[i][j]) {
-                            if (ps2_mmceman_set_gameid(&buff[j * HISTORY_ENTRY_SIZE]))
-                                break;
-                        }
-                    }
-                    mcio_mcClose(fh);
-                    memcpy((void*)slotCount[i], (void*)slots_new, HISTORY_ENTRY_COUNT);
-                } else {
-                    log(LOG_INFO, "File exists, but handle returned %d\n", fh);
-                }
-            }
-            refreshRequired[i] = false;
-        }
+        ps2_history_tracker_refresh();
         status = HISTORY_STATUS_WAITING_WRITE;
     }
 }
@@ -17,6 +17,7 @@
 
 #include "ps2/card_emu/ps2_memory_card.h"
 #include "ps2_mmceman_commands.h"
+#include "ps2_mmceman_debug.h"
 #include "ps2/ps2_cardman.h"
 
 #include "game_db/game_db.h"
@@ -111,6 +112,8 @@ void ps2_mmceman_task(void) {
         mmceman_cmd = 0;
     }
 
+    mmce_profiling_task();
+
     if (ps2_cardman_needs_update()
         && (mmceman_switching_timeout < time_us_64())
         && !input_is_any_down()
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/_default_fcntl.h>
+#include "pico/time.h"
 
 #include "sd.h"
 #include "config.h"
@@ -208,6 +209,27 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     log(LOG_INFO, "received MMCEMAN_RESET\n");
 }
 
+/* Profiler control, action byte is one of MMCEMAN_PROF_*.
+ * Replies with the recording state and the number of buffered entries */
+inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_profile)(void)
+{
+    uint8_t cmd;
+    uint16_t count;
+
+    mc_respond(0x0); receiveOrNextCmd(&cmd); //reserved byte
+    mc_respond(0x0); receiveOrNextCmd(&cmd); //action
+
+    mmce_profiling_control(cmd);
+    count = mmce_profiling_count();
+
+    mc_respond(mmce_profiling_is_enabled()); receiveOrNextCmd(&cmd); //recording state
+    mc_respond(count >> 8);                  receiveOrNextCmd(&cmd); //entries upper 8 bits
+    mc_respond(count & 0xff);                receiveOrNextCmd(&cmd); //entries lower 8 bits
+    mc_respond(term);
+
+    log(LOG_INFO, "received MMCEMAN_PROFILE\n");
+}
+
 inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_fs_open)(void)
 {
     uint8_t cmd;
@@ -219,7 +241,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     {
         //Packet #1: Command and flags
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_OPEN);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();            //Wait for file handling to be ready
@@ -267,7 +289,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(op_data->fd, 0);
         break;
     }
 }
@@ -276,7 +298,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
 {
     uint8_t cmd;
 
-    MP_CMD_START();
+    MP_CMD_START(MMCEMAN_CMD_FS_CLOSE);
     mmceman_op_in_progress = true;
 
     ps2_mmceman_fs_wait_ready();
@@ -298,7 +320,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     mc_respond(term);
 
     mmceman_op_in_progress = false;
-    MP_CMD_END();
+    MP_CMD_END(op_data->fd, 0);
 
 }
 
@@ -317,7 +339,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet #1: File handle, length, and return value
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_READ);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();        //Wait for file handling to be ready
@@ -493,7 +515,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(op_data->fd, op_data->length);
         break;
     }
 }
@@ -514,6 +536,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet 1: File descriptor, length, and return value
         case 0:
+            MP_CMD_START(MMCEMAN_CMD_FS_WRITE);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();            //Wait for file handling to be ready
@@ -602,6 +625,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
                 mmceman_transfer_stage = 1;
 
                 //Start write to sdcard
+                MP_SIGNAL_OP();
                 ps2_mmceman_fs_signal_operation(MMCEMAN_FS_WRITE);
 
                 //Reset tail idx
@@ -635,6 +659,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
+            MP_CMD_END(op_data->fd, op_data->length);
         break;
     }
 }
@@ -645,7 +670,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     uint8_t *offset8 = NULL;
     uint8_t *position8 = NULL;
 
-    MP_CMD_START();
+    MP_CMD_START(MMCEMAN_CMD_FS_LSEEK);
     mmceman_op_in_progress = true;
 
     ps2_mmceman_fs_wait_ready();
@@ -697,7 +722,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     mc_respond(term);
 
     mmceman_op_in_progress = false;
-    MP_CMD_END();
+    MP_CMD_END(op_data->fd, 0);
 }
 
 
@@ -709,7 +734,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet #1: Command and padding
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_REMOVE);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -752,7 +777,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(-1, 0);
         break;
     }
 }
@@ -765,7 +790,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet #1: Command and padding
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_MKDIR);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -807,7 +832,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(-1, 0);
         break;
     }
 }
@@ -820,7 +845,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet #1: Command and padding
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_RMDIR);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -862,7 +887,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(-1, 0);
         break;
     }
 }
@@ -876,7 +901,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     {
         //Packet #1: Command and padding
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_DOPEN);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -920,7 +945,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(op_data->fd, 0);
         break;
     }
 }
@@ -929,7 +954,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
 {
     uint8_t cmd;
 
-    MP_CMD_START();
+    MP_CMD_START(MMCEMAN_CMD_FS_DCLOSE);
     mmceman_op_in_progress = true;
 
     ps2_mmceman_fs_wait_ready();
@@ -953,7 +978,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     mc_respond(term);
 
     mmceman_op_in_progress = false;
-    MP_CMD_END();
+    MP_CMD_END(op_data->fd, 0);
 }
 
 inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_fs_dread)(void)
@@ -964,7 +989,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet #1: File descriptor
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_DREAD);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -1065,7 +1090,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(op_data->fd, 0);
         break;
     }
 }
@@ -1078,7 +1103,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     switch(mmceman_transfer_stage) {
         //Packet #1: File descriptor
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_GETSTAT);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -1159,7 +1184,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(-1, 0);
         break;
     }
 }
@@ -1170,7 +1195,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     uint8_t *offset8 = NULL;
     uint8_t *position8 = NULL;
 
-    MP_CMD_START();
+    MP_CMD_START(MMCEMAN_CMD_FS_LSEEK64);
     mmceman_op_in_progress = true;
 
     ps2_mmceman_fs_wait_ready();
@@ -1235,7 +1260,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     mc_respond(term);
 
     mmceman_op_in_progress = false;
-    MP_CMD_END();
+    MP_CMD_END(op_data->fd, 0);
 }
 
 //Used only by MMCEDRV atm
@@ -1251,10 +1276,11 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     uint8_t next_chunk;
     uint32_t bytes_left_in_packet;
     uint64_t offset;
+    bool use_read_ahead = false;
 
     switch(mmceman_transfer_stage) {
         case 0:
-            MP_CMD_START();
+            MP_CMD_START(MMCEMAN_CMD_FS_READ_SECTOR);
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();
@@ -1280,15 +1306,18 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
 
             offset = ((uint64_t)sector) * 2048;
 
-            //chunk read ahead, skip seeking
+            op_data->read_ahead.sequential = (op_data->fd == op_data->read_ahead.last_fd && sector == op_data->read_ahead.next_sector);
+
+            //Chunks already in the ring from read ahead, skip seeking
             if (op_data->read_ahead.fd == op_data->fd && op_data->read_ahead.valid && op_data->read_ahead.pos == offset) {
 
-                log(LOG_INFO, "%s: fd: %i, got valid read ahead, skipping seek\n", __func__, op_data->fd);
+                log(LOG_INFO, "%s: fd: %i, got %u bytes read ahead, skipping seek\n", __func__, op_data->fd, op_data->read_ahead.bytes);
 
-                //Mark as consumed
+                //Take over the ring, core 0 continues reading after the last chunk
                 op_data->read_ahead.valid = 0;
-                op_data->bytes_read = CHUNK_SIZE;
-                op_data->use_read_ahead = 1;
+                op_data->bytes_read = op_data->read_ahead.bytes;
+                op_data->head_idx = (op_data->read_ahead.bytes / CHUNK_SIZE) % (CHUNK_COUNT + 1);
+                use_read_ahead = true;
             } else {
                 //NOTE: Heavy fragmentation can result in long seek times and sometimes failed seeks altogether
                 log(LOG_INFO, "%s: fd: %i, seeking to offset %llu\n", __func__, op_data->fd, (long long unsigned int)offset);
@@ -1313,42 +1342,52 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
 
             op_data->length = count * 2048;
 
+            op_data->read_ahead.last_fd = op_data->fd;
+            op_data->read_ahead.next_sector = sector + count;
+
+            //Read ahead went past this request, drop the extra chunks and put the file position back
+            if (use_read_ahead && op_data->bytes_read > op_data->length) {
+                critical_section_enter_blocking(&mmceman_fs_crit);
+                for (uint32_t i = op_data->length / CHUNK_SIZE; i < op_data->bytes_read / CHUNK_SIZE; i++)
+                    op_data->chunk_state[i % (CHUNK_COUNT + 1)] = CHUNK_STATE_NOT_READY;
+                critical_section_exit(&mmceman_fs_crit);
+
+                op_data->bytes_read = op_data->length;
+                op_data->offset64 = offset + op_data->length;
+                op_data->whence64 = 0;
+                ps2_mmceman_fs_signal_operation(MMCEMAN_FS_LSEEK64);
+                ps2_mmceman_fs_wait_ready();
+            }
+
             MP_SIGNAL_OP();
             ps2_mmceman_fs_signal_operation(MMCEMAN_FS_READ);
 
             log(LOG_INFO, "%s: sector: %u, count: %u, length: %u\n", __func__, sector, count, op_data->length);
 
-            if (op_data->use_read_ahead != 1) {
-
-                while(op_data->chunk_state[op_data->tail_idx] != CHUNK_STATE_READY) {
+            //Returns immediately if the first chunk came from read ahead
+            while(op_data->chunk_state[op_data->tail_idx] != CHUNK_STATE_READY) {
 
-                    //Set by /CS high INTR, catch timeout condition
-                    if (mmceman_timeout_detected)
-                        return;
-
-                    log(LOG_TRACE, "w: %u s:%u\n", op_data->tail_idx, op_data->chunk_state[op_data->tail_idx]);
+                //Set by /CS high INTR, catch timeout condition
+                if (mmceman_timeout_detected)
+                    return;
 
-                    //Reading ahead failed to get requested chunks
-                    if (op_data->chunk_state[op_data->tail_idx] == CHUNK_STATE_INVALID) {
-                        log(LOG_ERROR, "Failed to read chunk, got CHUNK_STATE_INVALID, aborting\n");
-                        op_data->chunk_state[op_data->tail_idx] = CHUNK_STATE_NOT_READY;
-                        mc_respond(0x1);    //Return 1
-                        mmceman_op_in_progress = false;
-                        return;             //Abort
-                    }
+                log(LOG_TRACE, "w: %u s:%u\n", op_data->tail_idx, op_data->chunk_state[op_data->tail_idx]);
 
-                    sleep_us(1);
+                //Reading ahead failed to get requested chunks
+                if (op_data->chunk_state[op_data->tail_idx] == CHUNK_STATE_INVALID) {
+                    log(LOG_ERROR, "Failed to read chunk, got CHUNK_STATE_INVALID, aborting\n");
+                    op_data->chunk_state[op_data->tail_idx] = CHUNK_STATE_NOT_READY;
+                    mc_respond(0x1);    //Return 1
+                    mmceman_op_in_progress = false;
+                    return;             //Abort
                 }
 
-                //Place the first byte of the chunk in TX FIFO on reset to ensure proper alignment
-                ps2_mmceman_queue_tx(op_data->buffer[op_data->tail_idx][0]);
-
-            //We already have a chunk ahead, no need to wait
-            } else {
-                //Place the first byte of the chunk in TX FIFO on reset to ensure proper alignment
-                ps2_mmceman_queue_tx(op_data->read_ahead.buffer[0]);
+                sleep_us(1);
             }
 
+            //Place the first byte of the chunk in TX FIFO on reset to ensure proper alignment
+            ps2_mmceman_queue_tx(op_data->buffer[op_data->tail_idx][0]);
+
             ps2_mmceman_set_cb(&ps2_mmceman_cmd_fs_read_sector);
 
             mmceman_transfer_stage = 1;
@@ -1365,34 +1404,17 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             if (bytes_left_in_packet >= CHUNK_SIZE)
                 bytes_left_in_packet = CHUNK_SIZE - 1; //Since 1 byte was already sent out
 
-            //If we're using the read ahead buffer instead of the ring buffer, avoid incrementing tail idx for now
-            if (op_data->use_read_ahead == 1) {
-                next_chunk = op_data->tail_idx;
-            } else {
-                next_chunk = op_data->tail_idx + 1;
-                if (next_chunk > CHUNK_COUNT)
-                    next_chunk = 0;
-            }
-
-            //Using chunk from read ahead buffer
-            if (op_data->use_read_ahead == 1) {
-                //Send up until the last byte
-                for (uint32_t i = 1; i < bytes_left_in_packet; i++) {
-                    mc_respond(op_data->read_ahead.buffer[i]);
-                }
-
-                last_byte = op_data->read_ahead.buffer[bytes_left_in_packet];
-
-            //Use chunk from ring buffer
-            } else {
-                //Send up until the last byte
-                for (uint32_t i = 1; i < bytes_left_in_packet; i++) {
-                    mc_respond(op_data->buffer[op_data->tail_idx][i]);
-                }
+            next_chunk = op_data->tail_idx + 1;
+            if (next_chunk > CHUNK_COUNT)
+                next_chunk = 0;
 
-                last_byte = op_data->buffer[op_data->tail_idx][bytes_left_in_packet];
+            //Send up until the last byte
+            for (uint32_t i = 1; i < bytes_left_in_packet; i++) {
+                mc_respond(op_data->buffer[op_data->tail_idx][i]);
             }
 
+            last_byte = op_data->buffer[op_data->tail_idx][bytes_left_in_packet];
+
             //Check if there's more chunks after this
             if ((bytes_left_in_packet + op_data->bytes_transferred) < op_data->length) {
 
@@ -1419,25 +1441,15 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             //Update transferred count
             op_data->bytes_transferred += bytes_left_in_packet;
 
-            //Using read ahead buffer
-            if (op_data->use_read_ahead) {
-                op_data->use_read_ahead = 0;
-                op_data->read_ahead.valid = 0;
-
-                log(LOG_TRACE, "ra c, bip: %u\n", (bytes_left_in_packet + 1));
-
-            //Using ring buffer
-            } else {
-                //Enter crit and mark chunk as consumed
-                critical_section_enter_blocking(&mmceman_fs_crit);
-                op_data->chunk_state[op_data->tail_idx] = CHUNK_STATE_NOT_READY;
-                critical_section_exit(&mmceman_fs_crit);
+            //Enter crit and mark chunk as consumed
+            critical_section_enter_blocking(&mmceman_fs_crit);
+            op_data->chunk_state[op_data->tail_idx] = CHUNK_STATE_NOT_READY;
+            critical_section_exit(&mmceman_fs_crit);
 
-                log(LOG_TRACE, "%u c, bip: %u\n", op_data->tail_idx, (bytes_left_in_packet + 1));
+            log(LOG_TRACE, "%u c, bip: %u\n", op_data->tail_idx, (bytes_left_in_packet + 1));
 
-                //Update tail idx
-                op_data->tail_idx = next_chunk;
-            }
+            //Update tail idx
+            op_data->tail_idx = next_chunk;
 
             //If there aren't anymore chunks left after this, move to final transfer stage
             if (op_data->bytes_transferred == op_data->length)
@@ -1462,7 +1474,15 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(count8[0x1]); receiveOrNextCmd(&cmd);
             mc_respond(count8[0x0]); receiveOrNextCmd(&cmd);
 
-            ps2_mmceman_fs_signal_operation(MMCEMAN_FS_READ_AHEAD);
+            /* Read ahead while the PS2 processes this batch. Sequential access
+             * gets as much of the next request as fits in the ring, anything
+             * else a single chunk */
+            if (op_data->transfer_failed == 0) {
+                op_data->read_ahead.len = op_data->read_ahead.sequential ? op_data->length : CHUNK_SIZE;
+                ps2_mmceman_fs_signal_operation(MMCEMAN_FS_READ_AHEAD);
+            }
+
+            op_data->transfer_failed = 0; //clear fail state
 
             ps2_mmceman_set_cb(NULL);
 
@@ -1470,7 +1490,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
-            MP_CMD_END();
+            MP_CMD_END(op_data->fd, op_data->length);
         break;
     }
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #define MMCEMAN_GET_GAMEID 0x7
 #define MMCEMAN_SET_GAMEID 0x8
 #define MMCEMAN_RESET 0x9
+#define MMCEMAN_PROFILE 0xA
 
 //TEMP
 #define MMCEMAN_SWITCH_BOOTCARD 0x20
@@ -47,6 +48,7 @@ extern void ps2_mmceman_cmd_get_gameid(void);
 extern void ps2_mmceman_cmd_set_gameid(void);
 extern void ps2_mmceman_cmd_unmount_bootcard(void);
 extern void ps2_mmceman_cmd_reset(void);
+extern void ps2_mmceman_cmd_profile(void);
 
 extern void ps2_mmceman_cmd_fs_open(void);
 extern void ps2_mmceman_cmd_fs_close(void);
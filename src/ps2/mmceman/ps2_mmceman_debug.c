@@ -1,19 +1,213 @@
 #include "ps2_mmceman_debug.h"
 #include "pico/platform.h"
+#include "hardware/timer.h"
 
 #include <stdio.h>
+#include <sys/_default_fcntl.h>
 
-struct timeval tv_start_cmd, tv_end_cmd, tv_signal_mmce_fs, tv_start_mmce_fs, tv_end_mmce_fs;
+#include "sd.h"
+#include "debug.h"
 
-//TODO: fix
-void mmce_profiling_stat()
+#if LOG_LEVEL_MMCEMAN == 0
+#define log(x...)
+#else
+#define log(level, fmt, x...) LOG_PRINT(LOG_LEVEL_MMCEMAN, level, fmt, ##x)
+#endif
+
+#if MMCEMAN_PROFILING != 0
+
+/* Op tracking, only the first op signaled through MP_SIGNAL_OP after
+ * MP_CMD_START is accounted for, helper ops like VALIDATE_FD are not */
+#define PROF_OP_IDLE        0x0
+#define PROF_OP_SIGNALED    0x1
+#define PROF_OP_RUNNING     0x2
+#define PROF_OP_DONE        0x3
+
+volatile bool mmce_prof_enabled = false;
+volatile bool mmce_prof_active = false;
+
+static mmce_prof_entry_t prof_ring[MMCEMAN_PROF_RING_SIZE];
+static volatile uint16_t prof_head;
+static volatile uint16_t prof_count;
+
+static volatile uint8_t prof_cmd;
+static volatile uint8_t prof_op_state;
+static volatile uint32_t prof_cmd_start, prof_signal, prof_op_start, prof_op_end;
+
+static volatile uint8_t prof_dump_req;
+/* Set while core 0 reads the ring, commands finishing meanwhile are dropped */
+static volatile bool prof_dumping;
+
+void __time_critical_func(mmce_profiling_cmd_start)(uint8_t cmd)
+{
+    prof_cmd = cmd;
+    prof_op_state = PROF_OP_IDLE;
+    prof_cmd_start = time_us_32();
+}
+
+void __time_critical_func(mmce_profiling_signal_op)(void)
+{
+    if (prof_op_state == PROF_OP_IDLE) {
+        prof_signal = time_us_32();
+        prof_op_state = PROF_OP_SIGNALED;
+    }
+}
+
+void __time_critical_func(mmce_profiling_op_start)(void)
 {
-    long cmd_elasped = (tv_end_cmd.tv_sec - tv_start_cmd.tv_sec) * 1000000 + tv_end_cmd.tv_usec - tv_start_cmd.tv_usec; 
-    //long mmce_fs_elasped = (tv_end_mmce_fs.tv_sec - tv_start_mmce_fs.tv_sec) * 1000000 + tv_end_mmce_fs.tv_usec - tv_start_mmce_fs.tv_usec; 
-    //long cmd_mmce_fs_diff = (tv_start_mmce_fs.tv_sec - tv_signal_mmce_fs.tv_sec) * 1000000 + tv_start_mmce_fs.tv_usec - tv_signal_mmce_fs.tv_usec; 
+    if (prof_op_state == PROF_OP_SIGNALED) {
+        prof_op_start = time_us_32();
+        prof_op_state = PROF_OP_RUNNING;
+    }
+}
 
-    printf("[STAT] Command completed in: %liuS\n", cmd_elasped);
-    //printf("MMCE FS time: %liuS\n", mmce_fs_elasped);
-    //printf("Signal op -> start of op: %liuS\n", cmd_mmce_fs_diff);
-    printf("\n");
+void __time_critical_func(mmce_profiling_op_end)(void)
+{
+    if (prof_op_state == PROF_OP_RUNNING) {
+        prof_op_end = time_us_32();
+        prof_op_state = PROF_OP_DONE;
+    }
+}
+
+void __time_critical_func(mmce_profiling_cmd_end)(int fd, uint32_t len)
+{
+    uint32_t now = time_us_32();
+    mmce_prof_entry_t *entry = &prof_ring[prof_head];
+
+    if (prof_dumping) {
+        prof_op_state = PROF_OP_IDLE;
+        return;
+    }
+
+    entry->cmd = prof_cmd;
+    entry->fd = (int8_t)fd;
+    entry->len = len;
+    entry->start_us = prof_cmd_start;
+    entry->xfer_us = now - prof_cmd_start;
+    entry->signal_us = (prof_op_state >= PROF_OP_RUNNING) ? (prof_op_start - prof_signal) : 0;
+    entry->op_us = (prof_op_state == PROF_OP_DONE) ? (prof_op_end - prof_op_start) : 0;
+
+    prof_head = (prof_head + 1) % MMCEMAN_PROF_RING_SIZE;
+    if (prof_count < MMCEMAN_PROF_RING_SIZE)
+        prof_count++;
+
+    prof_op_state = PROF_OP_IDLE;
+}
+
+void __time_critical_func(mmce_profiling_control)(uint8_t action)
+{
+    switch (action) {
+        case MMCEMAN_PROF_OFF:
+            mmce_prof_enabled = false;
+            break;
+        case MMCEMAN_PROF_ON:
+            prof_op_state = PROF_OP_IDLE;
+            mmce_prof_enabled = true;
+            break;
+        case MMCEMAN_PROF_CLEAR:
+            prof_head = 0;
+            prof_count = 0;
+            break;
+        case MMCEMAN_PROF_DUMP_UART:
+        case MMCEMAN_PROF_DUMP_SD:
+            //SD access and printing are left to core 0
+            prof_dump_req = action;
+            break;
+        default:
+            break;
+    }
+}
+
+uint16_t __time_critical_func(mmce_profiling_count)(void)
+{
+    return prof_count;
+}
+
+bool __time_critical_func(mmce_profiling_is_enabled)(void)
+{
+    return mmce_prof_enabled;
 }
+
+static int mmce_profiling_format(char *line, size_t size, int idx, const mmce_prof_entry_t *entry)
+{
+    return snprintf(line, size, "%i,0x%02x,%i,%lu,%lu,%lu,%lu,%lu\n",
+                    idx, entry->cmd, entry->fd,
+                    (unsigned long)entry->len,
+                    (unsigned long)entry->start_us,
+                    (unsigned long)entry->signal_us,
+                    (unsigned long)entry->op_us,
+                    (unsigned long)entry->xfer_us);
+}
+
+static void mmce_profiling_dump(bool to_sd)
+{
+    static const char header[] = "idx,cmd,fd,len,start_us,signal_to_start_us,op_us,xfer_us\n";
+    char line[96];
+    int fd = -1;
+
+    //Stop recording so core 1 doesn't overwrite entries while dumping
+    prof_dumping = true;
+
+    uint16_t count = prof_count;
+    uint16_t first = (prof_head + MMCEMAN_PROF_RING_SIZE - count) % MMCEMAN_PROF_RING_SIZE;
+
+    if (to_sd) {
+        fd = sd_open(MMCEMAN_PROF_CSV_PATH, O_WRONLY | O_CREAT | O_TRUNC);
+        if (fd < 0) {
+            log(LOG_ERROR, "%s: failed to open %s\n", __func__, MMCEMAN_PROF_CSV_PATH);
+            prof_dumping = false;
+            return;
+        }
+        sd_write(fd, (void*)header, sizeof(header) - 1);
+    } else {
+        printf("%s", header);
+    }
+
+    for (int i = 0; i < count; i++) {
+        int len = mmce_profiling_format(line, sizeof(line), i, &prof_ring[(first + i) % MMCEMAN_PROF_RING_SIZE]);
+        if (to_sd)
+            sd_write(fd, line, len);
+        else
+            printf("%s", line);
+    }
+
+    if (to_sd) {
+        sd_close(fd);
+        log(LOG_INFO, "%s: wrote %u entries to %s\n", __func__, count, MMCEMAN_PROF_CSV_PATH);
+    }
+
+    prof_dumping = false;
+}
+
+void mmce_profiling_task(void)
+{
+    uint8_t req = prof_dump_req;
+
+    if (req != 0) {
+        prof_dump_req = 0;
+        mmce_profiling_dump(req == MMCEMAN_PROF_DUMP_SD);
+    }
+}
+
+#else
+
+void mmce_profiling_control(uint8_t action)
+{
+    (void)action;
+}
+
+uint16_t mmce_profiling_count(void)
+{
+    return 0;
+}
+
+bool mmce_profiling_is_enabled(void)
+{
+    return false;
+}
+
+void mmce_profiling_task(void)
+{
+}
+
+#endif
@@ -1,10 +1,35 @@
 #pragma once
 
-#include <sys/time.h>
-#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <pico/platform.h>
 
-#define MMCEMAN_PROFILING 0
+/* Compiles the MMCE profiler in. Recording itself is off by default and is
+ * toggled at runtime through MMCEMAN_PROFILE (see ps2_mmceman_commands.h) */
+#ifndef MMCEMAN_PROFILING
+#define MMCEMAN_PROFILING 1
+#endif
+
+/* Number of commands kept in the RAM ring, oldest entries get overwritten */
+#define MMCEMAN_PROF_RING_SIZE 128
+
+#define MMCEMAN_PROF_OFF        0x0
+#define MMCEMAN_PROF_ON         0x1
+#define MMCEMAN_PROF_CLEAR      0x2
+#define MMCEMAN_PROF_DUMP_UART  0x3
+#define MMCEMAN_PROF_DUMP_SD    0x4
+
+#define MMCEMAN_PROF_CSV_PATH   "/.sd2psx/mmce_profile.csv"
+
+typedef struct mmce_prof_entry_t {
+    uint32_t start_us;      //time_us_32 when the command was received
+    uint32_t signal_us;     //op signaled by core 1 -> op picked up by core 0
+    uint32_t op_us;         //op runtime on core 0
+    uint32_t xfer_us;       //first byte of the command -> termination byte
+    uint32_t len;           //requested transfer length, 0 if n/a
+    uint8_t  cmd;
+    int8_t   fd;
+} mmce_prof_entry_t;
 
 #if MMCEMAN_PROFILING == 0
 #define MP_CMD_START(x...)
@@ -13,18 +38,28 @@
 #define MP_OP_START(x...)
 #define MP_OP_END(x...)
 #else
-extern struct timeval tv_start_cmd, tv_end_cmd, tv_signal_mmce_fs, tv_start_mmce_fs, tv_end_mmce_fs;
-extern void mmce_profiling_stat();
-#define MP_CMD_START() gettimeofday(&tv_start_cmd, 0)
-#define MP_SIGNAL_OP() gettimeofday(&tv_signal_mmce_fs, 0)
-#define MP_OP_START() gettimeofday(&tv_start_mmce_fs, 0)
-#define MP_OP_END() gettimeofday(&tv_end_mmce_fs, 0)
-#define MP_CMD_END() do { \
-                        gettimeofday(&tv_end_cmd, 0); \
-                        mmce_profiling_stat(); \
-                    } while (0)
-#endif
+extern volatile bool mmce_prof_enabled;
+/* mmce_prof_enabled as it was when the current command started, toggling
+ * profiling mid-command must not record half of it */
+extern volatile bool mmce_prof_active;
 
+void mmce_profiling_cmd_start(uint8_t cmd);
+void mmce_profiling_cmd_end(int fd, uint32_t len);
+void mmce_profiling_signal_op(void);
+void mmce_profiling_op_start(void);
+void mmce_profiling_op_end(void);
 
+#define MP_CMD_START(cmd) do { mmce_prof_active = mmce_prof_enabled; if (mmce_prof_active) mmce_profiling_cmd_start(cmd); } while (0)
+#define MP_CMD_END(fd, len) do { if (mmce_prof_active) mmce_profiling_cmd_end(fd, len); mmce_prof_active = false; } while (0)
+#define MP_SIGNAL_OP() do { if (mmce_prof_active) mmce_profiling_signal_op(); } while (0)
+#define MP_OP_START() do { if (mmce_prof_active) mmce_profiling_op_start(); } while (0)
+#define MP_OP_END() do { if (mmce_prof_active) mmce_profiling_op_end(); } while (0)
+#endif
 
+//Core 1
+void mmce_profiling_control(uint8_t action);
+uint16_t mmce_profiling_count(void);
+bool mmce_profiling_is_enabled(void);
 
+//Core 0
+void mmce_profiling_task(void);
@@ -53,6 +53,9 @@ void ps2_mmceman_fs_init(void)
 
     op_data.read_ahead.fd = -1;
     op_data.read_ahead.valid = 0;
+    op_data.read_ahead.bytes = 0;
+    op_data.read_ahead.last_fd = -1;
+    op_data.read_ahead.sequential = 0;
 
     op_data.transfer_failed = 0;
 
@@ -69,13 +72,36 @@ bool ps2_mmceman_fs_idle(void)
     return (mmceman_fs_operation == MMCEMAN_FS_NONE);
 }
 
+/* Any op other than a matching read_sector gives up the read ahead. Rewind
+ * the file to where the PS2 expects it and release the ring chunks */
+static void ps2_mmceman_fs_discard_read_ahead(void)
+{
+    log(LOG_INFO, "Discarding %u bytes read ahead\n", op_data.read_ahead.bytes);
+
+    sd_seek64(op_data.read_ahead.fd, op_data.read_ahead.pos, 0);
+
+    critical_section_enter_blocking(&mmceman_fs_crit);
+    memset((void*)op_data.chunk_state, 0, sizeof(op_data.chunk_state));
+    critical_section_exit(&mmceman_fs_crit);
+
+    op_data.read_ahead.valid = 0;
+    op_data.read_ahead.bytes = 0;
+}
+
 void ps2_mmceman_fs_run(void)
 {
     uint32_t bytes_in_chunk = 0;
     uint32_t write_size = 0;
+    uint32_t read_ahead_len = 0;
+
+    if (mmceman_fs_operation == MMCEMAN_FS_NONE)
+        return;
 
     MP_OP_START();
 
+    if (op_data.read_ahead.valid && mmceman_fs_operation != MMCEMAN_FS_READ_AHEAD)
+        ps2_mmceman_fs_discard_read_ahead();
+
     switch (mmceman_fs_operation) {
         case MMCEMAN_FS_OPEN:
             op_data.fd = sd_open((const char*)op_data.buffer[0], op_data.flags);
@@ -90,11 +116,9 @@ void ps2_mmceman_fs_run(void)
         case MMCEMAN_FS_CLOSE:
             op_data.rv = sd_close(op_data.fd);
 
-            //Discard data read ahead from file
-            if (op_data.fd == op_data.read_ahead.fd) {
-                op_data.read_ahead.fd = -1;
-                op_data.read_ahead.valid = 0;
-            }
+            //Reset sequence detection for this fd
+            if (op_data.fd == op_data.read_ahead.last_fd)
+                op_data.read_ahead.last_fd = -1;
 
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
@@ -162,26 +186,52 @@ void ps2_mmceman_fs_run(void)
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
-        /* Try to read a single chunk ahead into a separate buffer */
+        /* Fill the chunk ring ahead of the current file position, read_sector
+         * picks it up if the next request starts where this one ended */
         case MMCEMAN_FS_READ_AHEAD:
             op_data.filesize = sd_filesize64(op_data.fd);
+            op_data.read_ahead.pos = sd_tell64(op_data.fd);
+            op_data.read_ahead.bytes = 0;
 
-            log(LOG_INFO, "Entering read ahead\n");
+            read_ahead_len = op_data.read_ahead.len;
+            if (read_ahead_len > READ_AHEAD_MAX)
+                read_ahead_len = READ_AHEAD_MAX;
 
             //Check if reading beyond file size
-            if (sd_tell64(op_data.fd) + CHUNK_SIZE <= op_data.filesize) {
-                op_data.read_ahead.pos = sd_tell64(op_data.fd);
-                op_data.rv = sd_read(op_data.fd, (void*)op_data.read_ahead.buffer, CHUNK_SIZE);
-
-                if (op_data.rv == CHUNK_SIZE) {
-                    log(LOG_INFO, "Read ahead: %i\n", op_data.rv);
-                    op_data.read_ahead.fd = op_data.fd;
-                    op_data.read_ahead.valid = 1;
-                } else {
+            if (op_data.read_ahead.pos + read_ahead_len > op_data.filesize) {
+                if (op_data.read_ahead.pos < op_data.filesize)
+                    read_ahead_len = (op_data.filesize - op_data.read_ahead.pos) & ~(CHUNK_SIZE - 1);
+                else
+                    read_ahead_len = 0;
+            }
+
+            log(LOG_INFO, "Entering read ahead, len: %u\n", read_ahead_len);
+
+            critical_section_enter_blocking(&mmceman_fs_crit);
+            memset((void*)op_data.chunk_state, 0, sizeof(op_data.chunk_state));
+            critical_section_exit(&mmceman_fs_crit);
+
+            for (int i = 0; op_data.read_ahead.bytes < read_ahead_len; i++) {
+                op_data.rv = sd_read(op_data.fd, (void*)op_data.buffer[i], CHUNK_SIZE);
+
+                if (op_data.rv != CHUNK_SIZE) {
                     log(LOG_ERROR, "Failed to read ahead %i bytes, got %i\n", CHUNK_SIZE, op_data.rv);
+                    //Keep the file position in line with the chunks that made it
+                    sd_seek64(op_data.fd, op_data.read_ahead.pos + op_data.read_ahead.bytes, 0);
+                    break;
                 }
-            } else {
-                log(LOG_WARN, "Skipping request to read ahead beyond file length\n");
+
+                critical_section_enter_blocking(&mmceman_fs_crit);
+                op_data.chunk_state[i] = CHUNK_STATE_READY;
+                critical_section_exit(&mmceman_fs_crit);
+
+                op_data.read_ahead.bytes += CHUNK_SIZE;
+            }
+
+            if (op_data.read_ahead.bytes > 0) {
+                log(LOG_INFO, "Read ahead: %u\n", op_data.read_ahead.bytes);
+                op_data.read_ahead.fd = op_data.fd;
+                op_data.read_ahead.valid = 1;
             }
 
             mmceman_fs_operation = MMCEMAN_FS_NONE;
@@ -203,20 +253,6 @@ void ps2_mmceman_fs_run(void)
         break;
 
         case MMCEMAN_FS_LSEEK:
-            //If we're seeking on a file that has data read ahead
-            if ((op_data.fd == op_data.read_ahead.fd) && (op_data.read_ahead.valid == 1)) {
-
-                //SEEK_CUR - adjust offset
-                if (op_data.whence == 1) {
-                    DPRINTF("C1: Correcting SEEK_CUR offset: %i\n", op_data.offset);
-                    op_data.offset -= CHUNK_SIZE;
-                    DPRINTF("C1: New offset: %i\n", op_data.offset);
-                }
-
-                //Invalidate data read ahead
-                op_data.read_ahead.valid = 0;
-            }
-
             sd_seek(op_data.fd, op_data.offset, op_data.whence);
             op_data.position = sd_tell(op_data.fd);
 
@@ -224,20 +260,6 @@ void ps2_mmceman_fs_run(void)
         break;
 
         case MMCEMAN_FS_LSEEK64:
-            //If we're seeking on a file that has data read ahead
-            if ((op_data.fd == op_data.read_ahead.fd) && (op_data.read_ahead.valid == 1)) {
-
-                //SEEK_CUR - adjust offset
-                if (op_data.whence64 == 1) {
-                    DPRINTF("C1: Correcting SEEK_CUR offset: %lli\n", op_data.offset64);
-                    op_data.offset64 -= CHUNK_SIZE;
-                    DPRINTF("C1: New offset: %lli\n", op_data.offset64);
-                }
-
-                //Invalidate data read ahead
-                op_data.read_ahead.valid = 0;
-            }
-
             sd_seek64(op_data.fd, op_data.offset64, op_data.whence64);
             op_data.position64 = sd_tell64(op_data.fd);
 
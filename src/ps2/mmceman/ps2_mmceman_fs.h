@@ -34,16 +34,24 @@
 #define CHUNK_SIZE 256
 #define CHUNK_COUNT 15
 
+#define READ_AHEAD_MAX ((CHUNK_COUNT + 1) * CHUNK_SIZE)
+
 #define CHUNK_STATE_NOT_READY 0x0
 #define CHUNK_STATE_READY 0x1
 #define CHUNK_STATE_INVALID 0x2
 
-//Single chunk read ahead on open, lseek, and after read
+//Read ahead into the chunk ring after read_sector, kept until the next op
 typedef struct ps2_mmceman_fs_read_ahead_t {
     int fd;
     int valid;
-    uint64_t pos;
-    uint8_t buffer[CHUNK_SIZE];
+    uint64_t pos;           //file offset of the first byte in the ring
+    uint32_t bytes;         //bytes ready in the ring, multiple of CHUNK_SIZE
+    uint32_t len;           //bytes requested, capped to ring capacity
+
+    //Sequence detection, updated by read_sector
+    int last_fd;
+    uint32_t next_sector;
+    int sequential;
 } ps2_mmceman_fs_read_ahead_t;
 
 typedef struct ps2_mmceman_fs_op_data_t {
@@ -74,7 +82,6 @@ typedef struct ps2_mmceman_fs_op_data_t {
     volatile uint8_t chunk_state[CHUNK_COUNT + 1]; //written to by both cores, writes encased in critical section
 
     uint8_t transfer_failed;
-    int use_read_ahead;
     ps2_mmceman_fs_read_ahead_t read_ahead;
 
     ps2_fileio_stat_t fileio_stat;
@@ -18,6 +18,7 @@
     #include "ps2_dirty.h"
     #include "psram/psram.h"
 #endif
+#include "ps2_save_index.h"
 #include "sd.h"
 #include "settings.h"
 #include "util.h"
@@ -45,7 +46,9 @@ uint8_t available_sectors[SECTOR_COUNT_8MB / 8];  // bitmap
 #else
 #define PSRAM_AVAILABLE false
 #endif
-static uint8_t flushbuf[BLOCK_SIZE];
+/* card creation writes this many blocks at once */
+#define CREATE_BLOCKS 4
+static uint8_t flushbuf[BLOCK_SIZE * CREATE_BLOCKS];
 int cardman_fd = -1;
 
 int current_read_sector = 0, priority_sector = -1;
@@ -122,6 +125,20 @@ int ps2_cardman_read_sector(int sector, void *buf512) {
     return 0;
 }
 
+/* Reads from PSRAM while the card lives there, SD may still lag behind */
+static int ps2_cardman_read_page(uint32_t page, void *buf512) {
+#if WITH_PSRAM
+    if (!ps2_mc_data_interface_get_sdmode()) {
+        ps2_dirty_lock();
+        psram_read_dma(page * BLOCK_SIZE, buf512, BLOCK_SIZE, NULL);
+        psram_wait_for_dma();
+        ps2_dirty_unlock();
+        return 0;
+    }
+#endif
+    return ps2_cardman_read_sector(page, buf512);
+}
+
 static bool try_set_next_named_card() {
     bool ret = false;
     if (cardman_state != PS2_CM_STATE_NAMED) {
@@ -406,6 +423,7 @@ static void ps2_cardman_continue(void) {
             if (cardman_cb)
                 cardman_cb(100, true);
             cardman_operation = CARDMAN_IDLE;
+            ps2_save_index_build(ps2_cardman_read_page);
 
         } else {
 #if WITH_PSRAM
@@ -423,6 +441,7 @@ static void ps2_cardman_continue(void) {
                         1000000.0 * card_size / (end - cardprog_start) / 1024);
                     if (cardman_cb)
                         cardman_cb(100, true);
+                    ps2_save_index_build(ps2_cardman_read_page);
                     break;
                 }
 
@@ -467,22 +486,33 @@ static void ps2_cardman_continue(void) {
                     1000000.0 * card_size / (end - cardprog_start) / 1024);
                 if (cardman_cb)
                     cardman_cb(100, true);
+                ps2_save_index_build(ps2_cardman_read_page);
 
                 break;
             }
+            size_t chunk = sizeof(flushbuf);
+            if (card_size - cardprog_pos < chunk)
+                chunk = card_size - cardprog_pos;
+
+            // dirty sectors may have been flushed in between, don't rely on the current position
+            if (sd_seek(cardman_fd, cardprog_pos, SEEK_SET) != 0)
+                fatal("cannot init memcard\nseek");
+
             if (!PSRAM_AVAILABLE || (settings_get_ps2_cardsize() > 8)) {
-                genblock(cardprog_pos, flushbuf);
-                sd_write(cardman_fd, flushbuf, BLOCK_SIZE);
+                for (size_t off = 0; off < chunk; off += BLOCK_SIZE)
+                    genblock(cardprog_pos + off, flushbuf + off);
+                sd_write(cardman_fd, flushbuf, chunk);
             } else {
 #if WITH_PSRAM
                 ps2_dirty_lock();
                 psram_wait_for_dma();
 
                 // read back from PSRAM to make sure to retain already rewritten sectors, if any
-                psram_read_dma(cardprog_pos, flushbuf, BLOCK_SIZE, NULL);
+                psram_segment_t seg = { cardprog_pos, flushbuf, chunk };
+                psram_read_list_dma(&seg, 1, NULL);
                 psram_wait_for_dma();
 
-                if (sd_write(cardman_fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
+                if (sd_write(cardman_fd, flushbuf, chunk) != (int)chunk)
                     fatal("cannot init memcard");
 
                 ps2_dirty_unlock();
@@ -492,7 +522,7 @@ static void ps2_cardman_continue(void) {
             if (cardman_cb)
                 cardman_cb(100U * (uint64_t)cardprog_pos / (uint64_t)card_size, cardman_operation == CARDMAN_IDLE);
 
-            cardman_sectors_done++;
+            cardman_sectors_done += chunk / BLOCK_SIZE;
         }
         sd_flush(cardman_fd);
 
@@ -548,6 +578,7 @@ void ps2_cardman_open(void) {
         }
         cardman_operation = CARDMAN_CREATE;
         cardman_fd = sd_open(path, O_RDWR | O_CREAT | O_TRUNC);
+        named_card_folders_invalidate();
         cardman_sectors_done = 0;
         cardprog_pos = 0;
         if (card_size > PS2_CARD_SIZE_8M) {
@@ -559,6 +590,11 @@ void ps2_cardman_open(void) {
         if (cardman_fd < 0)
             fatal("cannot open for creating new card");
 
+        // reserve the whole image up front so it ends up contiguous
+        if (sd_preallocate(cardman_fd, card_size) != 0) {
+            log(LOG_WARN, "could not preallocate %lu KB, image may be fragmented\n", (uint32_t)(card_size / 1024));
+        }
+
         log(LOG_INFO, "create new image at %s... ", path);
 
         if (cardman_cb)
@@ -618,11 +654,20 @@ void ps2_cardman_open(void) {
 }
 
 void ps2_cardman_close(void) {
+    sd_fast_path_stat_t fast_path;
+
     if (cardman_fd < 0)
         return;
     ps2_cardman_flush();
+    if (sd_get_fast_path_stat(cardman_fd, &fast_path) == 0) {
+        log(LOG_INFO, "raw sector access %s (lba %lu): %lu/%lu reads, %lu/%lu writes\n",
+            fast_path.active ? "active" : "inactive", (unsigned long)fast_path.first_lba,
+            (unsigned long)fast_path.fast_reads, (unsigned long)(fast_path.fast_reads + fast_path.slow_reads),
+            (unsigned long)fast_path.fast_writes, (unsigned long)(fast_path.fast_writes + fast_path.slow_writes));
+    }
     sd_close(cardman_fd);
     cardman_fd = -1;
+    ps2_save_index_clear();
     current_read_sector = 0;
     priority_sector = -1;
 #if WITH_PSRAM
@@ -821,6 +866,7 @@ bool ps2_cardman_is_idle(void) {
 
 void ps2_cardman_init(void) {
     card_variant = settings_get_ps2_variant();
+    named_card_folders_invalidate();
     if (!try_set_boot_card())
         set_default_card();
 
@@ -2,6 +2,7 @@
 #include "history_tracker/ps2_history_tracker.h"
 #include "psram.h"
 #include "ps2_cardman.h"
+#include "ps2_save_index.h"
 #include "debug.h"
 
 #include "bigmem.h"
@@ -126,7 +127,8 @@ void ps2_dirty_task(void) {
             ps2_dirty_unlock();
         }
         //DPRINTF("Writing %u\n", sector);
-        ps2_history_tracker_registerPageWrite(sector);
+        ps2_history_tracker_registerPageWrite(sector, flushbuf);
+        ps2_save_index_registerPageWrite(sector, flushbuf);
     }
     /* to make sure writes hit the storage medium */
     ps2_cardman_flush();
@@ -0,0 +1,411 @@
+#include "ps2_save_index.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "card_emu/ps2_mc_data_interface.h"
+#include "debug.h"
+#include "hardware/timer.h"
+#include "pico/platform.h"
+
+#if LOG_LEVEL_PS2_SI == 0
+    #define log(x...)
+#else
+    #define log(level, fmt, x...) LOG_PRINT(LOG_LEVEL_PS2_SI, level, fmt, ##x)
+#endif
+
+#define SUPERBLOCK_MAGIC        "Sony PS2 Memory Card Format "
+#define SUPERBLOCK_MAGIC_LENGTH 28
+#define SUPERBLOCK_PAGESIZE     0x28
+#define SUPERBLOCK_PAGES_PER_CL 0x2A
+#define SUPERBLOCK_ALLOC_OFFSET 0x34
+#define SUPERBLOCK_ROOTDIR      0x3C
+#define SUPERBLOCK_IFC_LIST     0x50
+#define MAX_IFC                 4
+
+#define ENTRY_MODE     0x00
+#define ENTRY_LENGTH   0x04
+#define ENTRY_CLUSTER  0x10
+#define ENTRY_MODIFIED 0x18
+#define ENTRY_NAME     0x40
+
+#define ENTRY_MODE_FILE   0x0010
+#define ENTRY_MODE_SUBDIR 0x0020
+#define ENTRY_MODE_EXISTS 0x8000
+
+#define FAT_ENTRY_USED       0x80000000
+#define FAT_CHAIN_END        0xFFFFFFFF
+#define FAT_ENTRIES_PER_PAGE (PS2_PAGE_SIZE / 4)
+
+/* Every directory entry takes one page, the root directory starts with
+ * "." and ".." */
+#define ROOT_SLOTS (PS2_SAVE_INDEX_MAX_ENTRIES + 2)
+
+/* Clusters of a save directory that are remembered to catch writes to its
+ * file entries, 16 entries with two pages per cluster */
+#define SAVE_DIR_CLUSTERS 8
+
+static struct {
+    bool valid;
+    bool root_stale;
+    uint16_t pages_per_cluster;
+    uint32_t alloc_offset;
+    uint32_t root_cluster;
+    uint32_t ifc_list[MAX_IFC];
+    uint32_t root_length;
+    uint32_t root_slots;
+    uint32_t root_clusters;
+    uint32_t root_chain[ROOT_SLOTS];
+} card;
+
+static ps2_save_entry_t entries[ROOT_SLOTS];
+static bool used[ROOT_SLOTS];
+static bool size_stale[ROOT_SLOTS];
+static uint32_t lengths[ROOT_SLOTS];
+static uint16_t dir_chain[ROOT_SLOTS][SAVE_DIR_CLUSTERS];
+static uint8_t dir_clusters[ROOT_SLOTS];
+static bool dir_partial[ROOT_SLOTS];    // longer than dir_chain, any write may touch it
+static int last_changed = -1;
+static uint32_t generation;
+static bool rebuild_pending;
+static ps2_save_index_read_t read_page;
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t page_of(uint32_t cluster, uint32_t page_in_cluster) {
+    return (card.alloc_offset + cluster) * card.pages_per_cluster + page_in_cluster;
+}
+
+static bool fat_next(uint32_t cluster, uint32_t *next) {
+    uint8_t buf[PS2_PAGE_SIZE];
+    uint32_t per_cluster = card.pages_per_cluster * FAT_ENTRIES_PER_PAGE;
+    uint32_t indirect_index = cluster / per_cluster;
+    uint32_t indirect_offset = indirect_index % per_cluster;
+    uint32_t fat_offset = cluster % per_cluster;
+
+    if (indirect_index / per_cluster >= MAX_IFC)
+        return false;
+
+    // FAT and indirect FAT clusters are absolute
+    uint32_t ifc = card.ifc_list[indirect_index / per_cluster];
+    if (read_page(ifc * card.pages_per_cluster + indirect_offset / FAT_ENTRIES_PER_PAGE, buf) != 0)
+        return false;
+
+    uint32_t fat_cluster = get_le32(&buf[(indirect_offset % FAT_ENTRIES_PER_PAGE) * 4]);
+    if (read_page(fat_cluster * card.pages_per_cluster + fat_offset / FAT_ENTRIES_PER_PAGE, buf) != 0)
+        return false;
+
+    uint32_t entry = get_le32(&buf[(fat_offset % FAT_ENTRIES_PER_PAGE) * 4]);
+    if ((entry == FAT_CHAIN_END) || !(entry & FAT_ENTRY_USED))
+        return false;
+
+    *next = entry & ~FAT_ENTRY_USED;
+    return true;
+}
+
+static bool parse_entry(int slot, const uint8_t *data) {
+    uint16_t mode = get_le16(&data[ENTRY_MODE]);
+    uint32_t length = get_le32(&data[ENTRY_LENGTH]);
+    ps2_save_entry_t entry = {};
+
+    if (!(mode & ENTRY_MODE_EXISTS) || !(mode & ENTRY_MODE_SUBDIR)) {
+        bool changed = used[slot];
+        used[slot] = false;
+        return changed;
+    }
+
+    memcpy(entry.name, &data[ENTRY_NAME], PS2_SAVE_NAME_LENGTH);
+    entry.cluster = get_le32(&data[ENTRY_CLUSTER]);
+    entry.mtime.resv = data[ENTRY_MODIFIED];
+    entry.mtime.sec = data[ENTRY_MODIFIED + 1];
+    entry.mtime.min = data[ENTRY_MODIFIED + 2];
+    entry.mtime.hour = data[ENTRY_MODIFIED + 3];
+    entry.mtime.day = data[ENTRY_MODIFIED + 4];
+    entry.mtime.month = data[ENTRY_MODIFIED + 5];
+    entry.mtime.year = get_le16(&data[ENTRY_MODIFIED + 6]);
+
+    if (used[slot]
+        && (length == lengths[slot])
+        && (strcmp(entry.name, entries[slot].name) == 0)
+        && (entry.cluster == entries[slot].cluster)
+        && (memcmp(&entry.mtime, &entries[slot].mtime, sizeof(entry.mtime)) == 0))
+        return false;
+
+    entries[slot] = entry;
+    lengths[slot] = length;
+    used[slot] = true;
+    size_stale[slot] = true;
+
+    return true;
+}
+
+static void dir_chain_add(int slot, uint32_t cluster) {
+    if ((dir_clusters[slot] < SAVE_DIR_CLUSTERS) && (cluster <= UINT16_MAX))
+        dir_chain[slot][dir_clusters[slot]++] = cluster;
+    else
+        dir_partial[slot] = true;
+}
+
+/* Hands the file entries of a save to visit until it returns true. The
+ * number of entries is kept in the root directory entry of the save. With
+ * record set the clusters of the directory are remembered on the way */
+static bool walk_save(int slot, bool record, bool (*visit)(const uint8_t *entry, uint32_t page, void *ctx), void *ctx) {
+    uint8_t buf[PS2_PAGE_SIZE];
+    uint32_t cluster = entries[slot].cluster;
+
+    if (record) {
+        dir_clusters[slot] = 0;
+        dir_partial[slot] = false;
+        dir_chain_add(slot, cluster);
+    }
+
+    for (uint32_t i = 1; i < lengths[slot]; i++) {
+        if (i % card.pages_per_cluster == 0) {
+            if (!fat_next(cluster, &cluster)) {
+                // the rest of the directory can not be followed
+                dir_partial[slot] |= record;
+                break;
+            }
+            if (record)
+                dir_chain_add(slot, cluster);
+        }
+        if (i < 2)
+            continue;
+
+        uint32_t page = page_of(cluster, i % card.pages_per_cluster);
+        if (read_page(page, buf) != 0)
+            break;
+
+        uint16_t mode = get_le16(&buf[ENTRY_MODE]);
+        if ((mode & ENTRY_MODE_EXISTS) && (mode & ENTRY_MODE_FILE) && visit(buf, page, ctx))
+            return true;
+    }
+
+    return false;
+}
+
+static bool add_file_size(const uint8_t *entry, uint32_t page, void *ctx) {
+    (void)page;
+    *(uint32_t *)ctx += get_le32(&entry[ENTRY_LENGTH]);
+    return false;
+}
+
+typedef struct {
+    const char *name;
+    ps2_save_file_t *file;
+} find_file_t;
+
+static bool match_file(const uint8_t *entry, uint32_t page, void *ctx) {
+    find_file_t *find = ctx;
+
+    if (strncmp((const char *)&entry[ENTRY_NAME], find->name, PS2_SAVE_NAME_LENGTH) != 0)
+        return false;
+
+    find->file->entry_page = page;
+    find->file->length = get_le32(&entry[ENTRY_LENGTH]);
+    find->file->data_page = find->file->length ? page_of(get_le32(&entry[ENTRY_CLUSTER]), 0) : 0;
+    return true;
+}
+
+/* A write to the directory of a save may change the length of its files */
+static void mark_save_written(uint32_t cluster) {
+    for (uint32_t slot = 2; slot < card.root_slots; slot++) {
+        bool hit = dir_partial[slot];
+
+        if (!used[slot] || size_stale[slot])
+            continue;
+        for (uint32_t i = 0; (i < dir_clusters[slot]) && !hit; i++)
+            hit = (dir_chain[slot][i] == cluster);
+        if (hit) {
+            size_stale[slot] = true;
+            last_changed = slot;
+            generation++;
+        }
+    }
+}
+
+/* Follows the root directory chain and reads the slots from first_slot on */
+static void walk_root(uint32_t first_slot) {
+    uint8_t buf[PS2_PAGE_SIZE];
+    uint32_t cluster = card.root_cluster;
+    uint32_t slots;
+
+    if (read_page(page_of(cluster, 0), buf) != 0)
+        return;
+
+    card.root_length = get_le32(&buf[ENTRY_LENGTH]);
+    slots = card.root_length < ROOT_SLOTS ? card.root_length : ROOT_SLOTS;
+    if (card.root_length > ROOT_SLOTS) {
+        log(LOG_WARN, "%s: only %u of %u root entries indexed\n", __func__, ROOT_SLOTS, card.root_length);
+    }
+
+    card.root_chain[0] = cluster;
+    card.root_clusters = 1;
+    while (card.root_clusters * card.pages_per_cluster < slots) {
+        if (!fat_next(cluster, &cluster)) {
+            // FAT not written yet, try again with the next update
+            slots = card.root_clusters * card.pages_per_cluster;
+            card.root_stale = true;
+            break;
+        }
+        card.root_chain[card.root_clusters++] = cluster;
+    }
+
+    for (uint32_t slot = first_slot < 2 ? 2 : first_slot; slot < slots; slot++) {
+        uint32_t page = page_of(card.root_chain[slot / card.pages_per_cluster], slot % card.pages_per_cluster);
+        if (read_page(page, buf) != 0)
+            break;
+        if (parse_entry(slot, buf))
+            generation++;
+    }
+
+    card.root_slots = slots;
+}
+
+static void refresh(void) {
+    if (rebuild_pending && read_page) {
+        ps2_save_index_build(read_page);
+    } else if (card.valid && card.root_stale) {
+        card.root_stale = false;
+        walk_root(card.root_slots);
+    }
+}
+
+void ps2_save_index_clear(void) {
+    memset(&card, 0x00, sizeof(card));
+    read_page = NULL;
+    memset(used, 0x00, sizeof(used));
+    last_changed = -1;
+    generation++;
+}
+
+void ps2_save_index_build(ps2_save_index_read_t read) {
+    uint8_t buf[PS2_PAGE_SIZE];
+    __unused uint64_t start = time_us_64();    // only logged
+
+    ps2_save_index_clear();
+    read_page = read;
+    rebuild_pending = false;
+
+    if ((read_page(0, buf) != 0)
+        || (memcmp(buf, SUPERBLOCK_MAGIC, SUPERBLOCK_MAGIC_LENGTH) != 0)
+        || (get_le16(&buf[SUPERBLOCK_PAGESIZE]) != PS2_PAGE_SIZE)) {
+        log(LOG_WARN, "%s: card is not formatted\n", __func__);
+        return;
+    }
+
+    card.pages_per_cluster = get_le16(&buf[SUPERBLOCK_PAGES_PER_CL]);
+    card.alloc_offset = get_le32(&buf[SUPERBLOCK_ALLOC_OFFSET]);
+    card.root_cluster = get_le32(&buf[SUPERBLOCK_ROOTDIR]);
+    for (int i = 0; i < MAX_IFC; i++)
+        card.ifc_list[i] = get_le32(&buf[SUPERBLOCK_IFC_LIST + i * 4]);
+
+    if (card.pages_per_cluster == 0)
+        return;
+
+    card.valid = true;
+    walk_root(2);
+
+    log(LOG_INFO, "%s: %u root entries in %u us\n", __func__, card.root_length, (uint32_t)(time_us_64() - start));
+}
+
+/* Pages of the root directory carry one entry each, they are parsed as they
+ * are written. Writes to "." may grow the directory and a new superblock
+ * means a format, both are read on the next query. Writes to the directory
+ * of a save only drop its size */
+void __time_critical_func(ps2_save_index_registerPageWrite)(uint32_t page, const uint8_t *data) {
+    uint32_t cluster, slot = ROOT_SLOTS;
+
+    // superblock rewritten, the card got formatted
+    if (page == 0)
+        rebuild_pending = true;
+
+    if (!card.valid)
+        return;
+
+    cluster = page / card.pages_per_cluster;
+    if (cluster < card.alloc_offset)
+        return;
+
+    cluster -= card.alloc_offset;
+    for (uint32_t i = 0; i < card.root_clusters; i++) {
+        if (card.root_chain[i] == cluster) {
+            slot = i * card.pages_per_cluster + page % card.pages_per_cluster;
+            break;
+        }
+    }
+
+    if (slot == ROOT_SLOTS) {
+        mark_save_written(cluster);
+    } else if (slot == 0) {
+        if (get_le32(&data[ENTRY_LENGTH]) != card.root_length)
+            card.root_stale = true;
+    } else if ((slot >= 2) && (slot < ROOT_SLOTS) && parse_entry(slot, data)) {
+        if (slot >= card.root_slots)
+            card.root_slots = slot + 1;
+        last_changed = slot;
+        generation++;
+        log(LOG_TRACE, "%s: slot %u now %s\n", __func__, slot, used[slot] ? entries[slot].name : "unused");
+    }
+}
+
+int ps2_save_index_slots(void) {
+    refresh();
+    return card.root_slots;
+}
+
+const ps2_save_entry_t *ps2_save_index_get(int slot) {
+    refresh();
+    if ((slot < 0) || (slot >= ROOT_SLOTS) || !used[slot])
+        return NULL;
+
+    if (size_stale[slot]) {
+        uint32_t size = 0;
+
+        walk_save(slot, true, add_file_size, &size);
+        entries[slot].size = size;
+        size_stale[slot] = false;
+    }
+
+    return &entries[slot];
+}
+
+bool ps2_save_index_find_file(int slot, const char *name, ps2_save_file_t *file) {
+    find_file_t find = { .name = name, .file = file };
+
+    refresh();
+    if ((slot < 0) || (slot >= ROOT_SLOTS) || !used[slot])
+        return false;
+
+    return walk_save(slot, false, match_file, &find);
+}
+
+bool ps2_save_index_complete(void) {
+    refresh();
+    return card.valid && !rebuild_pending && !card.root_stale && (card.root_length <= ROOT_SLOTS);
+}
+
+int ps2_save_index_find(const char *name) {
+    refresh();
+    for (uint32_t slot = 2; slot < card.root_slots; slot++) {
+        if (used[slot] && (strncmp(entries[slot].name, name, PS2_SAVE_NAME_LENGTH) == 0))
+            return slot;
+    }
+
+    return -1;
+}
+
+int ps2_save_index_last_changed(void) {
+    return last_changed;
+}
+
+uint32_t ps2_save_index_generation(void) {
+    return generation;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Index of the top level directories (saves) of the PS2 card. It is built
+ * once after the card is loaded and then follows the writes to the root
+ * directory pages */
+
+#define PS2_SAVE_INDEX_MAX_ENTRIES 64
+#define PS2_SAVE_NAME_LENGTH       32
+
+typedef struct {
+    uint8_t resv;
+    uint8_t sec;
+    uint8_t min;
+    uint8_t hour;
+    uint8_t day;
+    uint8_t month;
+    uint16_t year;
+} ps2_save_time_t;
+
+typedef struct {
+    char name[PS2_SAVE_NAME_LENGTH + 1];
+    uint32_t cluster;   /* first cluster, relative to the allocatable area */
+    uint32_t size;      /* bytes in all files of the save */
+    ps2_save_time_t mtime;
+} ps2_save_entry_t;
+
+typedef struct {
+    uint32_t entry_page;    /* page of its directory entry */
+    uint32_t data_page;     /* first page of its data, 0 when empty */
+    uint32_t length;
+} ps2_save_file_t;
+
+typedef int (*ps2_save_index_read_t)(uint32_t page, void *buf512);
+
+void ps2_save_index_build(ps2_save_index_read_t read_page);
+void ps2_save_index_clear(void);
+void ps2_save_index_registerPageWrite(uint32_t page, const uint8_t *data);
+
+/* Saves are addressed by their slot in the root directory. get returns NULL
+ * for unused slots */
+int ps2_save_index_slots(void);
+const ps2_save_entry_t *ps2_save_index_get(int slot);
+int ps2_save_index_find(const char *name);
+/* Looks a file up in the directory of a save, this reads the card */
+bool ps2_save_index_find_file(int slot, const char *name, ps2_save_file_t *file);
+/* True while every save of the card is in the index, a save that is not
+ * found is then not on the card */
+bool ps2_save_index_complete(void);
+
+/* Slot of the save written last, -1 if none. The generation changes with
+ * every update of the index */
+int ps2_save_index_last_changed(void);
+uint32_t ps2_save_index_generation(void);
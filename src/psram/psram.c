@@ -7,6 +7,7 @@
 #include "hardware/timer.h"
 #include "hardware/dma.h"
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -20,6 +21,18 @@ static pio_spi_inst_t spi = {
 
 static critical_section_t crit_psram;
 
+/* List transfers own the bus until their last segment is done, the next
+ * piece is started from the DMA irq without taking crit_psram */
+static struct {
+    const psram_segment_t *segs;
+    size_t count;
+    size_t idx;
+    size_t off;
+    bool write;
+    void (*cb)(void);
+} list;
+static volatile bool list_active;
+
 
 #define SPI_OP(stmt) \
     do { \
@@ -66,9 +79,95 @@ static test_t psram_tests[] = {
 
 #define NUM_TESTS (sizeof(psram_tests)/sizeof(*psram_tests))
 
+/* Waits for a running list outside of the critical section, its irq may
+ * be on this core */
+static void __time_critical_func(psram_enter)(void) {
+    while (1) {
+        while (list_active)
+            tight_loop_contents();
+
+        critical_section_enter_blocking(&crit_psram);
+        if (!list_active)
+            return;
+        critical_section_exit(&crit_psram);
+    }
+}
+
+static void __time_critical_func(psram_list_skip_empty)(void) {
+    while ((list.idx < list.count) && (list.off == list.segs[list.idx].sz)) {
+        list.idx++;
+        list.off = 0;
+    }
+}
+
+#define PSRAM_ASSERT_ONE_PAGE(addr, sz) assert((sz) <= PSRAM_PAGE_SIZE - (addr) % PSRAM_PAGE_SIZE)
+
+static void psram_list_next(void);
+
+static void __time_critical_func(psram_list_start)(void) {
+    const psram_segment_t *seg = &list.segs[list.idx];
+    uint32_t addr = seg->addr + list.off;
+    uint8_t *buf = (uint8_t *)seg->buf + list.off;
+    size_t sz = seg->sz - list.off;
+
+    if (sz > PSRAM_PAGE_SIZE - addr % PSRAM_PAGE_SIZE)
+        sz = PSRAM_PAGE_SIZE - addr % PSRAM_PAGE_SIZE;
+    list.off += sz;
+
+    gpio_put(spi.cs_pin, 0);
+    if (list.write)
+        pio_qspi_write8_dma(&spi, addr, buf, sz, psram_list_next);
+    else
+        pio_qspi_read8_dma(&spi, addr, buf, sz, psram_list_next);
+}
+
+/* DMA done irq of a list piece, runs on core0 */
+static void __time_critical_func(psram_list_next)(void) {
+    psram_list_skip_empty();
+    if (list.idx < list.count) {
+        psram_list_start();
+        return;
+    }
+
+    list_active = false;
+    if (list.cb)
+        list.cb();
+}
+
+static void __time_critical_func(psram_list_dma)(const psram_segment_t *segs, size_t count, bool write, void (*cb)(void)) {
+    psram_enter();
+    list.segs = segs;
+    list.count = count;
+    list.idx = 0;
+    list.off = 0;
+    list.write = write;
+    list.cb = cb;
+
+    psram_list_skip_empty();
+    if (list.idx == list.count) {
+        critical_section_exit(&crit_psram);
+        if (cb)
+            cb();
+        return;
+    }
+
+    list_active = true;
+    psram_list_start();
+    critical_section_exit(&crit_psram);
+}
+
+void __time_critical_func(psram_read_list_dma)(const psram_segment_t *segs, size_t count, void (*cb)(void)) {
+    psram_list_dma(segs, count, false, cb);
+}
+
+void __time_critical_func(psram_write_list_dma)(const psram_segment_t *segs, size_t count, void (*cb)(void)) {
+    psram_list_dma(segs, count, true, cb);
+}
+
 void __time_critical_func(psram_read_dma)(uint32_t addr, void *vbuf, size_t sz, void (*cb)(void)) {
     uint8_t *buf = vbuf;
-    critical_section_enter_blocking(&crit_psram);
+    PSRAM_ASSERT_ONE_PAGE(addr, sz);
+    psram_enter();
     gpio_put(spi.cs_pin, 0);
     pio_qspi_read8_dma(&spi, addr, buf, sz, cb);
     critical_section_exit(&crit_psram);
@@ -76,7 +175,8 @@ void __time_critical_func(psram_read_dma)(uint32_t addr, void *vbuf, size_t sz,
 
 void __time_critical_func(psram_write_dma)(uint32_t addr, void *vbuf, size_t sz, void (*cb)(void)) {
     uint8_t *buf = vbuf;
-    critical_section_enter_blocking(&crit_psram);
+    PSRAM_ASSERT_ONE_PAGE(addr, sz);
+    psram_enter();
     gpio_put(spi.cs_pin, 0);
     pio_qspi_write8_dma(&spi, addr, buf, sz, cb);
     critical_section_exit(&crit_psram);
@@ -84,7 +184,8 @@ void __time_critical_func(psram_write_dma)(uint32_t addr, void *vbuf, size_t sz,
 
 void __time_critical_func(psram_write)(uint32_t addr, void *vbuf, size_t sz) {
     uint8_t *buf = vbuf;
-    critical_section_enter_blocking(&crit_psram);
+    PSRAM_ASSERT_ONE_PAGE(addr, sz);
+    psram_enter();
     gpio_put(spi.cs_pin, 0);
     pio_qspi_write8_blocking(&spi, addr, buf, sz);
     critical_section_exit(&crit_psram);
@@ -101,6 +202,8 @@ inline void psram_wait_for_dma() {
     //while(pio_qspi_dma_active()) {tight_loop_contents();
     //printf("Rd: %u Wr: %u Reg: %08x\n", psram_read_dma_remaining(), psram_write_dma_remaining(), dma_channel_hw_addr(PIO_SPI_DMA_RX_DATA_CHAN)->ctrl_trig); if (cnt-- == 0) fatal("Took too long");
     //};
+    while (list_active)
+        tight_loop_contents();
     dma_channel_wait_for_finish_blocking(PIO_SPI_DMA_TX_CMD_CHAN);
     dma_channel_wait_for_finish_blocking(PIO_SPI_DMA_RX_CMD_CHAN);
     dma_channel_wait_for_finish_blocking(PIO_SPI_DMA_TX_DATA_CHAN);
@@ -136,6 +239,25 @@ static void psram_run_tests(void) {
         }
     }
 
+    /* list transfers, both segments cross a PSRAM page */
+    psram_segment_t segs_write[] = {
+        { TEST_BLOCK_SIZE * 3 + 100, buf_write, 300 },
+        { TEST_BLOCK_SIZE * 5 - 200, buf_write + 300, TEST_BLOCK_SIZE - 300 },
+    };
+    psram_segment_t segs_read[] = {
+        { segs_write[0].addr, buf_read, segs_write[0].sz },
+        { segs_write[1].addr, buf_read + 300, segs_write[1].sz },
+    };
+
+    memset(buf_read, 0, sizeof(buf_read));
+    psram_write_list_dma(segs_write, 2, NULL);
+    psram_wait_for_dma();
+    psram_read_list_dma(segs_read, 2, NULL);
+    psram_wait_for_dma();
+
+    if (memcmp(buf_write, buf_read, TEST_BLOCK_SIZE) != 0)
+        fatal("PSRAM failed list test");
+
     uint64_t end = time_us_64();
     printf("PSRAM passed all tests -- took %.2f ms -- avg speed %.2f kB/s\n",
         (end - start) / 1000.0,
@@ -3,11 +3,28 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+/* Bursts wrap around within a page of the PSRAM. A single transfer must stay
+ * within one page, list transfers are split at the boundaries */
+#define PSRAM_PAGE_SIZE 1024
+
+/* One piece of a list transfer. The list has to stay valid until its
+ * callback ran */
+typedef struct {
+    uint32_t addr;
+    void *buf;
+    size_t sz;
+} psram_segment_t;
+
 void psram_init(void);
 void psram_read(uint32_t addr, void *buf, size_t sz);
 void psram_write(uint32_t addr, void *buf, size_t sz);
 void psram_read_dma(uint32_t addr, void *buf, size_t sz, void (*cb)(void));
 void psram_write_dma(uint32_t addr, void *buf, size_t sz, void (*cb)(void));
+/* Runs the segments back to back from the DMA irq, cb is called once after
+ * the last one. Segments are split at the PSRAM page boundaries. The irq is
+ * on core 0, core 1 sticks to single transfers rather than wait on it */
+void psram_read_list_dma(const psram_segment_t *segs, size_t count, void (*cb)(void));
+void psram_write_list_dma(const psram_segment_t *segs, size_t count, void (*cb)(void));
 uint32_t psram_write_dma_remaining();
 uint32_t psram_read_dma_remaining();
 void psram_wait_for_dma();
@@ -21,14 +21,59 @@ bool str_is_integer(const char *str) {
     return true;
 }
 
-bool try_set_named_card_folder(const char *cards_dir, int it_idx, char *folder_name, size_t folder_name_size) {
-    bool ret = false;
+/* Named card folders are scanned once per card home and kept sorted, so
+ * stepping through them costs no directory reads. A list holds a window of
+ * MAX_NAMED_CARD_FOLDERS of them, with more folders than that the window is
+ * moved by scanning the home again */
+#define MAX_NAMED_CARD_FOLDERS  (64)
+#define MAX_NAMED_CARD_LISTS    (2)
+#define MAX_CARDS_DIR_LENGTH    (32)
+
+typedef struct {
+    bool valid;
+    bool full;              // folders after the window were dropped
+    uint32_t last_used;
+    char cards_dir[MAX_CARDS_DIR_LENGTH];
+    int base;               // index of names[0]
+    uint8_t count;
+    char names[MAX_NAMED_CARD_FOLDERS][MAX_GAME_ID_LENGTH];
+} named_card_list_t;
+
+static named_card_list_t named_card_lists[MAX_NAMED_CARD_LISTS];
+static uint32_t named_card_list_uses;
+
+static void named_card_list_insert(named_card_list_t *list, const char *name) {
+    int lo = 0, hi = list->count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(list->names[mid], name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (list->count == MAX_NAMED_CARD_FOLDERS)
+        list->full = true;
+    if (lo == MAX_NAMED_CARD_FOLDERS)
+        return;
+    if (list->count < MAX_NAMED_CARD_FOLDERS)
+        list->count++;
+    memmove(list->names[lo + 1], list->names[lo], (list->count - 1 - lo) * sizeof(list->names[0]));
+    strlcpy(list->names[lo], name, sizeof(list->names[0]));
+}
+
+/* Fills the window with the first folders that sort after the given name */
+static void named_card_list_scan(named_card_list_t *list, const char *after) {
     int dir_fd, it_fd = -1;
     char filename[MAX_GAME_ID_LENGTH + 1] = {}; // +1 byte to be able to tell whether the name was truncated or not
 
-    dir_fd = sd_open(cards_dir, O_RDONLY);
+    list->count = 0;
+    list->full = false;
+
+    dir_fd = sd_open(list->cards_dir, O_RDONLY);
     if (dir_fd < 0)
-        return false;
+        return;
 
     it_fd = sd_iterate_dir(dir_fd, it_fd);
     while (it_fd != -1) {
@@ -38,30 +83,69 @@ bool try_set_named_card_folder(const char *cards_dir, int it_idx, char *folder_n
         }
 
         // Skip boot card, normal cards, and cards with names longer than 15 characters
-        if (strcmp(filename, "BOOT") == 0 ||
+        if (!(strcmp(filename, "BOOT") == 0 ||
             (strncmp(filename, "Card", 4) == 0 && str_is_integer(filename + 4)) ||
-            (strlen(filename) >= MAX_GAME_ID_LENGTH)) {
-            it_fd = sd_iterate_dir(dir_fd, it_fd);
-            continue;
+            (strlen(filename) >= MAX_GAME_ID_LENGTH) ||
+            (strcmp(filename, after) <= 0))) {
+            named_card_list_insert(list, filename);
         }
 
-        if (it_idx > 0) {
-            it_idx--;
-            it_fd = sd_iterate_dir(dir_fd, it_fd);
-            continue;
+        it_fd = sd_iterate_dir(dir_fd, it_fd);
+    }
+
+    sd_close(dir_fd);
+}
+
+static named_card_list_t *named_card_list_get(const char *cards_dir) {
+    named_card_list_t *list = NULL;
+
+    for (int i = 0; i < MAX_NAMED_CARD_LISTS; i++) {
+        if (named_card_lists[i].valid && strcmp(named_card_lists[i].cards_dir, cards_dir) == 0) {
+            list = &named_card_lists[i];
+            break;
         }
+        if (!list || !named_card_lists[i].valid || (list->valid && named_card_lists[i].last_used < list->last_used))
+            list = &named_card_lists[i];
+    }
 
-        // This is the valid folder name
-        snprintf(folder_name, folder_name_size, "%s", filename);
-        ret = true;
-        break;
+    if (!list->valid || strcmp(list->cards_dir, cards_dir) != 0) {
+        strlcpy(list->cards_dir, cards_dir, sizeof(list->cards_dir));
+        list->base = 0;
+        named_card_list_scan(list, "");
+        list->valid = true;
     }
+    list->last_used = ++named_card_list_uses;
+
+    return list;
+}
 
+void named_card_folders_invalidate(void) {
+    for (int i = 0; i < MAX_NAMED_CARD_LISTS; i++)
+        named_card_lists[i].valid = false;
+}
 
-    if (it_fd != -1)
-        sd_close(it_fd);
+bool try_set_named_card_folder(const char *cards_dir, int it_idx, char *folder_name, size_t folder_name_size) {
+    named_card_list_t *list = named_card_list_get(cards_dir);
 
-    sd_close(dir_fd);
+    if (it_idx < 0)
+        return false;
 
-    return ret;
-}
\ No newline at end of file
+    if (it_idx < list->base) {
+        list->base = 0;
+        named_card_list_scan(list, "");
+    }
+    while ((it_idx >= list->base + list->count) && list->full) {
+        char last[MAX_GAME_ID_LENGTH];
+
+        strlcpy(last, list->names[list->count - 1], sizeof(last));
+        list->base += list->count;
+        named_card_list_scan(list, last);
+    }
+
+    if (it_idx >= list->base + list->count)
+        return false;
+
+    snprintf(folder_name, folder_name_size, "%s", list->names[it_idx - list->base]);
+
+    return true;
+}
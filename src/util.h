@@ -23,3 +23,5 @@ static inline uint64_t __time_critical_func(RAM_time_us_64)() {
 }
 
 bool try_set_named_card_folder(const char *cards_dir, int it_idx, char *folder_name, size_t folder_name_size);
+/* Drops the cached named card folder lists, the next lookup scans again */
+void named_card_folders_invalidate(void);